@@ -0,0 +1,56 @@
+/*
+ * Test.h
+ * Minimal host unit test helpers: checks count failures and print their location, 'TestReport' gives the test
+ * program exit status.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+#include <math.h>
+
+static int TestChecks = 0;
+static int TestFailures = 0;
+
+//----------------------------------------
+// Checks condition
+//----------------------------------------
+#define CHECK(condition)																	\
+	do																						\
+	{																						\
+		++TestChecks;																		\
+		if(!(condition))																	\
+		{																					\
+			++TestFailures;																	\
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);			\
+		}																					\
+	} while(0)
+
+//----------------------------------------
+// Checks that 'value' is within
+// 'tolerance' of 'expected'
+//----------------------------------------
+#define CHECK_CLOSE(value, expected, tolerance)												\
+	do																						\
+	{																						\
+		double v_ = (value), e_ = (expected);												\
+		++TestChecks;																		\
+		if(!(fabs(v_ - e_) <= (tolerance)))													\
+		{																					\
+			++TestFailures;																	\
+			printf("%s:%d: %s = %g, expected %g (+/- %g)\n", __FILE__, __LINE__, #value, v_, e_, (double)(tolerance));	\
+		}																					\
+	} while(0)
+
+//----------------------------------------
+// Prints test summary and returns test
+// program exit status
+//----------------------------------------
+static int TestReport(const char* name)
+{
+	printf("%s: %d checks, %d failed\n", name, TestChecks, TestFailures);
+	return TestFailures == 0 ? 0 : 1;
+}
+
+#endif /* TEST_H_ */
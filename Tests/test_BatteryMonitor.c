@@ -0,0 +1,233 @@
+/*
+ * test_BatteryMonitor.c
+ * Battery monitor against a simulated 3S LiPo discharge: open circuit voltage curve, internal resistance sag
+ * under hover current and throttle punches, ADC noise and a weaker cell.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "Utils/BatteryMonitor.h"
+#include "Test.h"
+
+//----------------------------------------
+// Same configuration as 'main.c'
+//----------------------------------------
+#define SAMPLE_PERIOD		0.08f
+#define TIME_CONSTANT		0.5f
+
+static BatteryMonitor NewMonitor(void)
+{
+	BatteryMonitor battery =
+	{
+		.cellCount = 3,
+		.filterAlpha = SAMPLE_PERIOD / (TIME_CONSTANT + SAMPLE_PERIOD),
+		.presentVoltage = 2.5f,
+		.lowVoltage = 3.5f,
+		.criticalVoltage = 3.3f,
+		.hysteresis = 0.1f,
+		.nominalVoltage = 3.8f,
+		.maxThrustScale = 1.5f
+	};
+	return battery;
+}
+
+//----------------------------------------
+// LiPo cell open circuit voltage from state
+// of charge (0 to 1)
+//----------------------------------------
+static float CellOpenCircuitVoltage(float charge)
+{
+	static const float curve[][2] = { { 0.0f, 3.0f }, { 0.05f, 3.3f }, { 0.1f, 3.55f }, { 0.2f, 3.7f }, { 0.5f, 3.8f },
+									  { 0.8f, 3.95f }, { 0.9f, 4.05f }, { 1.0f, 4.2f } };
+	uint32_t i = 1;
+
+	if(charge <= 0.0f)
+		return curve[0][1];
+	while(i < 7 && charge > curve[i][0])
+		++i;
+	return curve[i - 1][1] + (curve[i][1] - curve[i - 1][1]) * (charge - curve[i - 1][0]) / (curve[i][0] - curve[i - 1][0]);
+}
+
+//----------------------------------------
+// Simulated pack: 5000mAh cells (third
+// one 10% weaker), 6 mOhms per cell
+//----------------------------------------
+typedef struct
+{
+	float charge[3];
+	float capacity[3];
+} Pack;
+
+static void SampleTaps(const Pack* pack, float current, float taps[3])
+{
+	float sum = 0.0f;
+	uint32_t i;
+
+	for(i = 0; i < 3; ++i)
+	{
+		float noise = ((float)rand() / RAND_MAX - 0.5f) * 0.02f;
+		sum += CellOpenCircuitVoltage(pack->charge[i]) - current * 0.006f + noise;
+		taps[i] = sum;
+	}
+}
+
+static void Discharge(Pack* pack, float current, float dt)
+{
+	uint32_t i;
+	for(i = 0; i < 3; ++i)
+		pack->charge[i] -= current * dt / 3600.0f / pack->capacity[i];
+}
+
+//----------------------------------------
+// Flight discharge: hover at 15A with 40A
+// punches of 0.5s every 10s. Alarms must be
+// raised in order, once each (punches
+// don't toggle them), without delay once
+// weakest cell hover voltage is below
+// thresholds and at most PUNCH_SAG volts
+// earlier (filtered punch sag: alarms are
+// raised on loaded voltage).
+//----------------------------------------
+#define PUNCH_SAG		0.1f
+
+static void TestFlightDischarge(void)
+{
+	BatteryMonitor battery = NewMonitor();
+	Pack pack = { .charge = { 1.0f, 1.0f, 1.0f }, .capacity = { 5.0f, 5.0f, 4.5f } };
+	uint32_t changes = 0, step;
+	float lowTime = -1.0f, criticalTime = -1.0f;
+	BatteryState previous = battery.state;
+	bool monotonic = true;
+
+	srand(1);
+	for(step = 0; step < 20000 && battery.state != BATTERY_CRITICAL; ++step)
+	{
+		float time = step * SAMPLE_PERIOD;
+		float current = (step % 125) < 6 ? 40.0f : 15.0f;
+		float taps[3];
+
+		SampleTaps(&pack, current, taps);
+		if(BatteryMonitorUpdate(&battery, taps))
+		{
+			++changes;
+			monotonic &= battery.state > previous;
+			previous = battery.state;
+
+			// Weakest cell hover voltage when an alarm is raised
+			float hoverCell = CellOpenCircuitVoltage(pack.charge[2]) - 15.0f * 0.006f;
+			if(battery.state == BATTERY_LOW)
+			{
+				lowTime = time;
+				CHECK(hoverCell < 3.5f + PUNCH_SAG && hoverCell > 3.5f - 0.05f);
+			}
+			else if(battery.state == BATTERY_CRITICAL)
+			{
+				criticalTime = time;
+				CHECK(hoverCell < 3.3f + PUNCH_SAG && hoverCell > 3.3f - 0.05f);
+			}
+		}
+
+		Discharge(&pack, current, SAMPLE_PERIOD);
+
+		// Thrust scale compensates loaded pack voltage
+		if(battery.state != BATTERY_ABSENT)
+		{
+			float ratio = 3.8f * 3.0f / battery.voltage;
+			float expected = ratio * ratio > 1.5f ? 1.5f : ratio * ratio;
+			CHECK_CLOSE(BatteryThrustScale(&battery), expected, 1e-5);
+		}
+	}
+
+	// Absent -> ok -> low -> critical
+	CHECK(changes == 3);
+	CHECK(monotonic);
+	CHECK(lowTime > 0.0f && criticalTime > lowTime);
+
+	// Weakest cell raised alarms
+	CHECK(battery.minCell == battery.cells[2]);
+}
+
+//----------------------------------------
+// Landing: loaded voltage rebounds, alarms
+// recover one level at a time and only
+// above thresholds plus hysteresis
+//----------------------------------------
+static void TestRecovery(void)
+{
+	BatteryMonitor battery = NewMonitor();
+	float taps[3];
+	uint32_t i;
+
+	// Critical
+	for(i = 0; i < 50; ++i)
+	{
+		taps[0] = 3.25f; taps[1] = 6.5f; taps[2] = 9.75f;
+		BatteryMonitorUpdate(&battery, taps);
+	}
+	CHECK(battery.state == BATTERY_CRITICAL);
+
+	// Just above critical threshold but within hysteresis: stays critical
+	for(i = 0; i < 100; ++i)
+	{
+		taps[0] = 3.35f; taps[1] = 6.7f; taps[2] = 10.05f;
+		BatteryMonitorUpdate(&battery, taps);
+	}
+	CHECK(battery.state == BATTERY_CRITICAL);
+
+	// Rebound to 3.8V: recovers to low first, then ok on next update
+	taps[0] = 3.8f; taps[1] = 7.6f; taps[2] = 11.4f;
+	bool sawLow = false;
+	for(i = 0; i < 100; ++i)
+	{
+		BatteryMonitorUpdate(&battery, taps);
+		sawLow |= battery.state == BATTERY_LOW;
+	}
+	CHECK(sawLow);
+	CHECK(battery.state == BATTERY_OK);
+
+	// Single sample dips are filtered out
+	taps[0] = 3.0f; taps[1] = 6.8f; taps[2] = 10.6f;
+	BatteryMonitorUpdate(&battery, taps);
+	CHECK(battery.state == BATTERY_OK);
+}
+
+//----------------------------------------
+// Board powered by USB (no battery) and
+// thrust scale bounds
+//----------------------------------------
+static void TestAbsentAndBounds(void)
+{
+	BatteryMonitor battery = NewMonitor();
+	float taps[3] = { 0.1f, 0.2f, 0.3f };
+
+	CHECK(!BatteryMonitorUpdate(&battery, taps));
+	CHECK(battery.state == BATTERY_ABSENT);
+	CHECK(BatteryThrustScale(&battery) == 1.0f);
+
+	// Battery plugged in: filter starts from first sample
+	taps[0] = 3.8f; taps[1] = 7.6f; taps[2] = 11.4f;
+	CHECK(BatteryMonitorUpdate(&battery, taps));
+	CHECK(battery.state == BATTERY_OK);
+	CHECK_CLOSE(battery.voltage, 11.4, 1e-5);
+	CHECK_CLOSE(BatteryThrustScale(&battery), 1.0, 1e-5);
+
+	// Overcharged pack: scale bounded to 1/max
+	battery.voltage = 20.0f;
+	CHECK_CLOSE(BatteryThrustScale(&battery), 1.0 / 1.5, 1e-5);
+
+	// Unplugged
+	taps[0] = 0.0f; taps[1] = 0.0f; taps[2] = 0.0f;
+	CHECK(BatteryMonitorUpdate(&battery, taps));
+	CHECK(battery.state == BATTERY_ABSENT);
+}
+
+int main(void)
+{
+	TestFlightDischarge();
+	TestRecovery();
+	TestAbsentAndBounds();
+
+	return TestReport("BatteryMonitor");
+}
@@ -0,0 +1,271 @@
+/*
+ * test_PIDEngine.c
+ * PID engine step responses against analytic references.
+ * Plants are driven by the PID correction (u = -out, as rate setpoints are angle PIDs corrections opposites).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Utils/PIDEngine.h"
+#include "Test.h"
+
+#define DT		0.0025f
+
+//----------------------------------------
+// Closed loop step response of an
+// integrator plant (y' = u, u saturated at
+// +/- 'limit' if positive). Returns maximum
+// output reached and gives final output.
+//----------------------------------------
+static float IntegratorStep(PID* pid, float setpoint, float limit, uint32_t steps, float* finalOutput)
+{
+	float output = 0.0f, peak = 0.0f;
+	uint32_t i;
+
+	for(i = 0; i < steps; ++i)
+	{
+		pid->in = setpoint;
+		pid->error = output - setpoint;
+		ProcessPID(pid, DT);
+
+		float applied = pid->out;
+		if(limit > 0.0f)
+		{
+			applied = applied > limit ? limit : (applied < -limit ? -limit : applied);
+			PIDTrackOutput(pid, applied, DT);
+		}
+
+		output += -applied * DT;
+		peak = output > peak ? output : peak;
+	}
+
+	*finalOutput = output;
+	return peak;
+}
+
+//----------------------------------------
+// Proportional control of an integrator
+// plant: y(t) = 1 - exp(-Kp*t)
+//----------------------------------------
+static void TestProportionalStep(void)
+{
+	PID pid = { .Kp = 4.0f, .b = 1.0f, .ILimit = 1.0f };
+	float output = 0.0f;
+	uint32_t i;
+
+	for(i = 1; i <= 400; ++i)
+	{
+		pid.in = 1.0f;
+		pid.error = output - 1.0f;
+		ProcessPID(&pid, DT);
+		output += -pid.out * DT;
+
+		if(i % 40 == 0)
+			CHECK_CLOSE(output, 1.0 - exp(-4.0 * i * DT), 0.01);
+	}
+}
+
+//----------------------------------------
+// Proportional-integral control of a first
+// order plant (y' = (u - y)/tau) with a
+// constant disturbance: no static error
+//----------------------------------------
+static void TestIntegralRemovesStaticError(void)
+{
+	PID pid = { .Kp = 2.0f, .Ki = 4.0f, .b = 1.0f, .ILimit = 10.0f };
+	const float tau = 0.2f, disturbance = -0.3f;
+	float output = 0.0f;
+	uint32_t i;
+
+	for(i = 0; i < 4000; ++i)
+	{
+		pid.in = 1.0f;
+		pid.error = output - 1.0f;
+		ProcessPID(&pid, DT);
+		output += (-pid.out + disturbance - output) / tau * DT;
+	}
+
+	CHECK_CLOSE(output, 1.0, 0.001);
+	CHECK_CLOSE(pid.ITerm, -(1.0f - disturbance), 0.01);
+}
+
+//----------------------------------------
+// Setpoint steps don't kick derivative term
+// (derivative on measure)
+//----------------------------------------
+static void TestNoDerivativeKick(void)
+{
+	PID pid = { .Kp = 1.0f, .Kd = 0.5f, .b = 1.0f, .ILimit = 1.0f };
+
+	pid.in = 0.0f;
+	pid.error = 0.2f;
+	ProcessPID(&pid, DT);
+
+	// Setpoint step of 1 with same measure (0.2): a derivative on error would kick by Kd*0.8/dt (160)
+	pid.in = 1.0f;
+	pid.error = -0.8f;
+	ProcessPID(&pid, DT);
+
+	CHECK_CLOSE(pid.DTerm, 0.0, 1e-3);
+	CHECK_CLOSE(pid.out, -0.8, 1e-3);
+
+	// Measure step of 0.1 gives Kd*0.1/dt
+	pid.error = -0.7f;
+	ProcessPID(&pid, DT);
+	CHECK_CLOSE(pid.DTerm, 0.5 * 0.1 / DT, 1e-3);
+}
+
+//----------------------------------------
+// Derivative low-pass filter: measure step
+// response of a first-order filter at
+// 'DCutoff' and ramp response converging
+// to Kd*slope
+//----------------------------------------
+static void TestDerivativeFilter(void)
+{
+	PID pid = { .Kd = 0.01f, .b = 1.0f, .DCutoff = 40.0f, .ILimit = 1.0f };
+	const float alpha = DT / (DT + 1.0f / (6.28318531f * 40.0f));
+	float expected;
+	uint32_t i;
+
+	pid.error = 0.0f;
+	ProcessPID(&pid, DT);
+
+	// Measure step: filtered derivative impulse then geometric decay
+	pid.error = 1.0f;
+	ProcessPID(&pid, DT);
+	expected = alpha * 0.01f * 1.0f / DT;
+	CHECK_CLOSE(pid.DTerm, expected, 1e-4);
+	CHECK(pid.DTerm < 0.01f / DT);
+
+	for(i = 0; i < 10; ++i)
+	{
+		ProcessPID(&pid, DT);
+		expected *= 1.0f - alpha;
+	}
+	CHECK_CLOSE(pid.DTerm, expected, 1e-4);
+
+	// Measure ramp of 2 units/s
+	ResetPID(&pid);
+	for(i = 0; i < 400; ++i)
+	{
+		pid.error = 2.0f * i * DT;
+		ProcessPID(&pid, DT);
+	}
+	CHECK_CLOSE(pid.DTerm, 0.01 * 2.0, 1e-4);
+
+	// No filter: raw derivative
+	PID raw = { .Kd = 0.01f, .b = 1.0f, .ILimit = 1.0f };
+	raw.error = 0.0f;
+	ProcessPID(&raw, DT);
+	raw.error = 1.0f;
+	ProcessPID(&raw, DT);
+	CHECK_CLOSE(raw.DTerm, 0.01 / DT, 1e-3);
+}
+
+//----------------------------------------
+// Back-calculation anti-windup: saturated
+// step response overshoots far less with
+// tracking and still reaches setpoint
+//----------------------------------------
+static void TestBackCalculation(void)
+{
+	PID windup = { .Kp = 4.0f, .Ki = 8.0f, .b = 1.0f, .ILimit = 10.0f };
+	PID tracking = { .Kp = 4.0f, .Ki = 8.0f, .b = 1.0f, .Kt = 10.0f, .ILimit = 10.0f };
+	float windupFinal, trackingFinal;
+
+	float windupPeak = IntegratorStep(&windup, 1.0f, 0.5f, 4000, &windupFinal);
+	float trackingPeak = IntegratorStep(&tracking, 1.0f, 0.5f, 4000, &trackingFinal);
+
+	CHECK(windupPeak > 1.2f);
+	CHECK(trackingPeak < 1.05f);
+	CHECK(trackingPeak < windupPeak);
+	CHECK_CLOSE(trackingFinal, 1.0, 0.001);
+
+	// Without saturation, tracking has no effect
+	PID free = { .Kp = 4.0f, .Ki = 8.0f, .b = 1.0f, .Kt = 10.0f, .ILimit = 10.0f };
+	PID reference = { .Kp = 4.0f, .Ki = 8.0f, .b = 1.0f, .ILimit = 10.0f };
+	float freeFinal, referenceFinal;
+	IntegratorStep(&free, 1.0f, 100.0f, 400, &freeFinal);
+	IntegratorStep(&reference, 1.0f, 0.0f, 400, &referenceFinal);
+	CHECK_CLOSE(freeFinal, referenceFinal, 1e-5);
+}
+
+//----------------------------------------
+// Gain schedule: factors held before first
+// and after last points, interpolated in
+// between
+//----------------------------------------
+static void TestSchedule(void)
+{
+	static const PIDSchedule schedule =
+	{
+		.count = 3,
+		.points = {	{ .input = 0.2f,	.Kp = 0.5f,	.Ki = 1.0f,	.Kd = 1.0f },
+					{ .input = 0.4f,	.Kp = 1.0f,	.Ki = 1.0f,	.Kd = 1.0f },
+					{ .input = 0.8f,	.Kp = 2.0f,	.Ki = 1.0f,	.Kd = 1.0f } }
+	};
+	static const struct { float input, factor; } expected[] =
+	{
+		{ 0.0f, 0.5f }, { 0.2f, 0.5f }, { 0.3f, 0.75f }, { 0.4f, 1.0f }, { 0.6f, 1.5f }, { 0.8f, 2.0f }, { 1.0f, 2.0f }
+	};
+	uint32_t i;
+
+	for(i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
+	{
+		PID pid = { .Kp = 2.0f, .b = 1.0f, .ILimit = 1.0f, .schedule = &schedule };
+		pid.scheduleInput = expected[i].input;
+		pid.error = 1.0f;
+		ProcessPID(&pid, DT);
+		CHECK_CLOSE(pid.out, 2.0f * expected[i].factor, 1e-5);
+	}
+
+	// Integral and derivative factors
+	static const PIDSchedule single = { .count = 1, .points = { { .input = 0.0f, .Kp = 1.0f, .Ki = 0.5f, .Kd = 3.0f } } };
+	PID pid = { .Ki = 2.0f, .Kd = 0.1f, .b = 1.0f, .ILimit = 10.0f, .schedule = &single };
+	pid.error = 1.0f;
+	ProcessPID(&pid, DT);
+	pid.error = 2.0f;
+	ProcessPID(&pid, DT);
+	CHECK_CLOSE(pid.ITerm, 0.5 * 2.0 * (1.0 * DT + 1.5 * DT), 1e-6);
+	CHECK_CLOSE(pid.DTerm, 3.0 * 0.1 * 1.0 / DT, 1e-3);
+}
+
+//----------------------------------------
+// Setpoint weighting and integral limit
+//----------------------------------------
+static void TestSetpointWeightAndILimit(void)
+{
+	PID pid = { .Kp = 2.0f, .b = 0.0f, .ILimit = 1.0f };
+	pid.in = 1.0f;
+	pid.error = -1.0f;
+	ProcessPID(&pid, DT);
+	CHECK_CLOSE(pid.out, 0.0, 1e-6);
+
+	PID limited = { .Ki = 100.0f, .b = 1.0f, .ILimit = 0.3f };
+	uint32_t i;
+	for(i = 0; i < 100; ++i)
+	{
+		limited.error = 1.0f;
+		ProcessPID(&limited, DT);
+	}
+	CHECK_CLOSE(limited.ITerm, 0.3, 1e-6);
+
+	ResetPID(&limited);
+	CHECK(limited.ITerm == 0.0f && limited.DTerm == 0.0f && !limited.initialized);
+}
+
+int main(void)
+{
+	TestProportionalStep();
+	TestIntegralRemovesStaticError();
+	TestNoDerivativeKick();
+	TestDerivativeFilter();
+	TestBackCalculation();
+	TestSchedule();
+	TestSetpointWeightAndILimit();
+
+	return TestReport("PIDEngine");
+}
@@ -0,0 +1,200 @@
+/*
+ * test_RelayTuner.c
+ * Relay autotuner against a second-order-plus-delay plant: K*exp(-L*s) / ((T1*s + 1)*(T2*s + 1)), whose ultimate
+ * gain and period are known analytically. Tuned gains must stabilize the plant.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "Utils/RelayTuner.h"
+#include "Utils/PIDEngine.h"
+#include "Test.h"
+
+#define DT				0.0025f
+#define SUBSTEPS		10
+
+//----------------------------------------
+// Plant: gain, lags time constants and
+// delay (whole count of DT periods)
+//----------------------------------------
+#define PLANT_K			2.0f
+#define PLANT_T1		0.1f
+#define PLANT_T2		0.02f
+#define PLANT_DELAY		4
+
+typedef struct
+{
+	float delayed[PLANT_DELAY];
+	uint32_t head;
+	float x1, x2;
+} Plant;
+
+//----------------------------------------
+// Applies input 'u' (held over DT) and
+// returns plant output
+//----------------------------------------
+static float PlantStep(Plant* plant, float u)
+{
+	uint32_t i;
+
+	float delayed = plant->delayed[plant->head];
+	plant->delayed[plant->head] = u;
+	plant->head = (plant->head + 1) % PLANT_DELAY;
+
+	for(i = 0; i < SUBSTEPS; ++i)
+	{
+		plant->x1 += (PLANT_K * delayed - plant->x1) / PLANT_T1 * (DT / SUBSTEPS);
+		plant->x2 += (plant->x1 - plant->x2) / PLANT_T2 * (DT / SUBSTEPS);
+	}
+	return plant->x2;
+}
+
+//----------------------------------------
+// Analytic ultimate gain and period: phase
+// crossover frequency solves
+// w*L + atan(w*T1) + atan(w*T2) = PI. Half
+// a sample of zero-order hold is added to
+// the delay.
+//----------------------------------------
+static void UltimateGainAndPeriod(double* Ku, double* Tu)
+{
+	const double L = PLANT_DELAY * DT + DT / 2.0;
+	double low = 0.0, high = M_PI / L;
+	uint32_t i;
+
+	for(i = 0; i < 100; ++i)
+	{
+		double w = (low + high) / 2.0;
+		if(w * L + atan(w * PLANT_T1) + atan(w * PLANT_T2) < M_PI)
+			low = w;
+		else
+			high = w;
+	}
+
+	*Ku = sqrt((1.0 + low*low*PLANT_T1*PLANT_T1) * (1.0 + low*low*PLANT_T2*PLANT_T2)) / PLANT_K;
+	*Tu = 2.0 * M_PI / low;
+}
+
+//----------------------------------------
+// Runs the relay around a zero setpoint
+// (plant input is the opposite of relay
+// output, as for PIDs corrections) until
+// tuning ends
+//----------------------------------------
+static void RunTuner(RelayTuner* tuner, float amplitude, float hysteresis, float maxError, float timeout)
+{
+	Plant plant;
+	float output = 0.0f;
+	uint32_t i;
+
+	memset(&plant, 0, sizeof(plant));
+	RelayTunerStart(tuner, amplitude, hysteresis, maxError, timeout);
+	for(i = 0; i < 100000 && tuner->state == RELAY_TUNER_RUNNING; ++i)
+		output = PlantStep(&plant, -RelayTunerUpdate(tuner, output, DT));
+}
+
+//----------------------------------------
+// Measured ultimate gain and period match
+// analytic ones (relay describing function
+// is a first harmonic approximation: plant
+// lags filter out most of the harmonics)
+//----------------------------------------
+static void TestUltimateGainAndPeriod(void)
+{
+	RelayTuner tuner;
+	double Ku, Tu;
+
+	UltimateGainAndPeriod(&Ku, &Tu);
+	RunTuner(&tuner, 0.2f, 0.002f, 1.0f, 10.0f);
+
+	CHECK(tuner.state == RELAY_TUNER_DONE);
+	CHECK_CLOSE(tuner.Tu, Tu, 0.05 * Tu);
+	CHECK_CLOSE(tuner.Ku, Ku, 0.1 * Ku);
+}
+
+//----------------------------------------
+// Ziegler-Nichols gains from measured Ku
+// and Tu
+//----------------------------------------
+static void TestGains(void)
+{
+	RelayTuner tuner;
+	float Kp, Ki, Kd;
+
+	RunTuner(&tuner, 0.2f, 0.002f, 1.0f, 10.0f);
+
+	CHECK(RelayTunerGains(&tuner, RELAY_TUNER_RULE_PID, &Kp, &Ki, &Kd));
+	CHECK_CLOSE(Kp, 0.2 * tuner.Ku, 1e-5);
+	CHECK_CLOSE(Ki, 0.4 * tuner.Ku / tuner.Tu, 1e-4);
+	CHECK_CLOSE(Kd, 0.0667 * tuner.Ku * tuner.Tu, 1e-5);
+
+	CHECK(RelayTunerGains(&tuner, RELAY_TUNER_RULE_PI, &Kp, &Ki, &Kd));
+	CHECK_CLOSE(Kp, 0.45 * tuner.Ku, 1e-5);
+	CHECK_CLOSE(Ki, 0.54 * tuner.Ku / tuner.Tu, 1e-4);
+	CHECK(Kd == 0.0f);
+}
+
+//----------------------------------------
+// Closed loop unit step response with tuned
+// gains settles on setpoint without
+// excessive overshoot (Ziegler-Nichols
+// rules give about 35% with PID rule and
+// 60% with PI rule on this plant)
+//----------------------------------------
+static void TestTunedStepResponse(RelayTunerRule rule, float maxOvershoot)
+{
+	RelayTuner tuner;
+	Plant plant;
+	PID pid = { .b = 1.0f, .ILimit = 10.0f };
+	float output = 0.0f, peak = 0.0f;
+	uint32_t i;
+
+	RunTuner(&tuner, 0.2f, 0.002f, 1.0f, 10.0f);
+	CHECK(RelayTunerGains(&tuner, rule, &pid.Kp, &pid.Ki, &pid.Kd));
+
+	memset(&plant, 0, sizeof(plant));
+	for(i = 0; i < 4000; ++i)
+	{
+		pid.in = 1.0f;
+		pid.error = output - 1.0f;
+		ProcessPID(&pid, DT);
+		output = PlantStep(&plant, -pid.out);
+		peak = output > peak ? output : peak;
+	}
+
+	CHECK(peak < 1.0f + maxOvershoot);
+	CHECK_CLOSE(output, 1.0, 0.01);
+}
+
+//----------------------------------------
+// Tuning fails on error bound or timeout
+// and doesn't give any gain
+//----------------------------------------
+static void TestTuningFailures(void)
+{
+	RelayTuner tuner;
+	float Kp, Ki, Kd;
+
+	// Relay amplitude too large for error bound
+	RunTuner(&tuner, 2.0f, 0.002f, 0.1f, 10.0f);
+	CHECK(tuner.state == RELAY_TUNER_FAILED);
+	CHECK(!RelayTunerGains(&tuner, RELAY_TUNER_RULE_PID, &Kp, &Ki, &Kd));
+
+	// Timeout shorter than settle and measure cycles
+	RunTuner(&tuner, 0.2f, 0.002f, 1.0f, 0.5f);
+	CHECK(tuner.state == RELAY_TUNER_FAILED);
+	CHECK(RelayTunerUpdate(&tuner, 0.0f, DT) == 0.0f);
+}
+
+int main(void)
+{
+	TestUltimateGainAndPeriod();
+	TestGains();
+	TestTunedStepResponse(RELAY_TUNER_RULE_PID, 0.4f);
+	TestTunedStepResponse(RELAY_TUNER_RULE_PI, 0.7f);
+	TestTuningFailures();
+
+	return TestReport("RelayTuner");
+}
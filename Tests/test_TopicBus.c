@@ -0,0 +1,169 @@
+/*
+ * test_TopicBus.c
+ * Topic bus readers cursors, lost messages accounting and lapped readers while publisher is preempted in the middle
+ * of a publication.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "Utils/TopicBus.h"
+#include "Test.h"
+
+//----------------------------------------
+// Topic bus hooks
+//----------------------------------------
+static uint32_t Now = 0;
+static uint32_t Notifications = 0;
+
+intptr_t TopicBusLock(void) { return 0; }
+void TopicBusUnlock(intptr_t lock) { (void)lock; }
+uint32_t TopicBusTimestamp(void) { return Now; }
+
+static void Notify(uintptr_t arg)
+{
+	Notifications += (uint32_t)arg;
+}
+
+typedef struct
+{
+	uint32_t value;
+	float data[3];
+} Message;
+
+TOPIC_DEFINE(TestTopic, Message, 4);
+
+static void Publish(uint32_t value)
+{
+	Message msg = { .value = value, .data = { (float)value, 0.0f, 0.0f } };
+	++Now;
+	TopicPublish(&TestTopic, &msg);
+}
+
+//----------------------------------------
+// Simulates a publisher preempted while it
+// rewrites next slot
+//----------------------------------------
+static void BeginPreemptedPublish(void)
+{
+	uint32_t next = TestTopic.published + 1;
+	TopicSlotHeader* slot = (TopicSlotHeader*)((uint8_t*)TestTopic.slots + (next & (TestTopic.depth - 1)) * TestTopic.stride);
+	SeqLockWriteBegin(&slot->lock);
+}
+
+//----------------------------------------
+// Readers get every message in order with
+// its timestamp and are notified
+//----------------------------------------
+static void TestReadInOrder(void)
+{
+	TopicSubscriber sub;
+	Message msg;
+	uint32_t timestamp, i;
+
+	CHECK(TopicSubscribe(&TestTopic, &sub, Notify, 1));
+	CHECK(!TopicRead(&sub, &msg, NULL));
+
+	for(i = 1; i <= 3; ++i)
+		Publish(100 + i);
+	CHECK(Notifications == 3);
+
+	for(i = 1; i <= 3; ++i)
+	{
+		CHECK(TopicRead(&sub, &msg, &timestamp));
+		CHECK(msg.value == 100 + i && timestamp == Now - 3 + i);
+	}
+	CHECK(!TopicRead(&sub, &msg, NULL));
+	CHECK(sub.lost == 0);
+
+	CHECK(TopicReadLatest(&TestTopic, &msg, NULL) == TestTopic.published && msg.value == 103);
+
+	TopicUnsubscribe(&sub);
+	Publish(104);
+	CHECK(Notifications == 3);
+}
+
+//----------------------------------------
+// Lapped reader skips overwritten messages
+//----------------------------------------
+static void TestLappedReader(void)
+{
+	TopicSubscriber sub;
+	Message msg;
+	uint32_t i;
+
+	CHECK(TopicSubscribe(&TestTopic, &sub, NULL, 0));
+	for(i = 0; i < 10; ++i)
+		Publish(200 + i);
+
+	// At most depth-1 (3) messages are kept unread
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 207);
+	CHECK(sub.lost == 7);
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 208);
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 209);
+	CHECK(!TopicRead(&sub, &msg, NULL));
+
+	TopicUnsubscribe(&sub);
+}
+
+//----------------------------------------
+// Lapped higher priority reader while
+// publisher is preempted in the middle of a
+// publication: reader must neither spin nor
+// read the slot beeing rewritten
+//----------------------------------------
+static void TestLappedReaderWhilePublishing(void)
+{
+	TopicSubscriber sub;
+	Message msg;
+	uint32_t i;
+
+	CHECK(TopicSubscribe(&TestTopic, &sub, NULL, 0));
+	for(i = 0; i < 4; ++i)
+		Publish(300 + i);
+
+	// Reader is exactly 'depth' messages behind: its next message slot is beeing rewritten
+	BeginPreemptedPublish();
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 301);
+	CHECK(sub.lost == 1);
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 302);
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 303);
+	CHECK(!TopicRead(&sub, &msg, NULL));
+
+	// Latest message is still readable
+	CHECK(TopicReadLatest(&TestTopic, &msg, NULL) != 0 && msg.value == 303);
+
+	// Publisher resumes
+	Publish(304);
+	CHECK(TopicRead(&sub, &msg, NULL) && msg.value == 304);
+
+	TopicUnsubscribe(&sub);
+}
+
+//----------------------------------------
+// Subscribers limit
+//----------------------------------------
+static void TestSubscribersLimit(void)
+{
+	TopicSubscriber subs[TOPIC_MAX_SUBSCRIBERS + 1];
+	uint32_t i;
+
+	for(i = 0; i < TOPIC_MAX_SUBSCRIBERS; ++i)
+		CHECK(TopicSubscribe(&TestTopic, &subs[i], NULL, 0));
+	CHECK(!TopicSubscribe(&TestTopic, &subs[TOPIC_MAX_SUBSCRIBERS], NULL, 0));
+
+	for(i = 0; i < TOPIC_MAX_SUBSCRIBERS; ++i)
+		TopicUnsubscribe(&subs[i]);
+	CHECK(TestTopic.subscriberCount == 0);
+}
+
+int main(void)
+{
+	TestReadInOrder();
+	TestLappedReader();
+	TestLappedReaderWhilePublishing();
+	TestSubscribersLimit();
+
+	return TestReport("TopicBus");
+}
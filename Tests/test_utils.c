@@ -0,0 +1,392 @@
+/*
+ * test_utils.c
+ * Number formatting round trips (itoa, uitoa, ftoa), compressed JSON frames decoding (base64, frame header, zigzag
+ * varints and delta accumulation, as a host would do) and formatting benchmarks.
+ * Usage: test_utils [--exhaustive] [--bench]
+ * '--exhaustive' round-trips every int32_t value (takes a few minutes), '--bench' prints host time per call of
+ * formatting functions against libc 'snprintf'.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Utils/utils.h"
+#include "Test.h"
+
+//----------------------------------------
+// Checks formatted string, returned length
+// and ending '\0'
+//----------------------------------------
+#define CHECK_FTOA(value, decimals, expected)										\
+	do																				\
+	{																				\
+		char buff_[32];																\
+		uint32_t length_ = ftoa((value), buff_, (decimals));						\
+		CHECK(strcmp(buff_, (expected)) == 0 && length_ == strlen(expected));		\
+		if(strcmp(buff_, (expected)) != 0)											\
+			printf("    ftoa(%s, %d) = \"%s\"\n", #value, (decimals), buff_);		\
+	} while(0)
+
+//----------------------------------------
+// itoa round trip of a single value
+//----------------------------------------
+static bool IntRoundTrip(int32_t value)
+{
+	char buff[16];
+	uint32_t length = itoa(value, buff);
+	return length == strlen(buff) && strtoll(buff, NULL, 10) == value;
+}
+
+//----------------------------------------
+// itoa and uitoa round trips: every value
+// around powers of ten, a sweep of int32_t
+// range and optionally every int32_t value
+//----------------------------------------
+static void TestIntegerRoundTrips(bool exhaustive)
+{
+	uint32_t i, failures = 0;
+	int32_t value;
+	char buff[16];
+
+	for(value = -100000; value <= 100000; ++value)
+		failures += !IntRoundTrip(value);
+
+	for(i = 0; i < 10; ++i)
+	{
+		int64_t power = 1;
+		uint32_t j;
+		for(j = 0; j < i; ++j)
+			power *= 10;
+		for(j = 0; j < 3; ++j)
+		{
+			int64_t candidate = power - 1 + j;
+			if(candidate <= INT32_MAX)
+			{
+				failures += !IntRoundTrip((int32_t)candidate);
+				failures += !IntRoundTrip((int32_t)-candidate);
+			}
+		}
+	}
+
+	for(i = 0; i < 65536; ++i)
+		failures += !IntRoundTrip((int32_t)(i * 65521u + 12345u));
+
+	if(exhaustive)
+	{
+		int64_t v;
+		for(v = INT32_MIN; v <= INT32_MAX; ++v)
+			failures += !IntRoundTrip((int32_t)v);
+	}
+
+	CHECK(failures == 0);
+
+	CHECK(itoa(INT32_MIN, buff) == 11 && strcmp(buff, "-2147483648") == 0);
+	CHECK(itoa(INT32_MAX, buff) == 10 && strcmp(buff, "2147483647") == 0);
+	CHECK(itoa(0, buff) == 1 && strcmp(buff, "0") == 0);
+	CHECK(uitoa(UINT32_MAX, buff) == 10 && strcmp(buff, "4294967295") == 0);
+	CHECK(uitoa(1000000000u, buff) == 10 && strcmp(buff, "1000000000") == 0);
+
+	// No ending '\0' if not asked
+	memset(buff, 'x', sizeof(buff));
+	CHECK(itoa2(-42, buff, false) == 3 && buff[3] == 'x' && memcmp(buff, "-42", 3) == 0);
+}
+
+//----------------------------------------
+// ftoa edge cases
+//----------------------------------------
+static void TestFloatEdgeCases(void)
+{
+	// Rounding carry to integer part
+	CHECK_FTOA(0.99999f, 4, "1");
+	CHECK_FTOA(-0.99999f, 4, "-1");
+	CHECK_FTOA(9.99996f, 4, "10");
+	CHECK_FTOA(1.99951f, 3, "2");
+
+	// Fractional part omitted if it rounds to zero, kept with leading zeros otherwise
+	CHECK_FTOA(2.0f, 4, "2");
+	CHECK_FTOA(0.0f, 3, "0");
+	CHECK_FTOA(1.5f, 3, "1.500");
+	CHECK_FTOA(1.05f, 2, "1.05");
+	CHECK_FTOA(-0.25f, 2, "-0.25");
+	CHECK_FTOA(3.0625f, 4, "3.0625");
+
+	// No sign for negative values rounding to zero
+	CHECK_FTOA(-0.00001f, 3, "0");
+	CHECK_FTOA(-0.4f, 0, "0");
+
+	// DecimalCount == 0 rounds half up
+	CHECK_FTOA(2.4f, 0, "2");
+	CHECK_FTOA(2.5f, 0, "3");
+	CHECK_FTOA(-2.6f, 0, "-3");
+	CHECK_FTOA(0.5f, 0, "1");
+	CHECK_FTOA(4294967040.0f, 0, "4294967040");
+
+	// Integer part saturates to uint32_t range
+	CHECK_FTOA(4294967296.0f, 2, "4294967295");
+	CHECK_FTOA(1e20f, 0, "4294967295");
+	CHECK_FTOA(-1e12f, 3, "-4294967295");
+	CHECK_FTOA((float)INT32_MIN, 0, "-2147483648");
+	CHECK_FTOA((float)INT32_MIN, 4, "-2147483648");
+
+	// Decimal count is bounded to 9
+	CHECK_FTOA(0.5f, 12, "0.500000000");
+
+	// Non finite values
+	CHECK_FTOA(NAN, 3, "NaN");
+	CHECK_FTOA(INFINITY, 3, "+inf");
+	CHECK_FTOA(-INFINITY, 3, "-inf");
+
+	// No ending '\0' if not asked
+	char buff[16];
+	memset(buff, 'x', sizeof(buff));
+	CHECK(ftoa2(-1.25f, buff, 2, false) == 5 && buff[5] == 'x' && memcmp(buff, "-1.25", 5) == 0);
+}
+
+//----------------------------------------
+// ftoa round trips: parsed value is within
+// half a last decimal (plus float scaling
+// error) of formatted value
+//----------------------------------------
+static void TestFloatRoundTrips(void)
+{
+	uint32_t i, decimals, failures = 0;
+	char buff[32];
+
+	srand(1);
+	for(i = 0; i < 200000; ++i)
+	{
+		// Random magnitudes from 1e-6 to 1e9
+		float magnitude = powf(10.0f, (float)(rand() % 16) - 6.0f);
+		float value = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * magnitude;
+
+		for(decimals = 0; decimals <= 9; ++decimals)
+		{
+			uint32_t length = ftoa(value, buff, decimals);
+			double parsed = strtod(buff, NULL);
+			double tolerance = 0.5 * pow(10.0, -(double)decimals) * (1.0 + 1e-6) + 2.4e-7;
+
+			if(length != strlen(buff) || fabs(parsed - value) > tolerance)
+			{
+				if(failures++ < 10)
+					printf("    ftoa(%.9g, %u) = \"%s\"\n", value, decimals, buff);
+			}
+		}
+	}
+
+	CHECK(failures == 0);
+}
+
+//----------------------------------------
+// Compressed frames host decoder: decodes
+// base64 text, frame header and zigzag
+// varints and accumulates deltas over last
+// keyframe. Frames following a lost frame
+// are dropped until next keyframe.
+//----------------------------------------
+typedef struct
+{
+	int32_t values[16];
+	uint32_t count;
+	uint8_t nextSequence;
+	bool synced;
+} FrameDecoder;
+
+static int Base64Value(char c)
+{
+	if(c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if(c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if(c >= '0' && c <= '9')
+		return c - '0' + 52;
+	return c == '+' ? 62 : (c == '/' ? 63 : -1);
+}
+
+static uint32_t Base64Decode(const char* text, uint8_t* data)
+{
+	uint32_t bits = 0, bitCount = 0, length = 0;
+
+	for(; *text != '\0' && *text != '='; ++text)
+	{
+		bits = (bits << 6) | (uint32_t)Base64Value(*text);
+		bitCount += 6;
+		if(bitCount >= 8)
+		{
+			bitCount -= 8;
+			data[length++] = (uint8_t)(bits >> bitCount);
+		}
+	}
+	return length;
+}
+
+// Returns true if frame values are available
+static bool DecodeFrame(FrameDecoder* decoder, const char* text)
+{
+	uint8_t data[128];
+	uint32_t length = Base64Decode(text, data), offset = 1, i;
+	bool keyframe = (data[0] & 0x80) != 0;
+	uint8_t sequence = data[0] & 0x7F;
+
+	if(length == 0 || (!keyframe && (!decoder->synced || sequence != decoder->nextSequence)))
+	{
+		decoder->synced = false;
+		return false;
+	}
+
+	for(i = 0; i < decoder->count; ++i)
+	{
+		uint32_t zigzag = 0, shift = 0;
+		uint8_t byte;
+		do
+		{
+			byte = data[offset++];
+			zigzag |= (uint32_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while(byte & 0x80);
+
+		int32_t value = (int32_t)((zigzag >> 1) ^ -(zigzag & 1));
+		decoder->values[i] = keyframe ? value : (int32_t)((uint32_t)decoder->values[i] + (uint32_t)value);
+	}
+
+	decoder->synced = offset == length;
+	decoder->nextSequence = (sequence + 1) & 0x7F;
+	return decoder->synced;
+}
+
+//----------------------------------------
+// Encodes a frame as 'WriteCompressedJSONObject'
+// does and decodes it: decoder must rebuild
+// exact quantized values
+//----------------------------------------
+static int32_t EncoderPrevious[16];
+static uint8_t EncoderSequence = 0;
+
+static bool FrameRoundTrip(FrameDecoder* decoder, const int32_t values[], bool keyframe)
+{
+	uint8_t payload[1 + 5*16];
+	char text[4*((sizeof(payload)+2)/3) + 1];
+	uint32_t length = DeltaFrameEncode(values, EncoderPrevious, decoder->count, keyframe, EncoderSequence++, payload);
+
+	Base64Encode(payload, length, text);
+	return DecodeFrame(decoder, text) && memcmp(decoder->values, values, decoder->count * sizeof(int32_t)) == 0;
+}
+
+static void TestCompressedFrames(void)
+{
+	FrameDecoder decoder = { .count = 4 };
+	uint32_t i, j, failures = 0;
+
+	// Saturated quantization: NaN sentinel is INT32_MIN (JSON_QUANTIZED_NAN), others within [INT32_MIN+1, INT32_MAX]
+	CHECK(Quantize(1.23456f, 0.0001f) == 12346);
+	CHECK(Quantize(-1.23454f, 0.0001f) == -12345);
+	CHECK(Quantize(-0.00004f, 0.0001f) == 0);
+	CHECK(Quantize(1e30f, 0.0001f) == INT32_MAX);
+	CHECK(Quantize(-1e30f, 0.0001f) == INT32_MIN + 1);
+	CHECK(Quantize(INFINITY, 1.0f) == INT32_MAX);
+	CHECK(Quantize(-INFINITY, 1.0f) == INT32_MIN + 1);
+	CHECK(Quantize(-2147483648.0f, 1.0f) == INT32_MIN + 1);
+	CHECK(Quantize(NAN, 0.0001f) == INT32_MIN);
+
+	// Keyframe then deltas, including deltas wrapping across int32_t range and NaN sentinel
+	const int32_t frames[][4] =
+	{
+		{ 0, 1, -1, 12345 },
+		{ 1, 0, -2, 12345 },
+		{ INT32_MAX, INT32_MIN + 1, INT32_MIN, -12345 },
+		{ INT32_MIN + 1, INT32_MAX, 0, INT32_MIN },
+		{ Quantize(NAN, 1.0f), Quantize(1e30f, 1.0f), Quantize(-1e30f, 1.0f), Quantize(42.0f, 0.5f) },
+		{ 0, 0, 0, 0 }
+	};
+	for(i = 0; i < sizeof(frames) / sizeof(frames[0]); ++i)
+		CHECK(FrameRoundTrip(&decoder, frames[i], i == 0));
+
+	// Random walks and jumps with periodic keyframes
+	srand(3);
+	int32_t values[4] = { 0, 0, 0, 0 };
+	for(i = 0; i < 100000; ++i)
+	{
+		for(j = 0; j < 4; ++j)
+			values[j] = rand() % 8 == 0 ? (int32_t)((uint32_t)rand() * 2654435761u) : values[j] + rand() % 201 - 100;
+		failures += !FrameRoundTrip(&decoder, values, i % 50 == 0);
+	}
+	CHECK(failures == 0);
+
+	// Lost frame: following deltas are dropped until next keyframe
+	EncoderSequence++;
+	values[0] += 7;
+	CHECK(!FrameRoundTrip(&decoder, values, false));
+	CHECK(!FrameRoundTrip(&decoder, values, false));
+	CHECK(FrameRoundTrip(&decoder, values, true));
+	CHECK(FrameRoundTrip(&decoder, frames[2], false));
+
+	// Sequence number wraps on 7 bits
+	for(i = 0; i < 300; ++i)
+		failures += !FrameRoundTrip(&decoder, frames[i % 6], false);
+	CHECK(failures == 0);
+}
+
+//----------------------------------------
+// Host time per call of a formatting
+// function in nanoseconds
+//----------------------------------------
+static volatile uint32_t BenchSink;
+
+static double BenchTime(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static void Benchmarks(void)
+{
+	const uint32_t count = 2000000;
+	char buff[32];
+	uint32_t i;
+	double start;
+
+	start = BenchTime();
+	for(i = 0; i < count; ++i)
+		BenchSink += itoa((int32_t)(i * 2654435761u), buff);
+	printf("itoa:           %6.1f ns/call\n", (BenchTime() - start) / count);
+
+	start = BenchTime();
+	for(i = 0; i < count; ++i)
+		BenchSink += snprintf(buff, sizeof(buff), "%d", (int32_t)(i * 2654435761u));
+	printf("snprintf(%%d):   %6.1f ns/call\n", (BenchTime() - start) / count);
+
+	start = BenchTime();
+	for(i = 0; i < count; ++i)
+		BenchSink += ftoa((float)(int32_t)(i * 2654435761u) * 1e-5f, buff, 4);
+	printf("ftoa(4):        %6.1f ns/call\n", (BenchTime() - start) / count);
+
+	start = BenchTime();
+	for(i = 0; i < count; ++i)
+		BenchSink += snprintf(buff, sizeof(buff), "%.4f", (float)(int32_t)(i * 2654435761u) * 1e-5f);
+	printf("snprintf(%%.4f): %6.1f ns/call\n", (BenchTime() - start) / count);
+}
+
+int main(int argc, char* argv[])
+{
+	bool exhaustive = false, bench = false;
+	int i;
+
+	for(i = 1; i < argc; ++i)
+	{
+		exhaustive |= strcmp(argv[i], "--exhaustive") == 0;
+		bench |= strcmp(argv[i], "--bench") == 0;
+	}
+
+	TestIntegerRoundTrips(exhaustive);
+	TestFloatEdgeCases();
+	TestFloatRoundTrips();
+	TestCompressedFrames();
+
+	if(bench)
+		Benchmarks();
+
+	return TestReport("utils");
+}
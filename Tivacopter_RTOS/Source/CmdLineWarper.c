@@ -94,7 +94,7 @@ static void CheckSuccess(bool success)
 {
 	if(!success)
 	{
-		Log_error0("Error (re)allocating memory for UART console Warper commands.");
+		Log_error0("Error: UART console command table is full (Warper commands).");
 		ASSERT(FALSE);
 	}
 }
@@ -29,12 +29,75 @@
 #include "JSONCommunication.h"
 #include "PinMap.h"
 #include "IMU.h"
+#include "PID.h"
 
 //----------------------------------------
 // UART console from 'main.c'
 //----------------------------------------
 extern UARTConsole Console;
 
+//----------------------------------------
+// Topic notify callback from 'main.c'
+//----------------------------------------
+extern void TopicNotifySemaphore(uintptr_t semaphore);
+
+#if CONTROL_LOOP_TIMING
+//----------------------------------------
+// System time (microseconds) from 'main.c'
+//----------------------------------------
+extern uint32_t SystemTimeUs(void);
+
+//----------------------------------------
+// Inline control loop stages timing:
+// Durations (microseconds) of sensors
+// reading to processing latency, rate
+// control stage, attitude estimation and
+// angle control stage.
+//----------------------------------------
+typedef enum { LOOP_STAGE_LATENCY, LOOP_STAGE_RATE, LOOP_STAGE_ESTIMATION, LOOP_STAGE_ANGLE, LOOP_STAGE_COUNT } LoopStage;
+static const char* LoopStageNames[LOOP_STAGE_COUNT] = { "latency", "rate control", "estimation", "angle control" };
+static struct
+{
+	uint32_t last[LOOP_STAGE_COUNT];
+	uint32_t max[LOOP_STAGE_COUNT];
+	uint32_t sum[LOOP_STAGE_COUNT];
+	uint32_t count;
+	volatile bool resetRequested;
+} LoopTiming;
+
+static inline void RecordLoopStage(LoopStage stage, uint32_t start, uint32_t end)
+{
+	uint32_t duration = end - start;
+
+	LoopTiming.last[stage] = duration;
+	LoopTiming.sum[stage] += duration;
+	if(duration > LoopTiming.max[stage])
+		LoopTiming.max[stage] = duration;
+}
+
+//----------------------------------------
+// Loop timing:
+// Prints inline control loop stages
+// timing since last call.
+//----------------------------------------
+static void LoopTiming_cmd(int argc, char *argv[])
+{
+	uint32_t i, count = LoopTiming.count;
+
+	if(count == 0)
+	{
+		UARTwrite(&Console, "No control loop cycle since last call.", 38);
+		return;
+	}
+
+	UARTprintf(&Console, "%u cycles:", count);
+	for(i = 0; i < LOOP_STAGE_COUNT; ++i)
+		UARTprintf(&Console, "\n%s: last %u us, mean %u us, max %u us", LoopStageNames[i], LoopTiming.last[i], LoopTiming.sum[i] / count, LoopTiming.max[i]);
+
+	LoopTiming.resetRequested = true;
+}
+#endif
+
 //----------------------------------------
 // IMU data structures definition
 //----------------------------------------
@@ -46,9 +109,31 @@ static Gyroscope Gyro = {.range = _250dps, .xOffset = 0.0f, .yOffset = 0.0f, .zO
 static Accelerometer Accel = {.range = _4g};
 InertialMeasurementUnit IMU = {	.magn = &Magn, .accel = &Accel, . gyro = &Gyro,
 								.q = {1.0, 0.0, 0.0, 0.0},
-								.pos = {0.0, 0.0, 0.0},
-								.SensorsStrValues = {"0", "0", "0", "0", "0", "0", "0", "0", "0"},
-								.IMUStrValues = {"1", "0", "0", "0", "0", "0", "0", "0", "0", "0"}};
+								.pos = {0.0, 0.0, 0.0}};
+
+//----------------------------------------
+// Sensors and attitude topics (published
+// by I2C sensors reading callback and IMU
+// processing task).
+//----------------------------------------
+TOPIC_DEFINE(SensorsTopic, SensorsState, 4);
+TOPIC_DEFINE(AttitudeTopic, IMUState, 4);
+
+//----------------------------------------
+// Get IMU state
+//----------------------------------------
+uint32_t GetIMUState(IMUState* state)
+{
+	return TopicReadLatest(&AttitudeTopic, state, NULL);
+}
+
+//----------------------------------------
+// Get sensors state
+//----------------------------------------
+uint32_t GetSensorsState(SensorsState* state)
+{
+	return TopicReadLatest(&SensorsTopic, state, NULL);
+}
 
 //----------------------------------------
 // Lock function used by I2C transaction
@@ -116,52 +201,41 @@ static void MagnetoCompensate(void)
 }
 
 //----------------------------------------
-// Sensors data accessor:
-// Accessor used by JSON communication
-// to get data from sensors data source.
+// Sample sensors data:
+// Gives last sensors readings to sensors
+// decimated data source.
 //----------------------------------------
-static char** SensorsDataAccessor(void)
+static void SampleSensorsData(JSONDataSource* Sensors_ds)
 {
-	// Clear strings
-	memset(IMU.SensorsStrValues, '\0', sizeof(IMU.SensorsStrValues));
-
-	// Convert float values to strings
-	ftoa(Accel.val[x], IMU.SensorsStrPtrs[0], 4);
-	ftoa(Accel.val[y], IMU.SensorsStrPtrs[1], 4);
-	ftoa(Accel.val[z], IMU.SensorsStrPtrs[2], 4);
-	ftoa(Gyro.val[x], IMU.SensorsStrPtrs[3], 4);
-	ftoa(Gyro.val[y], IMU.SensorsStrPtrs[4], 4);
-	ftoa(Gyro.val[z], IMU.SensorsStrPtrs[5], 4);
-	ftoa(Magn.val[x], IMU.SensorsStrPtrs[6], 4);
-	ftoa(Magn.val[y], IMU.SensorsStrPtrs[7], 4);
-	ftoa(Magn.val[z], IMU.SensorsStrPtrs[8], 4);
-
-	return (char**)IMU.SensorsStrPtrs;
+	SensorsState sensors;
+
+	if(GetSensorsState(&sensors) != 0)
+	{
+		const float values[9] = {	sensors.accel[x], sensors.accel[y], sensors.accel[z],
+									sensors.gyro[x], sensors.gyro[y], sensors.gyro[z],
+									sensors.magn[x], sensors.magn[y], sensors.magn[z]	};
+
+		SampleJSONData(Sensors_ds, values);
+	}
 }
 
 //----------------------------------------
-// IMU data accessor:
-// Accessor used by JSON communication to
-// get data from IMU data source.
+// Sample IMU data:
+// Gives current attitude to IMU on-change
+// data source. Euler angles are only
+// computed if datasource is enabled.
 //----------------------------------------
-static char** IMUDataAccessor(void)
+static void SampleIMUData(JSONDataSource* IMU_ds, const IMUState* state)
 {
-	// Clear strings
-	memset(IMU.IMUStrValues, '\0', sizeof(IMU.IMUStrValues));
-
-	// Convert float values to strings
-	ftoa(IMU.q[0], 	IMU.IMUStrPtrs[0], 5);
-	ftoa(IMU.q[1], 	IMU.IMUStrPtrs[1], 5);
-	ftoa(IMU.q[2], 	IMU.IMUStrPtrs[2], 5);
-	ftoa(IMU.q[3], 	IMU.IMUStrPtrs[3], 5);
-	ftoa(IMU.yaw, 	IMU.IMUStrPtrs[4], 4);
-	ftoa(IMU.pitch, IMU.IMUStrPtrs[5], 4);
-	ftoa(IMU.roll, 	IMU.IMUStrPtrs[6], 4);
-	//	ftoa(IMU.pos[0],IMU.IMUStrPtrs[7], 3);
-	//	ftoa(IMU.pos[1],IMU.IMUStrPtrs[8], 3);
-	//	ftoa(IMU.pos[2],IMU.IMUStrPtrs[9], 3);
-
-	return (char**)IMU.IMUStrPtrs;
+	float q[4], yaw = 0.0f, pitch = 0.0f, roll = 0.0f;
+
+	memcpy(q, state->q, sizeof(q));
+	if(IMU_ds->enabled)
+		QuaternionToEuler(q, &roll, &pitch, &yaw);
+
+	const float values[7] = { q[0], q[1], q[2], q[3], yaw, pitch, roll };//, IMU.pos[0], IMU.pos[1], IMU.pos[2] };
+
+	SampleJSONData(IMU_ds, values);
 }
 
 //----------------------------------------
@@ -185,27 +259,17 @@ static void SendCSVMagn_cmd(int argc, char *argv[])
 //-----------------------------------------
 void SendCSVMagnTask(void)
 {
+	SensorsState sensors;
+
 	while(1)
 	{
 		Semaphore_pend(Mag_Sem, BIOS_WAIT_FOREVER);
 
 		while(!IsAbortRequested(&Console))
 		{
-			// As 'IMUProcessing_Sem' is a binary semaphore this task will be unblocked only if IMU processing task stay blocked
-			// so that IMU processing task don't read nor compensate magnetometer data at the same time.
-			// Be carefull to sleep enought time to avoid replacing to much IMU processings.
-			Semaphore_pend(IMUProcessing_Sem, BIOS_WAIT_FOREVER);
-
-			// Clear strings
-			memset(IMU.SensorsStrPtrs[6], '\0', sizeof(char[3][10]));
-
-			// Convert float values to strings
-			ftoa(Magn.val[x], IMU.SensorsStrPtrs[6], 4);
-			ftoa(Magn.val[y], IMU.SensorsStrPtrs[7], 4);
-			ftoa(Magn.val[z], IMU.SensorsStrPtrs[8], 4);
-
-			// Send uncompensated magnetometer data
-			UARTprintf(&Console, "%s,%s,%s\r\n", IMU.SensorsStrPtrs[6], IMU.SensorsStrPtrs[7], IMU.SensorsStrPtrs[8]);
+			// Send uncompensated magnetometer data from sensors snapshot (IMU processing isn't delayed)
+			if(GetSensorsState(&sensors) != 0)
+				UARTprintf(&Console, "%.4f,%.4f,%.4f\r\n", sensors.magn[x], sensors.magn[y], sensors.magn[z]);
 
 			// sleep for 50 000 us
 			Task_sleep((uint32_t)50000/SYSTEM_CLOCK_PERIOD_US);
@@ -232,10 +296,14 @@ void IMUProcessingTask(void)
 	float gx, gy, gz, ax, ay, az, mx, my, mz;
 	// Quaternion
 	float q0, q1, q2, q3;
-
-	// PID Task status structure
-	Task_Stat PIDTaskStat;
-	bool PIDTaskTerminated = false;
+	// Sensors values read and estimator state published by each loop
+	TopicSubscriber sensorsSub;
+	SensorsState sensors;
+	uint32_t sensorsTimestamp;
+	IMUState state;
+#if CONTROL_LOOP_TIMING
+	uint32_t stageStart, stageEnd;
+#endif
 
 	// Configure and calibrates sensors
 	ConfigureSensors();
@@ -247,23 +315,35 @@ void IMUProcessingTask(void)
 	// Add a command to allow user to receive uncompensated magetometer data for calibration
 	if(!SubscribeCmd(&Console, "sendCSVMagn", SendCSVMagn_cmd, "Sends magnetometer data in CSV format (usefull for calibration)."))
 	{
-		Log_error0("Error (re)allocating memory for UART console command.");
+		Log_error0("Error: UART console command table is full.");
 		return;
 	}
 
-	// Fill 'IMUStrPtrs' string pointer arrays with pointers to 'IMUStrValues' strings
-	uint32_t i;
-	for(i = 0; i < 10; ++i)
-		IMU.IMUStrPtrs[i] = &IMU.IMUStrValues[i][0];
+#if CONTROL_LOOP_TIMING
+	if(!SubscribeCmd(&Console, "loopTiming", LoopTiming_cmd, "Prints control loop stages timing since last call."))
+	{
+		Log_error0("Error: UART console command table is full.");
+		return;
+	}
+#endif
 
-	// Subscribe a bluetooth datasource to send periodically IMU's data
-	JSONDataSource* IMU_ds = SubscribePeriodicJSONDataSource("IMU", (const char*[]){ "q0", "q1", "q2", "q3", "yaw", "pitch", "roll"}, 7, 20, IMUDataAccessor);//, "px", "py", "pz"}, 10, 20, IMUDataAccessor);
+	// Subscribe a bluetooth datasource to send IMU's data when attitude changes (by more than IMU_JSON_DEADBAND)
+	JSONDataSource* IMU_ds = SubscribeOnChangeJSONDataSource("IMU", (const char*[]){ "q0", "q1", "q2", "q3", "yaw", "pitch", "roll"}, 7, IMU_JSON_DEADBAND, 5);//, "px", "py", "pz"}, 10, IMU_JSON_DEADBAND, 5);
 
 	if(IMU_ds == NULL)
 	{
 		Log_error0("Failed to subscribe 'IMU' data source.");
 		return;
 	}
+	SetJSONDataSourceUnits(IMU_ds, (const char*[]) { "", "", "", "", "rad", "rad", "rad" });
+
+	// Subscribe to sensors topic: each sensors reading wakes up this task
+	if(!TopicSubscribe(&SensorsTopic, &sensorsSub, TopicNotifySemaphore, (uintptr_t)IMUProcessing_Sem))
+	{
+		Log_error0("Failed to subscribe to sensors topic.");
+		UnsubscribeJSONDataSource(IMU_ds);
+		return;
+	}
 
 	while(1)
 	{
@@ -275,12 +355,37 @@ void IMUProcessingTask(void)
 			// TODO: End IMU task ?
 			break;
 		}
-		else
+		else if(TopicRead(&sensorsSub, &sensors, &sensorsTimestamp))
 		{
-			// Copy the gyroscope and accellerometer values. (global values cannot be cached)
-			q0 = IMU.q[0];		q1 = IMU.q[1];		q2 = IMU.q[2];		q3 = IMU.q[3];
-			gx = Gyro.val[x];	gy = Gyro.val[y];	gz = Gyro.val[z];
-			ax = Accel.val[x];	ay = Accel.val[y];	az = Accel.val[z];
+			// Use latest sensors readings (older ones are dropped if this task has been delayed)
+			while(TopicRead(&sensorsSub, &sensors, &sensorsTimestamp))
+				continue;
+
+#if CONTROL_LOOP_TIMING
+			if(LoopTiming.resetRequested)
+			{
+				memset(&LoopTiming, 0, sizeof(LoopTiming));
+				LoopTiming.resetRequested = false;
+			}
+			stageStart = SystemTimeUs();
+			RecordLoopStage(LOOP_STAGE_LATENCY, sensorsTimestamp, stageStart);
+#endif
+
+#if CONTROL_LOOP_INLINE
+			// Rate control stage uses gyroscope rates right away (doesn't wait for attitude estimation)
+			ControllerRateStage(&sensors);
+#endif
+
+#if CONTROL_LOOP_TIMING
+			stageEnd = SystemTimeUs();
+			RecordLoopStage(LOOP_STAGE_RATE, stageStart, stageEnd);
+			stageStart = stageEnd;
+#endif
+
+			// Copy the gyroscope and accellerometer values.
+			q0 = IMU.q[0];			q1 = IMU.q[1];			q2 = IMU.q[2];			q3 = IMU.q[3];
+			gx = sensors.gyro[x];	gy = sensors.gyro[y];	gz = sensors.gyro[z];
+			ax = sensors.accel[x];	ay = sensors.accel[y];	az = sensors.accel[z];
 
 			// Rate of change of quaternion from gyroscope
 			qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
@@ -401,29 +506,40 @@ void IMUProcessingTask(void)
 			q2 *= recipNorm;
 			q3 *= recipNorm;
 
-			// Convert quaternion to euler angles
-			IMU.yaw 	=	atan2(2*(q0*q3 + q1*q2), 1 - 2*(pow(q2,2) + pow(q3,2)));
-			IMU.pitch 	= 	asin(2*(q0*q2 - q3*q1));
-			IMU.roll 	=	atan2(2*(q0*q1 + q2*q3), 1 - 2*(pow(q1,2) + pow(q2,2)));
-
 			// Return the quaternion values.
 			IMU.q[0] = q0;
 			IMU.q[1] = q1;
 			IMU.q[2] = q2;
 			IMU.q[3] = q3;
 
-			// Unblock PID if PID task is still here
-			if(!PIDTaskTerminated)
-			{
-				Task_stat(PID_Task, &PIDTaskStat);
-				if(PIDTaskStat.mode != ti_sysbios_knl_Task_Mode_TERMINATED)
-					Semaphore_post(PID_Sem);
-				else
-					PIDTaskTerminated = true;
-			}
+			// Publish estimator state once per loop (readers never block this task)
+			memcpy(state.q, IMU.q, sizeof(state.q));
+			memcpy(state.gyro, sensors.gyro, sizeof(state.gyro));
+			memcpy(state.accel, sensors.accel, sizeof(state.accel));
+			state.g = Accel.g;
+			TopicPublish(&AttitudeTopic, &state);
+
+#if CONTROL_LOOP_TIMING
+			stageEnd = SystemTimeUs();
+			RecordLoopStage(LOOP_STAGE_ESTIMATION, stageStart, stageEnd);
+			stageStart = stageEnd;
+#endif
+
+#if CONTROL_LOOP_INLINE
+			// Angle control stage gives rate setpoints used by next rate control stage
+			ControllerAngleStage(&state);
+#endif
+
+#if CONTROL_LOOP_TIMING
+			RecordLoopStage(LOOP_STAGE_ANGLE, stageStart, SystemTimeUs());
+			LoopTiming.count++;
+#endif
+
+			SampleIMUData(IMU_ds, &state);
 		}
 	}
 
+	TopicUnsubscribe(&sensorsSub);
 	UnsubscribeJSONDataSource(IMU_ds);
 }
 
@@ -497,6 +613,13 @@ static void ConvertRawData(void)
 	Magn.val[x] = (int16_t)((IMU.magnRawData[2] << 8) | IMU.magnRawData[3]) * factor;
 	Magn.val[y] = -(int16_t)((IMU.magnRawData[0] << 8) | IMU.magnRawData[1]) * factor;
 	Magn.val[z] = (int16_t)((IMU.magnRawData[4] << 8) | IMU.magnRawData[5]) * factor;
+
+	// Publish converted sensors values
+	SensorsState sensors;
+	memcpy(sensors.accel, Accel.val, sizeof(sensors.accel));
+	memcpy(sensors.gyro, Gyro.val, sizeof(sensors.gyro));
+	memcpy(sensors.magn, Magn.val, sizeof(sensors.magn));
+	TopicPublish(&SensorsTopic, &sensors);
 }
 
 //------------------------------------------
@@ -504,21 +627,9 @@ static void ConvertRawData(void)
 //------------------------------------------
 static void TransactionCallback(uint32_t status, uint8_t* buffer, uint32_t length)
 {
-	static bool IMUProcessingTaskTerminated = false;
-
-	if(CheckI2CErrorCode(status, false) && !IMUProcessingTaskTerminated)
-	{
-		// Raw data is now available in 'IMU.MPU6050RawData' but we have to convert it to meaningfull values before letting 'IMU_Task' process this data.
+	// Raw data is now available in 'IMU.MPU6050RawData' but we have to convert it to meaningfull values before publishing it to sensors topic subscribers (e.g. 'IMUProcessing_Task').
+	if(CheckI2CErrorCode(status, false))
 		ConvertRawData();
-
-		// Unblock 'IMUProcessing_Task' if this task isn't terminated
-		Task_Stat IMUProcessingTaskStat;
-		Task_stat(IMUProcessing_Task, &IMUProcessingTaskStat);
-		if(IMUProcessingTaskStat.mode != ti_sysbios_knl_Task_Mode_TERMINATED)
-			Semaphore_post(IMUProcessing_Sem);
-		else
-			IMUProcessingTaskTerminated = true;
-	}
 }
 
 //------------------------------------------
@@ -526,25 +637,30 @@ static void TransactionCallback(uint32_t status, uint8_t* buffer, uint32_t lengt
 //------------------------------------------
 void IMUReadingTask(void)
 {
-	// Fill 'SensorsStrPtrs' string pointer arrays with pointers to 'SensorsStrValues' strings
-	uint32_t i;
-	for(i = 0; i < 9; ++i)
-		IMU.SensorsStrPtrs[i] = &IMU.SensorsStrValues[i][0];
-
-	// Subscribe a bluetooth datasource to send periodically Sensors's data
-	JSONDataSource* Sensors_ds = SubscribePeriodicJSONDataSource("sensors", (const char*[]) {	"ax", "ay", "az",
+	// Subscribe a bluetooth datasource to send Sensors's data averaged over 20 readings
+	JSONDataSource* Sensors_ds = SubscribeDecimatedJSONDataSource("sensors", (const char*[]) {	"ax", "ay", "az",
 																								"gx", "gy", "gz",
-																								"mx", "my", "mz" }, 9, 20, SensorsDataAccessor);
+																								"mx", "my", "mz" }, 9, 20, JSON_AGGREGATE_MEAN, 4);
 	if(Sensors_ds == NULL)
 	{
 		Log_error0("Failed to subscribe 'sensors' data source.");
 		return;
 	}
 
+	SetJSONDataSourceUnits(Sensors_ds, (const char*[]) { "m/s2", "m/s2", "m/s2", "rad/s", "rad/s", "rad/s", "G", "G", "G" });
+
+	// Allow raw sensors data to be streamed at loop rate in compressed mode ('compress sensors 1')
+	SetJSONDataSourceResolution(Sensors_ds, (const float[]) {	SENSORS_JSON_ACCEL_RESOLUTION, SENSORS_JSON_ACCEL_RESOLUTION, SENSORS_JSON_ACCEL_RESOLUTION,
+																SENSORS_JSON_GYRO_RESOLUTION, SENSORS_JSON_GYRO_RESOLUTION, SENSORS_JSON_GYRO_RESOLUTION,
+																SENSORS_JSON_MAGN_RESOLUTION, SENSORS_JSON_MAGN_RESOLUTION, SENSORS_JSON_MAGN_RESOLUTION	});
+
 	while(1)
 	{
 		Semaphore_pend(IMUReading_Sem, BIOS_WAIT_FOREVER);
 
+		// Give previous sensors readings to JSON datasource
+		SampleSensorsData(Sensors_ds);
+
 		// Read magnetometer's values
 		Async_I2CRegRead(IMU_I2C_BASE, HMC5883L_I2C_ADDR, HMC5883L_DATA_REG_BEGIN, IMU.magnRawData, HMC5883L_DATA_REG_COUNT, NULL);
 
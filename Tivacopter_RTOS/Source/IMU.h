@@ -10,6 +10,7 @@
 
 // MPU6050 registers and adresses
 #include "Utils/hw_MPU6050.h"
+#include "Utils/TopicBus.h"
 
 //------------------------------------------
 // Defines MPU6050 and HMC5883L IC
@@ -34,6 +35,10 @@
 #define SAMPLE_FREQ					400.0f			// sample frequency in Hz, TODO: determine PERIOD at runtime (not frequency)
 #define SAMPLE_PERIOD				1.0f/SAMPLE_FREQ
 #define BETA						0.1f			// 2 *  Madgwick AHRS algorithm proportional gain
+#define IMU_JSON_DEADBAND			0.001f			// Minimum change of any quaternion component or euler angle (radians) sent by 'IMU' JSON datasource
+#define SENSORS_JSON_ACCEL_RESOLUTION	0.0001f		// Quantization resolution of compressed 'sensors' JSON datasource fields
+#define SENSORS_JSON_GYRO_RESOLUTION	0.0001f
+#define SENSORS_JSON_MAGN_RESOLUTION	0.001f
 
 //-------------------------------------------------------------------------
 // HMC5883L mesurement mode defines:
@@ -165,19 +170,76 @@ typedef struct
 
 	// Quaternion
 	float q[4];
-	// Euler angles
-	float yaw, pitch, roll;
 
 	// Cartesian position
 	float pos[3];
-
-	// String pointer arrays and string values used for JSON datasources
-	char* SensorsStrPtrs[9];
-	char SensorsStrValues[9][15];
-	char* IMUStrPtrs[10];
-	char IMUStrValues[10][10];
 } InertialMeasurementUnit;
 
+//------------------------------------------
+// IMU state snapshot typedef:
+// Estimator state published once per IMU
+// processing loop (see 'AttitudeTopic').
+//------------------------------------------
+typedef struct
+{
+	// Attitude quaternion (Euler angles are only computed for telemetry, see 'QuaternionToEuler')
+	float q[4];
+
+	// Sensors values used by this estimation
+	float gyro[3];
+	float accel[3];
+	// Gravity acceleration measured during calibration
+	float g;
+} IMUState;
+
+//------------------------------------------
+// Sensors state snapshot typedef:
+// Converted (uncompensated) sensors values
+// published each time sensors are read
+// (see 'SensorsTopic').
+//------------------------------------------
+typedef struct
+{
+	float accel[3];
+	float gyro[3];
+	float magn[3];
+} SensorsState;
+
+//------------------------------------------
+// Attitude topic:
+// 'IMUState' messages published by IMU
+// processing task once per loop.
+//------------------------------------------
+extern Topic AttitudeTopic;
+
+//------------------------------------------
+// Sensors topic:
+// 'SensorsState' messages published each
+// time sensors are read.
+//------------------------------------------
+extern Topic SensorsTopic;
+
+//------------------------------------------
+// Get IMU state:
+// Copies last estimator state published by
+// IMU processing task to 'state' without
+// blocking (can be called from any thread).
+// Returns state version (attitude topic
+// sequence number, incremented once per IMU
+// processing loop) or 0 if no state have
+// been published yet.
+//------------------------------------------
+uint32_t GetIMUState(IMUState* state);
+
+//------------------------------------------
+// Get sensors state:
+// Copies last converted sensors values to
+// 'state' without blocking. Returns state
+// version or 0 if sensors haven't been read
+// yet.
+//------------------------------------------
+uint32_t GetSensorsState(SensorsState* state);
+
 //-----------------------------------------
 // Calibrate magnetometer task:
 // Sends magnetometer data for calibration
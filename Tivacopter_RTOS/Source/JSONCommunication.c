@@ -4,8 +4,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 //----------------------------------------
 // BIOS header files
@@ -18,6 +20,7 @@
 #include <xdc/runtime/Error.h>
 #include <ti/sysbios/hal/Hwi.h>
 #include <ti/sysbios/knl/Queue.h>
+#include <ti/sysbios/knl/Task.h>
 
 #include "inc/tm4c1294ncpdt.h"
 #include "driverlib/debug.h"
@@ -28,20 +31,43 @@
 
 #include "PinMap.h"
 #include "Utils/UARTConsole.h"
-#include "Utils/jsmn.h"
+#include "Utils/utils.h"
 #include "JSONCommunication.h"
 
+//----------------------------------------
+// FNV-1a hash used to match received keys
+// against datainputs keys
+//----------------------------------------
+#define JSON_KEY_HASH_BASIS				2166136261u
+#define JSON_KEY_HASH_STEP(hash, c)		(((hash) ^ (uint8_t)(c)) * 16777619u)
+
+// JSON input parser keeps track of matching datainputs in a 32 bits mask
+#if MAX_DATAINPUT_COUNT > 32
+#error "MAX_DATAINPUT_COUNT can't be greater than 32."
+#endif
+
+// JSON input parser keeps track of received fields in a 32 bits mask and key lookup tables store key indexes in bytes
+#if MAX_DATA_COUNT > 32 || JSON_KEY_TABLE_SIZE <= MAX_DATA_COUNT || (JSON_KEY_TABLE_SIZE & (JSON_KEY_TABLE_SIZE-1)) != 0
+#error "MAX_DATA_COUNT can't be greater than 32 and JSON_KEY_TABLE_SIZE must be a power of two greater than MAX_DATA_COUNT."
+#endif
+
 static bool JSONCommunicationStarted = false;
 static bool JSONProgrammaticAccessMode = true;
+static bool JSONSchemaMode = false;
 
-// NewJSONObjectReceived callback forward declaration
-static void NewJSONObjectReceived(char c);
+// JSONCharReceived callback forward declaration
+static void JSONCharReceived(char c);
 
 //----------------------------------------
 // UART console from 'main.c'
 //----------------------------------------
 extern UARTConsole Console;
 
+//----------------------------------------
+// System time (microseconds) from 'main.c'
+//----------------------------------------
+extern uint32_t SystemTimeUs(void);
+
 //----------------------------------------
 // Private static JSON data sources array
 //----------------------------------------
@@ -62,6 +88,17 @@ static void InitializeJSONDataSourcesArray()
 	}
 }
 
+//----------------------------------------
+// Private static JSON data samplers pool
+// used by on-change and decimated
+// datasources.
+//----------------------------------------
+static struct
+{
+	JSONDataSampler array[MAX_SAMPLED_DATASOURCE_COUNT];
+	JSONDataSource* owners[MAX_SAMPLED_DATASOURCE_COUNT];
+} JSONDataSamplers;
+
 //----------------------------------------
 // Private static JSON data inputs array
 //----------------------------------------
@@ -82,13 +119,37 @@ static void InitializeJSONDataInputsArray()
 	}
 }
 
+//----------------------------------------
+// Schema request data input:
+// Allows host to request schema of a
+// datasource (or of all datasources with
+// "*") after a desynchronization.
+//----------------------------------------
+static const char* SchemaRequestKeys[1] = { "schemaRequest" };
+static JSONDataInput* schemaRequest_di;
+
 //----------------------------------------
 // Raw echo data source:
 // Simple data source which sends back
 // all received JSON objects.
 //----------------------------------------
+static const char* RawEchoKeys[1] = { "rawInput" };
 static JSONDataSource* rawEcho_ds;
 
+//----------------------------------------
+// Clock sync data input and data source:
+// Answers host clock pings with vehicle
+// times of ping reception and of pong
+// sending (see 'JSONCommunication.h').
+//----------------------------------------
+static const char* ClockPingKeys[1] = { "clockPing" };
+static const char* ClockSyncKeys[2] = { "ping", "rx" };
+static JSONDataInput* clockPing_di;
+static JSONDataSource* clockSync_ds;
+static char ClockSyncPing[JSON_INPUT_VALUE_SIZE];
+static char ClockSyncRx[11];
+static char* ClockSyncValues[2] = { ClockSyncPing, ClockSyncRx };
+
 //----------------------------------------
 // list sources:
 // List all available JSON data source.
@@ -104,7 +165,9 @@ void JSON_list_sources_cmd(int argc, char *argv[])
 		{
 			JSONDataSource* ds = &JSONDataSources.array[i];
 			if(ds->name != NULL)
-				UARTprintf(&Console, "\n - %s		%s %s", ds->name, ds->enabled ? "Enabled" : "Disabled", ds->period > 0 ? "(Periodic)" : "");
+				UARTprintf(&Console, "\n - %s		%s %s %s", ds->name, ds->enabled ? "Enabled" : "Disabled",
+							ds->mode == JSON_DS_PERIODIC ? "(Periodic)" : ds->mode == JSON_DS_ON_CHANGE ? "(On change)" : ds->mode == JSON_DS_DECIMATED ? "(Decimated)" : "",
+							ds->sampler != NULL && ds->sampler->compressed ? "(Compressed)" : "");
 		}
 	}
 }
@@ -129,6 +192,148 @@ void JSON_list_inputs_cmd(int argc, char *argv[])
 	}
 }
 
+//----------------------------------------
+// Find JSON data source:
+// Returns subscribed datasource with
+// given name or NULL if there isn't any.
+//----------------------------------------
+static JSONDataSource* FindJSONDataSource(const char* name)
+{
+	uint32_t i;
+	for(i = 0; i < JSONDataSources.capacity; ++i)
+	{
+		JSONDataSource* ds = &JSONDataSources.array[i];
+		if(ds->name != NULL)
+			if(strcmp(ds->name, name) == 0)
+				return ds;
+	}
+	return NULL;
+}
+
+//----------------------------------------
+// Reset JSON schemas:
+// Makes schema of datasource with given
+// name (or of all datasources if name is
+// NULL or "*") to be sent again before
+// its next data.
+//----------------------------------------
+static void ResetJSONSchemas(const char* name)
+{
+	uint32_t i;
+	for(i = 0; i < JSONDataSources.capacity; ++i)
+	{
+		JSONDataSource* ds = &JSONDataSources.array[i];
+		if(ds->name != NULL)
+			if(name == NULL || strcmp(name, "*") == 0 || strcmp(ds->name, name) == 0)
+				ds->schemaSent = false;
+	}
+}
+
+//----------------------------------------
+// Schema request data accessor:
+// Called when host requests schema of a
+// datasource.
+//----------------------------------------
+static void SchemaRequestDataAccessor(char** values)
+{
+	ResetJSONSchemas(values[0]);
+}
+
+//----------------------------------------
+// Clock ping data accessor:
+// Called when host sends a clock ping
+// (ignored if previous pong isn't sent
+// yet).
+//----------------------------------------
+static void ClockPingDataAccessor(char** values)
+{
+	uint32_t rx = SystemTimeUs();
+
+	if(clockSync_ds == NULL || clockSync_ds->sendNowFlag || values[0] == NULL)
+		return;
+
+	strncpy(ClockSyncPing, values[0], sizeof(ClockSyncPing)-1);
+	uitoa(rx, ClockSyncRx);
+
+	clockSync_ds->sendNowFlag = true;
+	Semaphore_post(PeriodicJSON_Sem);
+}
+
+//----------------------------------------
+// Clock sync data accessor:
+// Called by sending task right before
+// pong is written: stamps it with its
+// sending time.
+//----------------------------------------
+static char** ClockSyncDataAccessor(void)
+{
+	clockSync_ds->timestamp = SystemTimeUs();
+	return ClockSyncValues;
+}
+
+//----------------------------------------
+// compress:
+// Enables compressed stream mode of
+// specified JSON data source, optionally
+// changing its decimation factor.
+//----------------------------------------
+void JSON_compress_cmd(int argc, char *argv[])
+{
+	if(checkArgRange(&Console, argc, 2, 3))
+	{
+		JSONDataSource* ds = FindJSONDataSource(argv[1]);
+		if(ds == NULL)
+			UARTprintf(&Console, "Wrong JSON data source name ('%s')\n", argv[1]);
+		else if(ds->sampler == NULL || ds->sampler->resolution[0] <= 0.0f)
+			UARTprintf(&Console, "'%s' JSON data source can't be compressed.\n", argv[1]);
+		else
+		{
+			JSONDataSampler* sampler = ds->sampler;
+			uint32_t i;
+
+			if(argc == 3 && ds->mode == JSON_DS_DECIMATED)
+			{
+				int decimation = atoi(argv[2]);
+				if(!sampler->compressed)
+					sampler->uncompressedDecimation = sampler->decimation;
+				sampler->decimation = decimation > 0 ? decimation : 1;
+			}
+
+			sampler->keyframeRequested = true;
+			sampler->compressed = true;
+
+			// Print fields resolutions needed by host to decode frames
+			UARTprintf(&Console, "'%s' JSON data source compressed (resolutions:", argv[1]);
+			for(i = 0; i < ds->dataCount; ++i)
+				UARTprintf(&Console, " %s=%.6f", ds->keys[i], sampler->resolution[i]);
+			UARTwrite(&Console, ").\n", 3);
+		}
+	}
+}
+
+//----------------------------------------
+// uncompress:
+// Disables compressed stream mode of
+// specified JSON data source.
+//----------------------------------------
+void JSON_uncompress_cmd(int argc, char *argv[])
+{
+	if(checkArgCount(&Console, argc, 2))
+	{
+		JSONDataSource* ds = FindJSONDataSource(argv[1]);
+		if(ds == NULL || ds->sampler == NULL)
+			UARTprintf(&Console, "Wrong JSON data source name ('%s')\n", argv[1]);
+		else
+		{
+			if(ds->sampler->compressed && ds->sampler->uncompressedDecimation > 0)
+				ds->sampler->decimation = ds->sampler->uncompressedDecimation;
+			ds->sampler->uncompressedDecimation = 0;
+			ds->sampler->compressed = false;
+			UARTprintf(&Console, "'%s' JSON data source uncompressed.\n", argv[1]);
+		}
+	}
+}
+
 //----------------------------------------
 // enable:
 // Enables specified JSON data source.
@@ -146,6 +351,7 @@ void JSON_enable_cmd(int argc, char *argv[])
 				if(ds->name != NULL)
 					if(strcmp(ds->name, argv[argc]) == 0)
 					{
+						ds->schemaSent = false;
 						ds->enabled = true;
 						UARTprintf(&Console, "'%s' JSON data source enabled.\n", argv[argc]);
 						break;
@@ -201,6 +407,7 @@ void JSON_start_cmd(int argc, char *argv[])
 	if(checkArgCount(&Console, argc, 1))
 	{
 		DisableCmdLineInterface(&Console);
+		ResetJSONSchemas(NULL);
 		JSONCommunicationStarted = true;
 	}
 }
@@ -232,6 +439,35 @@ void JSON_disable_programatic_access_cmd(int argc, char *argv[])
 	}
 }
 
+//----------------------------------------
+// schema mode:
+// Enables schema mode: datasources send
+// their schema once and then refer to
+// their fields by index.
+//----------------------------------------
+void JSON_enable_schema_mode_cmd(int argc, char *argv[])
+{
+	if(checkArgCount(&Console, argc, 1))
+	{
+		ResetJSONSchemas(NULL);
+		JSONSchemaMode = true;
+		UARTwrite(&Console, "Schema mode enabled.", 20);
+	}
+}
+
+//----------------------------------------
+// schema mode:
+// Disables schema mode.
+//----------------------------------------
+void JSON_disable_schema_mode_cmd(int argc, char *argv[])
+{
+	if(checkArgCount(&Console, argc, 1))
+	{
+		JSONSchemaMode = false;
+		UARTwrite(&Console, "Schema mode disabled.", 21);
+	}
+}
+
 //---------------------------------------------
 // Subscribe data source:
 // Creates a data source and get it from static
@@ -301,10 +537,15 @@ JSONDataSource* SubscribePeriodicJSONDataSource2(const char* name, const char* k
 	newSource->name = name;
 	newSource->keys = keys;
 	newSource->dataCount = dataCount;
+	newSource->units = NULL;
 	newSource->enabled = enabled;
+	newSource->schemaSent = false;
+	newSource->mode = period > 0 ? JSON_DS_PERIODIC : JSON_DS_MANUAL;
 	newSource->period = period;
 	newSource->dataAccessor = dataAccessor;
+	newSource->sampler = NULL;
 	newSource->sendNowFlag = false;
+	newSource->timestamp = 0;
 
 	if(period > 0)
 	{
@@ -329,6 +570,216 @@ JSONDataSource* SubscribePeriodicJSONDataSource2(const char* name, const char* k
 	return newSource;
 }
 
+//--------------------------------------------
+// Subscribe sampled data source:
+// Creates a datasource and attaches it a free
+// sampler from 'JSONDataSamplers' pool.
+//--------------------------------------------
+static JSONDataSource* SubscribeSampledJSONDataSource(const char* name, const char* keys[], uint32_t dataCount, JSONDataSourceMode mode, uint8_t decimalCount)
+{
+	if(dataCount > MAX_SAMPLED_DATA_COUNT)
+	{
+		Log_error1("Error: Too much data fields given to create a new sampled datasource (please modify MAX_SAMPLED_DATA_COUNT=%u if needed).", MAX_SAMPLED_DATA_COUNT);
+		ASSERT(FALSE);
+		return NULL;
+	}
+
+	// Find a free sampler
+	uint32_t idx;
+	for(idx = 0; idx < MAX_SAMPLED_DATASOURCE_COUNT; ++idx)
+		if(JSONDataSamplers.owners[idx] == NULL)
+			break;
+	if(idx == MAX_SAMPLED_DATASOURCE_COUNT)
+	{
+		Log_error1("Error: Maximum sampled JSON datasources count reached (please modify MAX_SAMPLED_DATASOURCE_COUNT=%u if needed).", MAX_SAMPLED_DATASOURCE_COUNT);
+		ASSERT(FALSE);
+		return NULL;
+	}
+
+	JSONDataSource* newSource = SubscribePeriodicJSONDataSource2(name, keys, dataCount, 0, NULL, true);
+	if(newSource == NULL)
+		return NULL;
+
+	JSONDataSampler* sampler = &JSONDataSamplers.array[idx];
+	memset(sampler, 0, sizeof(JSONDataSampler));
+	sampler->decimalCount = decimalCount;
+	sampler->forceSend = true;
+
+	JSONDataSamplers.owners[sampler - JSONDataSamplers.array] = newSource;
+	newSource->sampler = sampler;
+	newSource->mode = mode;
+
+	return newSource;
+}
+
+//--------------------------------------------
+// Subscribe on-change data source:
+// Creates a datasource which sends its data
+// only when any field sampled through
+// 'SampleJSONData' moved by more than
+// 'deadband' since last sending.
+//--------------------------------------------
+JSONDataSource* SubscribeOnChangeJSONDataSource(const char* name, const char* keys[], uint32_t dataCount, float deadband, uint8_t decimalCount)
+{
+	JSONDataSource* newSource = SubscribeSampledJSONDataSource(name, keys, dataCount, JSON_DS_ON_CHANGE, decimalCount);
+	if(newSource != NULL)
+		newSource->sampler->deadband = deadband;
+	return newSource;
+}
+
+//--------------------------------------------
+// Subscribe decimated data source:
+// Creates a datasource which sends its data
+// once every 'decimation' samples given to
+// 'SampleJSONData', aggregated over them.
+//--------------------------------------------
+JSONDataSource* SubscribeDecimatedJSONDataSource(const char* name, const char* keys[], uint32_t dataCount, uint32_t decimation, JSONAggregation aggregation, uint8_t decimalCount)
+{
+	JSONDataSource* newSource = SubscribeSampledJSONDataSource(name, keys, dataCount, JSON_DS_DECIMATED, decimalCount);
+	if(newSource != NULL)
+	{
+		uint32_t i;
+		newSource->sampler->decimation = decimation > 0 ? decimation : 1;
+		for(i = 0; i < dataCount; ++i)
+			newSource->sampler->aggregation[i] = aggregation;
+	}
+	return newSource;
+}
+
+//--------------------------------------------
+// Set JSON data source units:
+// Sets units sent with datasource's schema.
+//--------------------------------------------
+void SetJSONDataSourceUnits(JSONDataSource* ds, const char* units[])
+{
+	if(ds != NULL)
+	{
+		ds->units = units;
+		ds->schemaSent = false;
+	}
+}
+
+//--------------------------------------------
+// Set JSON data source aggregation:
+// Sets aggregation of each field of given
+// decimated datasource.
+//--------------------------------------------
+bool SetJSONDataSourceAggregation(JSONDataSource* ds, const JSONAggregation aggregation[])
+{
+	if(ds == NULL || ds->sampler == NULL || ds->mode != JSON_DS_DECIMATED)
+	{
+		Log_error0("Error: Only decimated JSON datasources have an aggregation.");
+		return false;
+	}
+
+	memcpy(ds->sampler->aggregation, aggregation, ds->dataCount*sizeof(JSONAggregation));
+	return true;
+}
+
+//--------------------------------------------
+// Set JSON data source resolution:
+// Sets quantization resolution of each field
+// of given sampled datasource used by its
+// compressed stream mode.
+//--------------------------------------------
+bool SetJSONDataSourceResolution(JSONDataSource* ds, const float resolution[])
+{
+	uint32_t i;
+
+	if(ds == NULL || ds->sampler == NULL)
+	{
+		Log_error0("Error: Only on-change or decimated JSON datasources can be compressed.");
+		return false;
+	}
+
+	for(i = 0; i < ds->dataCount; ++i)
+		if(!(resolution[i] > 0.0f))
+		{
+			Log_error1("Error: JSON datasource resolution of field %u isn't positive.", i);
+			return false;
+		}
+
+	memcpy(ds->sampler->resolution, resolution, ds->dataCount*sizeof(float));
+	return true;
+}
+
+//--------------------------------------------
+// Sample JSON data:
+// Gives a new sample of 'values' to an
+// on-change or decimated datasource.
+// When data have to be sent, values are
+// copied to sampler's 'pending' array and
+// sending task is woken up. If previous
+// values are still being sent, on-change
+// datasources retry on next sample and
+// decimated datasources extend their
+// aggregation window.
+//--------------------------------------------
+void SampleJSONData(JSONDataSource* ds, const float values[])
+{
+	if(ds == NULL || ds->sampler == NULL)
+		return;
+
+	JSONDataSampler* sampler = ds->sampler;
+	uint32_t i;
+
+	// Send current values as soon as datasource get enabled and JSON communication is started
+	if(!JSONCommunicationStarted || !ds->enabled)
+	{
+		sampler->sampleCount = 0;
+		sampler->forceSend = true;
+		return;
+	}
+
+	if(ds->mode == JSON_DS_DECIMATED)
+	{
+		// Aggregate new sample
+		if(sampler->sampleCount == 0)
+			memcpy(sampler->aggregate, values, ds->dataCount*sizeof(float));
+		else
+			for(i = 0; i < ds->dataCount; ++i)
+			{
+				if(sampler->aggregation[i] == JSON_AGGREGATE_MIN)
+					sampler->aggregate[i] = values[i] < sampler->aggregate[i] ? values[i] : sampler->aggregate[i];
+				else if(sampler->aggregation[i] == JSON_AGGREGATE_MAX)
+					sampler->aggregate[i] = values[i] > sampler->aggregate[i] ? values[i] : sampler->aggregate[i];
+				else
+					sampler->aggregate[i] += values[i];
+			}
+		sampler->sampleCount++;
+
+		if((sampler->sampleCount < sampler->decimation && !sampler->forceSend) || ds->sendNowFlag)
+			return;
+
+		for(i = 0; i < ds->dataCount; ++i)
+			sampler->pending[i] = sampler->aggregation[i] == JSON_AGGREGATE_MEAN ? sampler->aggregate[i] / sampler->sampleCount : sampler->aggregate[i];
+		sampler->sampleCount = 0;
+	}
+	else
+	{
+		// Look for any field which moved by more than deadband since last sending
+		bool changed = sampler->forceSend;
+		for(i = 0; i < ds->dataCount && !changed; ++i)
+			changed = fabsf(values[i] - sampler->lastSent[i]) > sampler->deadband;
+
+		if(!changed || ds->sendNowFlag)
+			return;
+
+		memcpy(sampler->pending, values, ds->dataCount*sizeof(float));
+		memcpy(sampler->lastSent, values, ds->dataCount*sizeof(float));
+	}
+
+	// Compressed stream (re)starts with a keyframe
+	if(sampler->forceSend)
+		sampler->keyframeRequested = true;
+
+	sampler->forceSend = false;
+	// Frame is stamped with time of its last sample
+	ds->timestamp = SystemTimeUs();
+	ds->sendNowFlag = true;
+	Semaphore_post(PeriodicJSON_Sem);
+}
+
 //---------------------------------------------
 // Unsubscribe JSON data source:
 // Unsubscribes given data source.
@@ -353,6 +804,10 @@ bool UnsubscribeJSONDataSource(JSONDataSource* datasource)
 				return false;
 			}
 
+		// Release datasource's sampler
+		if(datasource->sampler != NULL)
+			JSONDataSamplers.owners[datasource->sampler - JSONDataSamplers.array] = NULL;
+
 		if(datasource->period > 0)
 		{
 			if(datasource->clock == NULL)
@@ -374,6 +829,236 @@ bool UnsubscribeJSONDataSource(JSONDataSource* datasource)
 	return false;
 }
 
+//----------------------------------------
+// JSON write:
+// Writes given string to UART console,
+// waiting for transmit buffer to drain
+// if needed (at most JSON_TX_TIMEOUT
+// ticks each time).
+//----------------------------------------
+static void JSONwrite(const char* str)
+{
+	UARTwriteTimeout(&Console, str, strlen(str), JSON_TX_TIMEOUT);
+}
+
+//----------------------------------------
+// Formats given string and arguments to
+// UART console, waiting for transmit
+// buffer to drain like 'JSONwrite'.
+//----------------------------------------
+static void JSONprintf(const char* format, ...) UART_PRINTF_FORMAT(1, 2);
+static void JSONprintf(const char* format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	UARTvprintfTimeout(&Console, JSON_TX_TIMEOUT, format, args);
+	va_end(args);
+}
+
+//----------------------------------------
+// Write JSON timestamp:
+// Writes '"t": "<us>"' member giving
+// vehicle time of datasource's data.
+//----------------------------------------
+static void WriteJSONTimestamp(JSONDataSource* ds)
+{
+	JSONprintf("\"t\": \"%u\"", ds->timestamp);
+}
+
+//----------------------------------------
+// Write JSON string array:
+// Writes a '[ ... ]' array made of
+// 'count' strings ('defaultString' is
+// used for each NULL string or if
+// 'strings' is NULL).
+//----------------------------------------
+static void WriteJSONStringArray(const char* const* strings, uint32_t count, const char* defaultString)
+{
+	uint32_t i;
+
+	JSONwrite("[ ");
+	for(i = 0; i < count; ++i)
+	{
+		const char* str = strings != NULL && strings[i] != NULL ? strings[i] : defaultString;
+		JSONwrite("\"");
+		JSONwrite(str);
+		JSONwrite(i == count-1 ? "\" " : "\", ");
+	}
+	JSONwrite("]");
+}
+
+//----------------------------------------
+// Write JSON schema:
+// Writes schema of given datasource if
+// schema mode is enabled and if it wasn't
+// already sent:
+// { "schema": "<name>", "keys": [...],
+//   "types": [...], "units": [...] }
+//----------------------------------------
+static void WriteJSONSchema(JSONDataSource* ds)
+{
+	if(!JSONSchemaMode || ds->schemaSent)
+		return;
+
+	JSONwrite("\n{ \"schema\": \"");
+	JSONwrite(ds->name);
+	JSONwrite("\", \"keys\": ");
+	WriteJSONStringArray(ds->keys, ds->dataCount, "");
+	JSONwrite(", \"types\": ");
+	WriteJSONStringArray(NULL, ds->dataCount, ds->sampler != NULL ? "float" : "string");
+	JSONwrite(", \"units\": ");
+	WriteJSONStringArray(ds->units, ds->dataCount, "");
+	JSONwrite(" }");
+
+	ds->schemaSent = true;
+}
+
+//----------------------------------------
+// Write JSON object:
+// Writes a JSON object made of given
+// datasource's keys and given values.
+// In schema mode, keys are replaced by
+// values indexes in an array:
+// { "<name>": [ "<value0>", ... ], "t": "<us>" }
+// Returns false if datasource provided
+// wrong values or keys.
+//----------------------------------------
+static bool WriteJSONObject(JSONDataSource* ds, char* values[])
+{
+	uint32_t valIdx;
+	bool success = true;
+
+	if(JSONSchemaMode)
+	{
+		for(valIdx = 0; valIdx < ds->dataCount; ++valIdx)
+			if(values[valIdx] == NULL)
+			{
+				Log_error0("Error: JSON datasource provided wrong values.");
+				return false;
+			}
+
+		WriteJSONSchema(ds);
+		JSONwrite("\n{ \"");
+		JSONwrite(ds->name);
+		JSONwrite("\": ");
+		WriteJSONStringArray((const char* const*)values, ds->dataCount, "");
+		JSONwrite(", ");
+		WriteJSONTimestamp(ds);
+		JSONwrite(" }");
+		return true;
+	}
+
+	JSONwrite(JSONProgrammaticAccessMode ? "\n{ " : "\n{\n");
+
+	for(valIdx = 0; valIdx < ds->dataCount; ++valIdx)
+	{
+		char* value = values[valIdx];
+		const char* key = ds->keys[valIdx];
+
+		if(value == NULL || key == NULL)
+		{
+			Log_error0("Error: JSON datasource provided wrong values or keys.");
+			success = false;
+			break;
+		}
+
+		JSONwrite(JSONProgrammaticAccessMode ? " \"" : "\t\"");
+		JSONwrite(key);
+		JSONwrite("\": \"");
+		JSONwrite(value);
+		JSONwrite(JSONProgrammaticAccessMode ? "\", " : "\", \n");
+	}
+
+	// Timestamp is always the last member
+	JSONwrite(JSONProgrammaticAccessMode ? " " : "\t");
+	WriteJSONTimestamp(ds);
+	JSONwrite(JSONProgrammaticAccessMode ? " }" : " \n\n}");
+
+	return success;
+}
+
+//----------------------------------------
+// Write sampled JSON object:
+// Writes pending values of given sampled
+// datasource as 'WriteJSONObject' does,
+// formatting each member with a single
+// call (no intermediate value string).
+//----------------------------------------
+static void WriteSampledJSONObject(JSONDataSource* ds)
+{
+	const JSONDataSampler* sampler = ds->sampler;
+	uint32_t i;
+
+	if(JSONSchemaMode)
+	{
+		WriteJSONSchema(ds);
+		JSONprintf("\n{ \"%s\": [ ", ds->name);
+		for(i = 0; i < ds->dataCount; ++i)
+			JSONprintf("\"%.*f\"%s", sampler->decimalCount, sampler->pending[i], i == ds->dataCount-1 ? " " : ", ");
+		JSONwrite("], ");
+		WriteJSONTimestamp(ds);
+		JSONwrite(" }");
+		return;
+	}
+
+	JSONwrite(JSONProgrammaticAccessMode ? "\n{ " : "\n{\n");
+	for(i = 0; i < ds->dataCount; ++i)
+		JSONprintf(JSONProgrammaticAccessMode ? " \"%s\": \"%.*f\", " : "\t\"%s\": \"%.*f\", \n", ds->keys[i], sampler->decimalCount, sampler->pending[i]);
+
+	// Timestamp is always the last member
+	JSONwrite(JSONProgrammaticAccessMode ? " " : "\t");
+	WriteJSONTimestamp(ds);
+	JSONwrite(JSONProgrammaticAccessMode ? " }" : " \n\n}");
+}
+
+//----------------------------------------
+// Write compressed JSON object:
+// Quantizes pending values of given
+// sampled datasource, delta-encodes them
+// against previous frame (unless a
+// keyframe is due) and writes them as a
+// base64 zigzag varint payload:
+// { "<name>": "<payload>", "t": "<us>" }
+// (see 'Tests/test_utils.c' decoder).
+//----------------------------------------
+static bool WriteCompressedJSONObject(JSONDataSource* ds)
+{
+	static uint8_t payload[1 + 5*MAX_SAMPLED_DATA_COUNT];
+	static char text[4*((sizeof(payload)+2)/3) + 1];
+	JSONDataSampler* sampler = ds->sampler;
+	int32_t quantized[MAX_SAMPLED_DATA_COUNT];
+	uint32_t i, length;
+
+	// A (re)sent schema is always followed by a keyframe
+	if(JSONSchemaMode && !ds->schemaSent)
+		sampler->keyframeRequested = true;
+	WriteJSONSchema(ds);
+
+	bool keyframe = sampler->keyframeRequested || ++sampler->framesSinceKeyframe >= JSON_KEYFRAME_PERIOD;
+	if(keyframe)
+	{
+		sampler->keyframeRequested = false;
+		sampler->framesSinceKeyframe = 0;
+	}
+
+	// NaN values are quantized to JSON_QUANTIZED_NAN
+	for(i = 0; i < ds->dataCount; ++i)
+		quantized[i] = Quantize(sampler->pending[i], sampler->resolution[i]);
+	length = DeltaFrameEncode(quantized, sampler->lastQuantized, ds->dataCount, keyframe, sampler->sequence++, payload);
+	Base64Encode(payload, length, text);
+
+	JSONwrite("\n{ \"");
+	JSONwrite(ds->name);
+	JSONwrite("\": \"");
+	JSONwrite(text);
+	JSONwrite("\", ");
+	WriteJSONTimestamp(ds);
+	JSONwrite(" }");
+
+	return true;
+}
+
 //--------------------------------------------
 // Send JSON data:
 // Send specified data corresponding to given
@@ -399,40 +1084,13 @@ bool SendJSONData(JSONDataSource* ds, char* values[])
 		if(ds->name != NULL && ds->enabled)
 		{
 			uint32_t dsIdx;
-			uint32_t valIdx;
 
 			for(dsIdx = 0; dsIdx < JSONDataSources.capacity; ++dsIdx)
 			{
 				if(ds == &JSONDataSources.array[dsIdx])
 				{
-						UARTwrite(&Console, JSONProgrammaticAccessMode ? "\n{ " : "\n{\n", 3);
-
-						for(valIdx = 0; valIdx < ds->dataCount; ++valIdx)
-						{
-							char* value = values[valIdx];
-							const char* key = ds->keys[valIdx];
-
-							if(value == NULL || key == NULL) {
-								Log_error0("Error: JSON datasource provided wrong values or keys.");
-								return false;
-							}
-
-							// Don't append comma if we are printing the last element
-							const char* comma = valIdx == ds->dataCount-1 ? "" : ",";
-
-							UARTprintf(&Console, JSONProgrammaticAccessMode ? " \"%s\": \"%s\"%s " : "\t\"%s\": \"%s\"%s \n", key, value, comma);
-						}
-
-						UARTwrite(&Console, JSONProgrammaticAccessMode ? " }" : "\n}", 2);
-
-						// If Tx UART console buffer is near to be full, we wait for UART transmition
-						// TODO: trouver mieux !
-						uint32_t timeout = 10;
-						if(UARTTxBytesFree(&Console) < 128)
-							while(UARTTxBytesFree(&Console) < 1024 && --timeout)
-								Task_sleep(1);
-
-						return true;
+					ds->timestamp = SystemTimeUs();
+					return WriteJSONObject(ds, values);
 				}
 			}
 			Log_error0("Error: Can't find specified JSON datasource among subscribed datasources.");
@@ -445,6 +1103,25 @@ bool SendJSONData(JSONDataSource* ds, char* values[])
 	return false;
 }
 
+//------------------------------------------
+// JSON communication UART console commands
+// (static command table kept in flash).
+//------------------------------------------
+static const CmdLineEntry JSONCommands[] =
+{
+	{ "listSources", 	JSON_list_sources_cmd, 	"List all available JSON data sources.", NULL, NULL },
+	{ "listInputs", 	JSON_list_inputs_cmd,	"List all available JSON data inputs.", NULL, NULL },
+	{ "enable", 		JSON_enable_cmd, 		"Enables specified JSON data source's stream (only active once \'start\' have been called).", NULL, NULL },
+	{ "disable", 		JSON_disable_cmd, 		"Disables specified JSON data source's stream.", NULL, NULL },
+	{ "compress", 		JSON_compress_cmd, 		"Enables compressed stream of specified JSON data source (optional decimation as second argument).", NULL, NULL },
+	{ "uncompress", 	JSON_uncompress_cmd, 	"Disables compressed stream of specified JSON data source.", NULL, NULL },
+	{ "start", 			JSON_start_cmd, 		"Starts JSON communication.", NULL, JSONCharReceived },
+	{ "progModeEn", 	JSON_enable_programatic_access_cmd, 	"Enables programmatic access mode. (newline means new JSON object)", NULL, NULL },
+	{ "progModeDis", 	JSON_disable_programatic_access_cmd, 	"Disables programmatic access mode.", NULL, NULL },
+	{ "schemaModeEn", 	JSON_enable_schema_mode_cmd, 	"Enables schema mode. (datasources schema is sent once, then fields are referenced by index)", NULL, NULL },
+	{ "schemaModeDis", 	JSON_disable_schema_mode_cmd, 	"Disables schema mode.", NULL, NULL }
+};
+
 //------------------------------------------
 // Periodic data sending task:
 // Sends JSON data from periodic datasources
@@ -453,22 +1130,29 @@ bool SendJSONData(JSONDataSource* ds, char* values[])
 void PeriodicJSONDataSendingTask(void)
 {
 	// Subscribe UART console commands for JSON communication
-	bool sucess = true;
-	sucess = sucess && SubscribeCmd(&Console, "listSources", 	JSON_list_sources_cmd, 	"List all available JSON data sources.");
-	sucess = sucess && SubscribeCmd(&Console, "listInputs", 	JSON_list_inputs_cmd,	"List all available JSON data inputs.");
-	sucess = sucess && SubscribeCmd(&Console, "enable", 		JSON_enable_cmd, 		"Enables specified JSON data source's stream (only active once \'start\' have been called).");
-	sucess = sucess && SubscribeCmd(&Console, "disable", 		JSON_disable_cmd, 		"Disables specified JSON data source's stream.");
-	sucess = sucess && SubscribeListeningCmd(&Console, "start", JSON_start_cmd, 		"Starts JSON communication.", "\n", NewJSONObjectReceived);
-	sucess = sucess && SubscribeCmd(&Console, "progModeEn", 	JSON_enable_programatic_access_cmd, 	"Enables programmatic access mode. (newline means new JSON object)");
-	sucess = sucess && SubscribeCmd(&Console, "progModeDis", 	JSON_disable_programatic_access_cmd, 	"Disables programmatic access mode.");
-	if(!sucess)
-	{
-		Log_error0("Error (re)allocating memory for UART console command (from JSON API).");
+	if(!SubscribeCmdTable(&Console, JSONCommands, sizeof(JSONCommands)/sizeof(JSONCommands[0])))
+	{
+		Log_error0("Error: UART console command table is full (from JSON API).");
 		return;
 	}
 
+	// Subscribe a datainput allowing host to request datasources schema again
+	schemaRequest_di = SubscribeJSONDataInput("schemaRequest", SchemaRequestKeys, 1, SchemaRequestDataAccessor);
+	if(schemaRequest_di == NULL)
+		Log_error0("Failed to subscribe 'schemaRequest' data input.");
+
 	// Subscribe raw echo from data inputs JSON datasource
-	rawEcho_ds = SubscribeJSONDataSource2("rawEcho", (const char*[]) { "rawInput" }, 2, false);
+	rawEcho_ds = SubscribeJSONDataSource2("rawEcho", RawEchoKeys, 1, false);
+
+	// Subscribe clock sync datasource and datainput allowing host to align its clock with vehicle time
+	clockSync_ds = SubscribeJSONDataSource("clockSync", ClockSyncKeys, 2);
+	if(clockSync_ds != NULL)
+	{
+		clockSync_ds->dataAccessor = ClockSyncDataAccessor;
+		clockPing_di = SubscribeJSONDataInput("clockPing", ClockPingKeys, 1, ClockPingDataAccessor);
+	}
+	if(clockSync_ds == NULL || clockPing_di == NULL)
+		Log_error0("Failed to subscribe 'clockSync' data source or 'clockPing' data input.");
 
 	while(1)
 	{
@@ -477,45 +1161,27 @@ void PeriodicJSONDataSendingTask(void)
 		if(JSONDataSources.used > 0)
 		{
 			uint32_t dsIdx;
-			uint32_t valIdx;
 
 			// Send data from JSON datasources accessors if they are enabled and if their sendNowFlag is raised
 			for(dsIdx = 0; dsIdx < JSONDataSources.capacity; ++dsIdx)
 			{
 				JSONDataSource* ds = &JSONDataSources.array[dsIdx];
-				if(ds->sendNowFlag && ds->enabled && ds->name != NULL)
+				if(ds->sendNowFlag && ds->name != NULL)
 				{
-					UARTwrite(&Console, JSONProgrammaticAccessMode ? "\n{ " : "\n{\n", 3);
-
-					// Get value string pointer array from JSON data source
-					char** values = ds->dataAccessor();
-
-					for(valIdx = 0; valIdx < ds->dataCount; ++valIdx)
+					// Get value string pointer array from JSON data source (or its sampler) and send it
+					if(ds->enabled)
 					{
-						char* value = values[valIdx];
-						const char* key = ds->keys[valIdx];
-
-						if(value == NULL || key == NULL)
-						{
-							Log_error0("Error: JSON datasource provided wrong values or keys.");
-							break;
-						}
-
-						// Don't append comma if we are printing the last element
-						const char* comma = valIdx == ds->dataCount-1 ? "" : ",";
-
-						UARTprintf(&Console, JSONProgrammaticAccessMode ? " \"%s\": \"%s\"%s " : "\t\"%s\": \"%s\"%s \n", key, value, comma);
+						// Each JSON object is published to UART console as a single write so that other tasks output can't split it
+						UARTHoldTx(&Console);
+						if(ds->sampler != NULL && ds->sampler->compressed)
+							WriteCompressedJSONObject(ds);
+						else if(ds->sampler != NULL)
+							WriteSampledJSONObject(ds);
+						else
+							WriteJSONObject(ds, ds->dataAccessor());
+						UARTReleaseTx(&Console);
 					}
 
-					UARTwrite(&Console, JSONProgrammaticAccessMode ? " }" : "\n}", 2);
-
-					// If Tx UART console buffer is near to be full, we wait for UART transmition
-					// TODO: trouver mieux !
-					uint32_t timeout = ds->period;
-					if(UARTTxBytesFree(&Console) < 128)
-						while(UARTTxBytesFree(&Console) < 1024 && --timeout)
-							Task_sleep(1);
-
 					ds->sendNowFlag = false;
 				}
 			}
@@ -563,6 +1229,7 @@ void PeriodicJSONDataSendingSwi(UArg dataSource)
 	{
 		if(ds->dataAccessor != NULL && ds->name != NULL)
 		{
+			ds->timestamp = SystemTimeUs();
 			ds->sendNowFlag = true;
 
 			Semaphore_post(PeriodicJSON_Sem);
@@ -570,6 +1237,19 @@ void PeriodicJSONDataSendingSwi(UArg dataSource)
 	}
 }
 
+//--------------------------------------------
+// Hash JSON key:
+// FNV-1a hash of given key, computed
+// incrementally by JSON input parser.
+//--------------------------------------------
+static uint32_t HashJSONKey(const char* key)
+{
+	uint32_t hash = JSON_KEY_HASH_BASIS;
+	while(*key != '\0')
+		hash = JSON_KEY_HASH_STEP(hash, *key++);
+	return hash;
+}
+
 //--------------------------------------------
 // Subscribe JSON data input:
 // Subscribe to incomming data corresponding
@@ -580,6 +1260,17 @@ void PeriodicJSONDataSendingSwi(UArg dataSource)
 // data is received.
 //--------------------------------------------
 JSONDataInput* SubscribeJSONDataInput(char* name, const char* keys[], uint32_t dataCount, DataValuesSetAccessor dataAccessor)
+{
+	return SubscribeTypedJSONDataInput(name, keys, dataCount, NULL, false, dataAccessor);
+}
+
+//--------------------------------------------
+// Subscribe typed JSON data input:
+// Subscribe to incomming data whose values
+// are written straight to 'bindings' typed
+// targets.
+//--------------------------------------------
+JSONDataInput* SubscribeTypedJSONDataInput(char* name, const char* keys[], uint32_t dataCount, const JSONInputBinding bindings[], bool atomic, DataValuesSetAccessor dataAccessor)
 {
 	if(!JSONDataSources.IsJSONDatasourcesArrayInitialized)
 		InitializeJSONDataSourcesArray();
@@ -615,8 +1306,20 @@ JSONDataInput* SubscribeJSONDataInput(char* name, const char* keys[], uint32_t d
 	newInput->name = name;
 	newInput->keys = keys;
 	newInput->dataCount = dataCount;
+	newInput->bindings = bindings;
+	newInput->atomic = atomic;
 	newInput->dataAccessor = dataAccessor;
 
+	// Precompute keys hashes and key lookup table used by JSON input parser
+	uint32_t i, slot;
+	memset(newInput->keyTable, 0, sizeof(newInput->keyTable));
+	for(i = 0; i < dataCount; ++i)
+	{
+		newInput->keyHashes[i] = HashJSONKey(keys[i]);
+		for(slot = newInput->keyHashes[i]; newInput->keyTable[slot & (JSON_KEY_TABLE_SIZE-1)] != 0; ++slot);
+		newInput->keyTable[slot & (JSON_KEY_TABLE_SIZE-1)] = i + 1;
+	}
+
 	return newInput;
 }
 
@@ -652,71 +1355,386 @@ bool UnsubscribeJSONDataInput(JSONDataInput* datainput)
 }
 
 //------------------------------------------
-// New JSON object received:
-// Called by UART console when a newline
-// character is received.
-// This function deserializes any valid JSON
-// object to update corresponding subscribed
-// datainput.
+// JSON input parser:
+// Incremental parser fed with every
+// character received while JSON
+// communication is started. It accepts
+// one-line flat objects made of string,
+// number or literal values and matches
+// their keys against subscribed datainputs
+// keys hashes as soon as they are
+// received, so that no line buffer is
+// copied nor parsed again.
 //------------------------------------------
-static void NewJSONObjectReceived(char c)
+typedef enum
 {
-	static char buf[INPUT_JSON_BUFFER_SIZE];
-	static jsmntok_t tokens[INPUT_JSON_TOKEN_NUM];
-	static jsmn_parser parser;
-	static char data[MAX_DATA_COUNT][32];
-	static char* dataPtrs[MAX_DATA_COUNT];
+	JSON_PARSE_IDLE,			// Waiting for '{'
+	JSON_PARSE_KEY_OR_END,		// Waiting for a key or '}'
+	JSON_PARSE_KEY,				// Receiving a key
+	JSON_PARSE_COLON,			// Waiting for ':'
+	JSON_PARSE_VALUE,			// Waiting for a value
+	JSON_PARSE_STRING,			// Receiving a string value
+	JSON_PARSE_STRING_ESCAPE,	// Receiving an escaped character of a string value
+	JSON_PARSE_LITERAL,			// Receiving a number or literal value
+	JSON_PARSE_COMMA_OR_END,	// Waiting for ',' or '}'
+	JSON_PARSE_ERROR			// Ignoring characters until next line
+} JSONParseState;
 
-	uint32_t i, j, tokNum;
-	jsmntok_t* tok;
-	JSONDataInput* di;
-	const char* key;
+static struct
+{
+	JSONParseState state;
+	// Hash, length and characters of the key being received
+	uint32_t keyHash;
+	uint32_t keyLength;
+	char key[JSON_INPUT_VALUE_SIZE];
+	// Index of current key/value pair in received object
+	uint32_t pairIdx;
+	// Length of the value being received
+	uint32_t valueLength;
+	// Bit mask of datainputs which have all received keys so far
+	uint32_t candidates;
+	// Field index of each received pair and bit mask of received fields for each datainput
+	uint8_t pairFields[MAX_DATAINPUT_COUNT][MAX_DATA_COUNT];
+	uint32_t receivedFields[MAX_DATAINPUT_COUNT];
+	char values[MAX_DATA_COUNT][JSON_INPUT_VALUE_SIZE];
+	char* valuePtrs[MAX_DATA_COUNT];
+	// Raw line given to 'rawEcho' datasource
+	char rawLine[INPUT_JSON_BUFFER_SIZE];
+	uint32_t rawLength;
+} JSONParser = {.state = JSON_PARSE_IDLE};
 
-	//TODO : lock
-	memset(buf, 0, INPUT_JSON_BUFFER_SIZE);
-	memset(data, 0, 32*MAX_DATA_COUNT);
+//------------------------------------------
+// Find JSON input key:
+// Looks for received key in key lookup
+// table of given datainput. Returns key
+// index or -1 if datainput doesn't have
+// this key.
+//------------------------------------------
+static int32_t FindJSONInputKey(const JSONDataInput* di)
+{
+	uint32_t slot = JSONParser.keyHash;
+	uint8_t entry;
 
-	UARTgets(&Console, buf, INPUT_JSON_BUFFER_SIZE);
+	if(JSONParser.keyLength >= JSON_INPUT_VALUE_SIZE)
+		return -1;
 
-	if(rawEcho_ds != NULL)
-		if(rawEcho_ds->enabled)
-			SendJSONData(rawEcho_ds, (char**)(&buf));
+	while((entry = di->keyTable[slot++ & (JSON_KEY_TABLE_SIZE-1)]) != 0)
+		if(di->keyHashes[entry-1] == JSONParser.keyHash && strcmp(di->keys[entry-1], JSONParser.key) == 0)
+			return entry-1;
 
-	jsmn_init(&parser);
-	tokNum = jsmn_parse(&parser, buf, INPUT_JSON_BUFFER_SIZE, tokens, INPUT_JSON_TOKEN_NUM);
+	return -1;
+}
 
-	for(i = 0; i < JSONDataInputs.capacity; i++)
+//------------------------------------------
+// JSON parser key received:
+// Discards datainputs which don't have
+// received key and remembers its field
+// index for the others.
+//------------------------------------------
+static void JSONParserKeyReceived(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < JSONDataInputs.capacity; ++i)
+		if(JSONParser.candidates & (1u << i))
+		{
+			int32_t field = FindJSONInputKey(&JSONDataInputs.array[i]);
+			if(field < 0)
+				JSONParser.candidates &= ~(1u << i);
+			else
+			{
+				JSONParser.pairFields[i][JSONParser.pairIdx] = field;
+				JSONParser.receivedFields[i] |= 1u << field;
+			}
+		}
+}
+
+//------------------------------------------
+// JSON parser value received:
+// Terminates received value and moves to
+// next key/value pair.
+//------------------------------------------
+static void JSONParserValueReceived(void)
+{
+	JSONParser.values[JSONParser.pairIdx][JSONParser.valueLength] = '\0';
+	JSONParser.valuePtrs[JSONParser.pairIdx] = JSONParser.values[JSONParser.pairIdx];
+	JSONParser.pairIdx++;
+}
+
+//------------------------------------------
+// Parse JSON number:
+// Decodes a decimal number with optional
+// fraction and exponent. Returns false if
+// given string isn't a valid number.
+//------------------------------------------
+static bool ParseJSONNumber(const char* str, float* value)
+{
+	float result = 0.0f, scale = 1.0f;
+	bool negative = false, hasDigits = false;
+	int32_t exponent = 0;
+
+	if(*str == '-' || *str == '+')
+		negative = (*str++ == '-');
+
+	for(; *str >= '0' && *str <= '9'; ++str, hasDigits = true)
+		result = result*10.0f + (*str - '0');
+
+	if(*str == '.')
+		for(++str; *str >= '0' && *str <= '9'; ++str, hasDigits = true)
+		{
+			scale *= 0.1f;
+			result += (*str - '0') * scale;
+		}
+
+	if(!hasDigits)
+		return false;
+
+	if(*str == 'e' || *str == 'E')
+	{
+		bool negativeExponent = false;
+		++str;
+		if(*str == '-' || *str == '+')
+			negativeExponent = (*str++ == '-');
+		if(*str < '0' || *str > '9')
+			return false;
+		for(; *str >= '0' && *str <= '9'; ++str)
+			if(exponent < 64)
+				exponent = exponent*10 + (*str - '0');
+		for(; exponent > 0; --exponent)
+			result = negativeExponent ? result*0.1f : result*10.0f;
+	}
+
+	if(*str != '\0')
+		return false;
+
+	*value = negative ? -result : result;
+	return true;
+}
+
+//------------------------------------------
+// Apply JSON input bindings:
+// Decodes and validates received values of
+// given typed datainput, then writes them
+// to their targets (at once if datainput
+// is atomic). Targets of fields which
+// weren't received are left untouched.
+//------------------------------------------
+static void ApplyJSONInputBindings(JSONDataInput* di, const uint8_t pairFields[])
+{
+	float staged[MAX_DATA_COUNT];
+	uint32_t i;
+
+	// Decode and validate all received values before writing any target
+	for(i = 0; i < JSONParser.pairIdx; ++i)
 	{
-		di = &JSONDataInputs.array[i];
+		const JSONInputBinding* binding = &di->bindings[pairFields[i]];
+		const char* str = JSONParser.valuePtrs[i];
+		float value;
+
+		if(binding->type == JSON_INPUT_BOOL && strcmp(str, "true") == 0)
+			value = 1.0f;
+		else if(binding->type == JSON_INPUT_BOOL && strcmp(str, "false") == 0)
+			value = 0.0f;
+		else if(!ParseJSONNumber(str, &value))
+			value = binding->defaultValue;
+		else if(binding->type == JSON_INPUT_FLOAT)
+			value = value < binding->min ? binding->min : (value > binding->max ? binding->max : value);
+
+		staged[i] = value;
+	}
 
-		if(di->name != NULL)
+	// Write targets
+	unsigned key = di->atomic ? Task_disable() : 0;
+	for(i = 0; i < JSONParser.pairIdx; ++i)
+	{
+		const JSONInputBinding* binding = &di->bindings[pairFields[i]];
+		if(binding->target == NULL)
+			continue;
+		if(binding->type == JSON_INPUT_BOOL)
+			*(bool*)binding->target = (staged[i] != 0.0f);
+		else
+			*(float*)binding->target = staged[i];
+	}
+	if(di->atomic)
+		Task_restore(key);
+}
+
+//------------------------------------------
+// JSON parser object received:
+// Gives received values to the first
+// datainput having all received keys.
+// Typed datainputs accept partial updates
+// whereas others need all their keys.
+//------------------------------------------
+static void JSONParserObjectReceived(void)
+{
+	static char* fieldValues[MAX_DATA_COUNT];
+	uint32_t i, j;
+
+	for(i = 0; i < JSONDataInputs.capacity; ++i)
+		if(JSONParser.candidates & (1u << i))
 		{
-			if(tokNum != di->dataCount*2+1)
+			JSONDataInput* di = &JSONDataInputs.array[i];
+			bool complete = JSONParser.receivedFields[i] == (di->dataCount == 32 ? 0xFFFFFFFF : (1u << di->dataCount) - 1);
+
+			if(!complete && di->bindings == NULL)
 				continue;
 
-			for(j = 0; j < di->dataCount; j++)
+			if(di->bindings != NULL)
+				ApplyJSONInputBindings(di, JSONParser.pairFields[i]);
+
+			if(di->dataAccessor != NULL)
 			{
-				tok = &tokens[1+2*j];
-				key = di->keys[j];
-				if(!strncmp(buf + tok->start, key, tok->end - tok->start))
-				{
-					tok = &tokens[2+2*j];
+				// Give values to accessor in datainput's keys order (NULL for fields which weren't received)
+				memset(fieldValues, 0, sizeof(fieldValues));
+				for(j = 0; j < JSONParser.pairIdx; ++j)
+					fieldValues[JSONParser.pairFields[i][j]] = JSONParser.valuePtrs[j];
+				di->dataAccessor(fieldValues);
+			}
+			return;
+		}
+}
 
-					if(tok->end - tok->start > 32)
-						return;
+//------------------------------------------
+// JSON character received:
+// Called by UART console for every
+// received character once JSON
+// communication is started.
+//------------------------------------------
+static void JSONCharReceived(char c)
+{
+	uint32_t i;
+	bool isSpace = c == ' ' || c == '\t' || c == '\r';
 
-					strncpy(data[j], buf + tok->start, tok->end - tok->start);
-					dataPtrs[j] = data[j];
-				}
-				else
-					break;
-			}
+	// A new line always ends current object
+	if(c == '\n')
+	{
+		if(rawEcho_ds != NULL && rawEcho_ds->enabled && JSONParser.rawLength > 0)
+		{
+			char* rawValues[1] = { JSONParser.rawLine };
+			JSONParser.rawLine[JSONParser.rawLength] = '\0';
+			SendJSONData(rawEcho_ds, rawValues);
+		}
+		JSONParser.rawLength = 0;
+		JSONParser.state = JSON_PARSE_IDLE;
+		return;
+	}
 
-			if(j == di->dataCount)
+	if(rawEcho_ds != NULL && rawEcho_ds->enabled && JSONParser.rawLength < INPUT_JSON_BUFFER_SIZE-1)
+		JSONParser.rawLine[JSONParser.rawLength++] = c;
+
+	switch(JSONParser.state)
+	{
+	case JSON_PARSE_IDLE:
+		if(c == '{')
+		{
+			JSONParser.pairIdx = 0;
+			JSONParser.candidates = 0;
+			for(i = 0; i < JSONDataInputs.capacity; ++i)
 			{
-				di->dataAccessor((char**)dataPtrs);
-				return;
+				JSONParser.receivedFields[i] = 0;
+				if(JSONDataInputs.array[i].name != NULL)
+					JSONParser.candidates |= 1u << i;
 			}
+			JSONParser.state = JSON_PARSE_KEY_OR_END;
+		}
+		break;
+
+	case JSON_PARSE_KEY_OR_END:
+		if(c == '"' && JSONParser.pairIdx < MAX_DATA_COUNT)
+		{
+			JSONParser.keyHash = JSON_KEY_HASH_BASIS;
+			JSONParser.keyLength = 0;
+			JSONParser.state = JSON_PARSE_KEY;
+		}
+		else if(c == '}' && JSONParser.pairIdx == 0)
+			JSONParser.state = JSON_PARSE_IDLE;
+		else if(!isSpace)
+			JSONParser.state = JSON_PARSE_ERROR;
+		break;
+
+	case JSON_PARSE_KEY:
+		if(c == '"')
+		{
+			if(JSONParser.keyLength < JSON_INPUT_VALUE_SIZE)
+				JSONParser.key[JSONParser.keyLength] = '\0';
+			JSONParserKeyReceived();
+			JSONParser.state = JSON_PARSE_COLON;
+		}
+		else
+		{
+			JSONParser.keyHash = JSON_KEY_HASH_STEP(JSONParser.keyHash, c);
+			if(JSONParser.keyLength < JSON_INPUT_VALUE_SIZE-1)
+				JSONParser.key[JSONParser.keyLength] = c;
+			JSONParser.keyLength++;
+		}
+		break;
+
+	case JSON_PARSE_COLON:
+		if(c == ':')
+			JSONParser.state = JSON_PARSE_VALUE;
+		else if(!isSpace)
+			JSONParser.state = JSON_PARSE_ERROR;
+		break;
+
+	case JSON_PARSE_VALUE:
+		JSONParser.valueLength = 0;
+		if(c == '"')
+			JSONParser.state = JSON_PARSE_STRING;
+		else if(c == '{' || c == '[' || c == ',' || c == '}')
+			JSONParser.state = JSON_PARSE_ERROR;
+		else if(!isSpace)
+		{
+			JSONParser.values[JSONParser.pairIdx][JSONParser.valueLength++] = c;
+			JSONParser.state = JSON_PARSE_LITERAL;
 		}
+		break;
+
+	case JSON_PARSE_STRING:
+	case JSON_PARSE_STRING_ESCAPE:
+		if(c == '"' && JSONParser.state == JSON_PARSE_STRING)
+		{
+			JSONParserValueReceived();
+			JSONParser.state = JSON_PARSE_COMMA_OR_END;
+		}
+		else if(c == '\\' && JSONParser.state == JSON_PARSE_STRING)
+			JSONParser.state = JSON_PARSE_STRING_ESCAPE;
+		else if(JSONParser.valueLength < JSON_INPUT_VALUE_SIZE-1)
+		{
+			JSONParser.values[JSONParser.pairIdx][JSONParser.valueLength++] = c;
+			JSONParser.state = JSON_PARSE_STRING;
+		}
+		else
+			JSONParser.state = JSON_PARSE_ERROR;
+		break;
+
+	case JSON_PARSE_LITERAL:
+		if(c != ',' && c != '}' && !isSpace)
+		{
+			if(JSONParser.valueLength < JSON_INPUT_VALUE_SIZE-1)
+				JSONParser.values[JSONParser.pairIdx][JSONParser.valueLength++] = c;
+			else
+				JSONParser.state = JSON_PARSE_ERROR;
+			break;
+		}
+		JSONParserValueReceived();
+		JSONParser.state = JSON_PARSE_COMMA_OR_END;
+		// Literal's ending character is processed as a separator (fall through)
+
+	case JSON_PARSE_COMMA_OR_END:
+		if(c == ',')
+			JSONParser.state = JSON_PARSE_KEY_OR_END;
+		else if(c == '}')
+		{
+			JSONParserObjectReceived();
+			JSONParser.state = JSON_PARSE_IDLE;
+		}
+		else if(!isSpace)
+			JSONParser.state = JSON_PARSE_ERROR;
+		break;
+
+	case JSON_PARSE_ERROR:
+	default:
+		break;
 	}
 }
@@ -16,21 +16,48 @@
 #endif
 
 #ifndef MAX_DATAINPUT_COUNT
-#define MAX_DATAINPUT_COUNT				2
+#define MAX_DATAINPUT_COUNT				4
 #endif
 
 #ifndef INPUT_JSON_BUFFER_SIZE
 #define INPUT_JSON_BUFFER_SIZE			512
 #endif
 
-#ifndef INPUT_JSON_TOKEN_NUM
-#define INPUT_JSON_TOKEN_NUM			128
+// Size of JSON data inputs key lookup tables (power of two greater than MAX_DATA_COUNT)
+#ifndef JSON_KEY_TABLE_SIZE
+#define JSON_KEY_TABLE_SIZE				64
+#endif
+
+// Maximum length of received JSON keys and values
+#ifndef JSON_INPUT_VALUE_SIZE
+#define JSON_INPUT_VALUE_SIZE			32
 #endif
 
 #ifndef MAX_DATA_COUNT
 #define MAX_DATA_COUNT					32
 #endif
 
+#ifndef MAX_SAMPLED_DATASOURCE_COUNT
+#define MAX_SAMPLED_DATASOURCE_COUNT	6
+#endif
+
+#ifndef MAX_SAMPLED_DATA_COUNT
+#define MAX_SAMPLED_DATA_COUNT			16
+#endif
+
+// Count of compressed frames between two keyframes
+#ifndef JSON_KEYFRAME_PERIOD
+#define JSON_KEYFRAME_PERIOD			50
+#endif
+
+// Quantized value sent for NaN in compressed stream mode (other values saturate to [INT32_MIN+1, INT32_MAX])
+#define JSON_QUANTIZED_NAN				INT32_MIN
+
+// Maximum time (RTOS clock ticks) JSON data sending waits for UART console transmit buffer to drain
+#ifndef JSON_TX_TIMEOUT
+#define JSON_TX_TIMEOUT					10
+#endif
+
 //----------------------------------------
 // Data accessor function typedef used to
 // get string data array from datasources.
@@ -38,6 +65,60 @@
 typedef char** (*DataValuesGetAccessor)(void);
 typedef void (*DataValuesSetAccessor)(char**);
 
+//----------------------------------------
+// JSON datasource sending modes:
+// > JSON_DS_MANUAL: data is sent by
+//   'SendJSONData' calls.
+// > JSON_DS_PERIODIC: data is sent every
+//   'period' RTOS clock ticks.
+// > JSON_DS_ON_CHANGE: data is sent when
+//   any sampled field moved by more than
+//   a deadband since last sending.
+// > JSON_DS_DECIMATED: data is sent once
+//   every N samples, aggregated over them.
+//----------------------------------------
+typedef enum { JSON_DS_MANUAL, JSON_DS_PERIODIC, JSON_DS_ON_CHANGE, JSON_DS_DECIMATED } JSONDataSourceMode;
+
+//----------------------------------------
+// Aggregation applied by decimated JSON
+// datasources to each field over their N
+// samples.
+//----------------------------------------
+typedef enum { JSON_AGGREGATE_MIN, JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MAX } JSONAggregation;
+
+//------------------------------------------
+// A structure gathering sampling state of
+// an on-change or decimated datasource.
+// 'pending' values are written by sampling
+// thread and read by sending task only
+// while datasource's 'sendNowFlag' is set.
+//------------------------------------------
+typedef struct
+{
+	// Deadband of on-change datasources
+	float deadband;
+	// Decimation factor and per field aggregation of decimated datasources
+	uint32_t decimation;
+	JSONAggregation aggregation[MAX_SAMPLED_DATA_COUNT];
+	// Decimal count used to convert values to strings
+	uint8_t decimalCount;
+	// Count of samples aggregated since last sending
+	uint32_t sampleCount;
+	// Flag forcing next sample to be sent (e.g. when datasource is enabled)
+	bool forceSend;
+	float lastSent[MAX_SAMPLED_DATA_COUNT];
+	float aggregate[MAX_SAMPLED_DATA_COUNT];
+	float pending[MAX_SAMPLED_DATA_COUNT];
+	// Compressed stream mode state (see 'SetJSONDataSourceResolution')
+	bool compressed;
+	bool keyframeRequested;
+	uint8_t sequence;
+	uint32_t framesSinceKeyframe;
+	uint32_t uncompressedDecimation;
+	float resolution[MAX_SAMPLED_DATA_COUNT];
+	int32_t lastQuantized[MAX_SAMPLED_DATA_COUNT];
+} JSONDataSampler;
+
 //------------------------------------------
 // A structure gathering informations about
 // a JSON data source.
@@ -52,17 +133,53 @@ typedef struct
 	const char** keys;
 	// Data member count (length of arrays)
 	uint32_t dataCount;
+	// Data units table (optional, sent with datasource's schema)
+	const char** units;
 	// Boolean indicating wether if the datasource should send its data or not.
 	bool enabled;
+	// Flag indicating wether if datasource's schema have been sent in schema mode
+	volatile bool schemaSent;
+	// Datasource sending mode
+	JSONDataSourceMode mode;
 	// Period of the data source data sending in RTOS clock ticks (0 means not periodic)
 	uint32_t period;
 	// If the datasource is periodic, this handle keep track of the datasource clock.
 	Clock_Handle clock;
 	DataValuesGetAccessor dataAccessor;
+	// Sampling state of on-change and decimated datasources (NULL otherwise)
+	JSONDataSampler* sampler;
 	// Flag used to indicate to sending task that this data source need to send its data
-	bool sendNowFlag;
+	volatile bool sendNowFlag;
+	// Vehicle time (microseconds) of data to send, sent as "t" member of each JSON object
+	volatile uint32_t timestamp;
 } JSONDataSource;
 
+//------------------------------------------
+// Type of a JSON data input binding target
+//------------------------------------------
+typedef enum { JSON_INPUT_FLOAT, JSON_INPUT_BOOL } JSONInputType;
+
+//------------------------------------------
+// A structure binding a JSON data input
+// field to a typed target:
+// > JSON_INPUT_FLOAT targets are 'float*'
+//   and received numbers are saturated to
+//   ['min', 'max'] range.
+// > JSON_INPUT_BOOL targets are 'bool*' and
+//   are true if received value is 'true' or
+//   a non-zero number.
+// 'defaultValue' is written if received
+// value isn't a valid number or boolean.
+//------------------------------------------
+typedef struct
+{
+	JSONInputType type;
+	void* target;
+	float min;
+	float max;
+	float defaultValue;
+} JSONInputBinding;
+
 //-------------------------------------------
 // A structure typedef gathering informations
 // about a JSON data input.
@@ -77,9 +194,45 @@ typedef struct
 	const char** keys;
 	// Data member count (length of arrays)
 	uint32_t dataCount;
+	// Keys hashes and open addressing key lookup table (key index + 1, 0 means empty slot) precomputed at subscription
+	uint32_t keyHashes[MAX_DATA_COUNT];
+	uint8_t keyTable[JSON_KEY_TABLE_SIZE];
+	// Typed targets of received values (NULL if values are only given to accessor)
+	const JSONInputBinding* bindings;
+	// Flag indicating wether if all bound targets must be updated at once
+	bool atomic;
 	DataValuesSetAccessor dataAccessor;
 } JSONDataInput;
 
+//----------------------------------------
+// Frames timestamps and clock sync:
+// Every sent JSON object ends with a
+// "t": "<us>" member giving vehicle time of
+// its data in microseconds (wrapping around
+// 2^32): time of last sample for on-change
+// and decimated datasources, time of
+// sending otherwise.
+// Host can align its clock with vehicle's
+// one by sending:
+//   { "clockPing": "<t0>" }
+// which is answered by 'clockSync'
+// datasource with:
+//   { "ping": "<t0>", "rx": "<t1>", "t": "<t2>" }
+// where t0 is host time of ping sending
+// (echoed as is), t1 vehicle time of ping
+// reception and t2 vehicle time of pong
+// sending. With t3 host time of pong
+// reception (all in microseconds):
+//   offset = ((t1 - t0) + (t2 - t3)) / 2
+//   latency = ((t3 - t0) - (t2 - t1)) / 2
+// Host time of any frame is then its "t"
+// minus offset, and drift is the slope of
+// offsets measured over time (e.g. least
+// squares fit over pings with the lowest
+// latencies). A new ping is ignored until
+// previous pong have been sent.
+//----------------------------------------
+
 //----------------------------------------
 // UART console commands for JSON
 // communication.
@@ -87,9 +240,13 @@ typedef struct
 void JSON_list_sources_cmd(int argc, char *argv[]);
 void JSON_enable_cmd(int argc, char *argv[]);
 void JSON_disable_cmd(int argc, char *argv[]);
+void JSON_compress_cmd(int argc, char *argv[]);
+void JSON_uncompress_cmd(int argc, char *argv[]);
 void JSON_start_cmd(int argc, char *argv[]);
 void JSON_enable_programatic_access_cmd(int argc, char *argv[]);
 void JSON_disable_programatic_access_cmd(int argc, char *argv[]);
+void JSON_enable_schema_mode_cmd(int argc, char *argv[]);
+void JSON_disable_schema_mode_cmd(int argc, char *argv[]);
 
 //---------------------------------------------
 // Subscribe data source:
@@ -116,6 +273,86 @@ JSONDataSource* SubscribeJSONDataSource2(const char* name,const char* keys[], ui
 JSONDataSource* SubscribePeriodicJSONDataSource(const char* name, const char* keys[], uint32_t dataCount, uint32_t period, DataValuesGetAccessor DataAccessor);
 JSONDataSource* SubscribePeriodicJSONDataSource2(const char* name, const char* keys[], uint32_t dataCount, uint32_t period, DataValuesGetAccessor dataAccessor, bool enabled);
 
+//--------------------------------------------
+// Subscribe on-change data source:
+// Creates a datasource which sends its data
+// only when any field sampled through
+// 'SampleJSONData' moved by more than
+// 'deadband' since last sending.
+// 'decimalCount' is the number of decimals
+// sent for each value.
+//--------------------------------------------
+JSONDataSource* SubscribeOnChangeJSONDataSource(const char* name, const char* keys[], uint32_t dataCount, float deadband, uint8_t decimalCount);
+
+//--------------------------------------------
+// Subscribe decimated data source:
+// Creates a datasource which sends its data
+// once every 'decimation' samples given to
+// 'SampleJSONData'. Sent values are the
+// minimum, mean or maximum of each field
+// over these samples (see 'aggregation',
+// applied to every field unless
+// 'SetJSONDataSourceAggregation' is called).
+//--------------------------------------------
+JSONDataSource* SubscribeDecimatedJSONDataSource(const char* name, const char* keys[], uint32_t dataCount, uint32_t decimation, JSONAggregation aggregation, uint8_t decimalCount);
+
+//--------------------------------------------
+// Sample JSON data:
+// Gives a new sample of 'values' to an
+// on-change or decimated datasource. Should
+// be called once per loop iteration by data
+// producer. Values are only formatted by
+// sending task.
+//--------------------------------------------
+void SampleJSONData(JSONDataSource* ds, const float values[]);
+
+//--------------------------------------------
+// Set JSON data source units:
+// Sets units of each field of given
+// datasource ('units' array should have the
+// same size as datasource's 'keys' array).
+// Units are only sent with datasource's
+// schema (see 'schemaModeEn' command).
+//--------------------------------------------
+void SetJSONDataSourceUnits(JSONDataSource* ds, const char* units[]);
+
+//--------------------------------------------
+// Set JSON data source aggregation:
+// Sets aggregation of each field of given
+// decimated datasource (e.g. maximum of
+// motors commands but mean of signed PIDs
+// outputs, whose maximum would hide
+// negative peaks).
+// Returns false if datasource isn't
+// decimated.
+//--------------------------------------------
+bool SetJSONDataSourceAggregation(JSONDataSource* ds, const JSONAggregation aggregation[]);
+
+//--------------------------------------------
+// Set JSON data source resolution:
+// Allows given on-change or decimated
+// datasource to be streamed in compressed
+// mode ('compress' command) with given
+// quantization resolution of each field.
+// Compressed frames are sent as:
+//   { "<name>": "<base64 payload>" }
+// where payload is a header byte (bit 7:
+// keyframe flag, bits 0-6: sequence number)
+// followed by one zigzag varint per field.
+// Keyframes carry quantized values and other
+// frames carry differences (modulo 2^32) with
+// previous frame's quantized values.
+// Quantized values saturate to
+// [INT32_MIN+1, INT32_MAX] and NaN values
+// are sent as JSON_QUANTIZED_NAN. Keyframes
+// are sent every JSON_KEYFRAME_PERIOD frames
+// and whenever stream (re)starts so that
+// host can resync after any lost frame.
+// Returns false if datasource isn't sampled
+// or if any resolution isn't positive.
+//--------------------------------------------
+bool SetJSONDataSourceResolution(JSONDataSource* ds, const float resolution[]);
+
 //--------------------------------------------
 // Unsubscribe JSON data source:
 // Unsubscribes given data source.
@@ -154,9 +391,32 @@ void PeriodicJSONDataSendingSwi(UArg dataSource);
 // names of the data fields that will be
 // populated as soon as corresponding JSON
 // data is received.
+// Received objects must contain all keys, in
+// any order.
 //--------------------------------------------
 JSONDataInput* SubscribeJSONDataInput(char* name, const char* keys[], uint32_t dataCount, DataValuesSetAccessor dataAccessor);
 
+//--------------------------------------------
+// Subscribe typed JSON data input:
+// Subscribe to incomming data whose values
+// are decoded, validated and written straight
+// to typed targets of 'bindings' table (which
+// should contain 'dataCount' bindings).
+// Keys can be received in any order and
+// objects may only contain changed fields
+// (partial updates): other targets are left
+// untouched.
+// If 'atomic' is true, all targets are written
+// without being preempted by other tasks once
+// a whole object have been received and
+// validated, so that readers never see them
+// half-updated.
+// 'dataAccessor' (may be NULL) is then called
+// with received values strings (NULL for
+// fields which weren't received).
+//--------------------------------------------
+JSONDataInput* SubscribeTypedJSONDataInput(char* name, const char* keys[], uint32_t dataCount, const JSONInputBinding bindings[], bool atomic, DataValuesSetAccessor dataAccessor);
+
 //--------------------------------------------
 // Unsubscribe JSON data input:
 // Unsubscribes given data input.
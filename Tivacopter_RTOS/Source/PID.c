@@ -26,14 +26,16 @@
 #include "PinMap.h"
 #include "JSONCommunication.h"
 #include "Utils/utils.h"
+#include "Utils/quaternions.h"
+#include "Utils/PIDEngine.h"
+#include "Utils/Mixer.h"
+#include "Utils/ThrustLUT.h"
+#include "Utils/RelayTuner.h"
+#include "Utils/SetpointShaper.h"
+#include "Settings.h"
 #include "IMU.h"
 #include "PID.h"
 
-//----------------------------------------
-// IMU data structure from 'IMU.h'
-//----------------------------------------
-extern InertialMeasurementUnit IMU;
-
 //----------------------------------------
 // UART console from 'main.c'
 //----------------------------------------
@@ -44,27 +46,221 @@ extern UARTConsole Console;
 //----------------------------------------
 extern void beep(bool state);
 
+//----------------------------------------
+// Battery voltage sag compensation from
+// 'main.c'
+//----------------------------------------
+extern float GetBatteryThrustScale(void);
+
+//----------------------------------------
+// Topic notify callback from 'main.c'
+//----------------------------------------
+extern void TopicNotifySemaphore(uintptr_t semaphore);
+
 //----------------------------------------
 // Motor data structures
 //----------------------------------------
-static Motor Motors[4];
+static Motor Motors[MOTOR_COUNT];
+static const MixerFrame* const Frame = &MIXER_FRAME;
+
+//----------------------------------------
+// ESCs PWM outputs
+//----------------------------------------
+static const struct { uint32_t base; uint32_t timer; } MotorsPWM[MOTOR_COUNT] =
+{
+	{ TIMER2_BASE, TIMER_A }, { TIMER2_BASE, TIMER_B }, { TIMER3_BASE, TIMER_A }, { TIMER3_BASE, TIMER_B }
+};
+
+//----------------------------------------
+// Motors thrust linearization tables:
+// Mixer gives motors thrusts which are
+// converted to ESCs commands. Tables are
+// initialized from quadratic thrust model
+// and motors start commands and can be
+// replaced by bench calibration (see
+// 'motorTest', 'motorThrust' and
+// 'motorCalibrate' commands).
+//----------------------------------------
+static ThrustLUT MotorsLUT[MOTOR_COUNT];
+static const float MotorsStartCommand[MOTOR_COUNT] = { MOTOR1_POWER_OFFSET, MOTOR2_POWER_OFFSET, MOTOR3_POWER_OFFSET, MOTOR4_POWER_OFFSET };
+
+//----------------------------------------
+// Motors bench calibration state:
+// 'running' is true while 'motor' is
+// driven at 'command' (motors must be shut
+// off) and 'points' are thrusts measured
+// on this motor.
+//----------------------------------------
+#define MOTOR_CALIBRATION_MAX_POINTS	16
+
+static struct
+{
+	uint32_t motor;
+	volatile float command;
+	volatile bool running;
+	uint32_t pointCount;
+	ThrustCalibrationPoint points[MOTOR_CALIBRATION_MAX_POINTS];
+} MotorCalibration;
 static QuadControl TivacopterControl = {.RadioControlEnabled = true, .AltitudeStabilizationEnabled = true};
 
+//----------------------------------------
+// Pilot targets and setpoints shaping:
+// Remote control and radio inputs are
+// written to pilot targets rather than to
+// 'TivacopterControl'. Each new remote
+// control target is linearly interpolated
+// over the (filtered) interval between
+// remote control packets, then shaped at
+// control loop rate by a critically damped
+// second-order filter with rate,
+// acceleration and jerk limits, so that
+// sparse and jittery packets don't give
+// setpoint steps to PIDs. Directions go
+// through an expo curve of factor
+// DIRECTION_EXPO. Packets intervals are
+// bounded to SETPOINT_MAX_INTERVAL seconds.
+//----------------------------------------
+#define DIRECTION_EXPO				0.3f
+#define SETPOINT_MAX_INTERVAL		0.25f
+#define SETPOINT_INTERVAL_FILTER	0.25f
+
+typedef struct
+{
+	float Throttle;
+	float Direction[2];
+	float Yaw;
+} PilotTargets;
+
+static PilotTargets RemoteControlTargets;
+static volatile uint32_t RemoteControlSequence = 0;
+static PilotTargets RadioTargets;
+
+static struct
+{
+	uint32_t sequence;
+	uint32_t cycles;
+	float interval;
+} RemoteControlTiming = { .interval = SETPOINT_MAX_INTERVAL };
+
+static SetpointShaper ThrottleShaper =		{ .frequency = 3.0f,	.maxRate = 1.5f,	.maxAccel = 15.0f,	.maxJerk = 300.0f };
+static SetpointShaper DirectionShapers[2] =	{	{ .frequency = 5.0f,	.maxRate = 4.0f,	.maxAccel = 60.0f,	.maxJerk = 1500.0f,	.expo = DIRECTION_EXPO },
+												{ .frequency = 5.0f,	.maxRate = 4.0f,	.maxAccel = 60.0f,	.maxJerk = 1500.0f,	.expo = DIRECTION_EXPO } };
+static SetpointShaper YawShaper =			{ .frequency = 3.0f,	.maxRate = PI,		.maxAccel = 20.0f,	.maxJerk = 400.0f,	.wrap = 2.0f*PI };
+
 //----------------------------------------
 // PID data structures
+// Angle PIDs (outer loop) give rate
+// setpoints (rad/s) to rate PIDs (inner
+// loop) which give motors corrections.
+// Rate PIDs integral terms track motors
+// mixer saturation (back-calculation) and
+// their derivative terms are filtered at
+// 'RATE_PID_D_CUTOFF' Hz.
 // TODO: determine PIDs gains
 //----------------------------------------
-static PID YawPID =		{ .Kp = 0.035,	.Ki = 0.035,	.Kd = 0.0,		.ILimit = 0.30};
-static PID PitchPID =	{ .Kp = 0.16,	.Ki = 0.48,		.Kd = 0.0004,	.ILimit = 1.20};//{ .Kp = 0.04,	.Ki = 0.12,		.Kd = 0.0001,	.ILimit = 0.30};
-static PID RollPID =	{ .Kp = 0.16,	.Ki = 0.48,		.Kd = 0.0004,	.ILimit = 1.20};//{ .Kp = 0.04,	.Ki = 0.12,		.Kd = 0.0001,	.ILimit = 0.30};
-static PID AltitudePID ={ .Kp = 0.035,	.Ki = 0.035,	.Kd = 0.0,		.ILimit = 0.3};
+#define RATE_PID_D_CUTOFF		40.0f
+
+//----------------------------------------
+// Rate PIDs gain schedules (only used if
+// RATE_PID_SCHEDULING is enabled):
+// Rate PIDs gains are scaled depending on
+// collective throttle, with factors of 1 at
+// hover throttle (0.4). Factors are all 1
+// until measured on the quadcopter held on
+// a gimbal: at each point throttle, run
+// 'autotune roll' (or 'autotune yaw') and
+// set factors to the ratio of printed Ku
+// over hover Ku. As autotune saves tuned
+// angle PID, restore hover gains
+// ('setRollPID', 'setYawPID') afterwards.
+//----------------------------------------
+#if RATE_PID_SCHEDULING
+static const PIDSchedule RollPitchRateSchedule =
+{
+	.count = 5,
+	.points = {	{ .input = 0.0f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f },
+				{ .input = 0.2f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f },
+				{ .input = 0.4f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f },
+				{ .input = 0.55f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f },
+				{ .input = 0.7f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f } }
+};
+
+static const PIDSchedule YawRateSchedule =
+{
+	.count = 3,
+	.points = {	{ .input = 0.0f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f },
+				{ .input = 0.4f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f },
+				{ .input = 0.7f,	.Kp = 1.00f,	.Ki = 1.00f,	.Kd = 1.00f } }
+};
 
-//-----------------------------------------
-// String pointer array for PID data source
-//-----------------------------------------
-char* PIDStrPtrs[12] =  {	Motors[0].strPower, Motors[1].strPower, Motors[2].strPower, Motors[3].strPower,
-							YawPID.strIn, PitchPID.strIn, RollPID.strIn, AltitudePID.strIn,
-							YawPID.strOut, PitchPID.strOut, RollPID.strOut, AltitudePID.strOut	};
+#define YAW_RATE_SCHEDULE			&YawRateSchedule
+#define ROLL_PITCH_RATE_SCHEDULE	&RollPitchRateSchedule
+#else
+#define YAW_RATE_SCHEDULE			NULL
+#define ROLL_PITCH_RATE_SCHEDULE	NULL
+#endif
+
+static PID YawPID =		{ .Kp = 2.0,	.Ki = 0.0,		.Kd = 0.0,		.b = 1.0,	.ILimit = 0.50};
+static PID PitchPID =	{ .Kp = 4.0,	.Ki = 0.0,		.Kd = 0.0,		.b = 1.0,	.ILimit = 0.50};
+static PID RollPID =	{ .Kp = 4.0,	.Ki = 0.0,		.Kd = 0.0,		.b = 1.0,	.ILimit = 0.50};
+static PID AltitudePID ={ .Kp = 0.035,	.Ki = 0.035,	.Kd = 0.0,		.b = 1.0,	.ILimit = 0.3};
+static PID YawRatePID =		{ .Kp = 0.035,	.Ki = 0.035,	.Kd = 0.0,		.b = 1.0,	.Kt = 1.0,	.DCutoff = RATE_PID_D_CUTOFF,	.ILimit = 0.30,	.schedule = YAW_RATE_SCHEDULE};
+static PID PitchRatePID =	{ .Kp = 0.04,	.Ki = 0.12,		.Kd = 0.0004,	.b = 1.0,	.Kt = 3.0,	.DCutoff = RATE_PID_D_CUTOFF,	.ILimit = 0.30,	.schedule = ROLL_PITCH_RATE_SCHEDULE};
+static PID RollRatePID =	{ .Kp = 0.04,	.Ki = 0.12,		.Kd = 0.0004,	.b = 1.0,	.Kt = 3.0,	.DCutoff = RATE_PID_D_CUTOFF,	.ILimit = 0.30,	.schedule = ROLL_PITCH_RATE_SCHEDULE};
+
+//----------------------------------------
+// Controller topic published by PID task
+//----------------------------------------
+TOPIC_DEFINE(ControllerTopic, ControllerState, 4);
+
+//----------------------------------------
+// Get controller state
+//----------------------------------------
+uint32_t GetControllerState(ControllerState* state)
+{
+	return TopicReadLatest(&ControllerTopic, state, NULL);
+}
+
+//----------------------------------------
+// Persistent controller settings:
+// PIDs gains and motors thrust tables
+// stored in EEPROM (see 'saveSettings'
+// command and PIDs autotuning).
+//----------------------------------------
+#define SETTINGS_PID_COUNT		7
+
+static PID* const SettingsPIDs[SETTINGS_PID_COUNT] = { &YawPID, &PitchPID, &RollPID, &AltitudePID, &YawRatePID, &PitchRatePID, &RollRatePID };
+
+typedef struct
+{
+	struct { float Kp, Ki, Kd, ILimit; } PIDs[SETTINGS_PID_COUNT];
+	ThrustLUT motors[MOTOR_COUNT];
+} ControllerSettings;
+
+//----------------------------------------
+// PIDs autotuning:
+// Relay oscillation (rate setpoint of
+// +/- AUTOTUNE_AMPLITUDE rad/s) replaces
+// tuned angle PID output until ultimate
+// gain and period are measured. Tuning
+// fails if angle error exceeds
+// AUTOTUNE_MAX_ERROR rad or if it lasts
+// more than AUTOTUNE_TIMEOUT seconds.
+//----------------------------------------
+#define AUTOTUNE_AMPLITUDE		2.0f
+#define AUTOTUNE_HYSTERESIS		0.005f
+#define AUTOTUNE_MAX_ERROR		0.5f
+#define AUTOTUNE_TIMEOUT		20.0f
+
+static struct
+{
+	PID* volatile pid;
+	PID* target;
+	PID* ratePID;
+	const char* axis;
+	RelayTunerRule rule;
+	RelayTuner tuner;
+} Autotune;
 
 //----------------------------------------
 // Data received from radio
@@ -73,12 +269,32 @@ static const char* RadioPropertiesNames[5] = { "in0", "in1", "in2", "in3", "in4"
 char* RadioIn[5] = { "0", "0", "0", "0", "0" };
 static bool RadioInputUpdatedFlag = false;
 
+//----------------------------------------
+// PID datasource and remote control data
+// input keys and units: allocated here
+// rather than in 'ControllerInit' because
+// JSON datasources and datainputs keep
+// these pointers (controller stays
+// subscribed once 'ControllerInit' returns)
+//----------------------------------------
+static const char* PIDPropertiesNames[12] = {	"motor1", "motor2", "motor3", "motor4",
+												"YawIn", "PitchIn", "RollIn", "AltitudeIn",
+												"YawOut", "PitchOut", "RollOut", "AltitudeOut"	};
+static const char* PIDPropertiesUnits[12] = {	"", "", "", "",
+												"rad", "rad", "rad", "",
+												"", "", "", ""	};
+static const char* RemoteControlKeys[6] = { "throttle", "directionX", "directionY", "yaw", "beep", "shutOffMotors" };
+
 //------------------------------------------
 // Static function forward declarations
 //------------------------------------------
-static inline void ProcessPID(PID* pid);
+static void SetMotorCommand(uint32_t motor, float command);
 static void TurnOffMotors(void);
 static void MapRadioInputToQuadcopterControl(void);
+static void ShapeSetpoints(void);
+static void DisarmController(void);
+static void PublishControllerState(void);
+static void SaveControllerSettings(void);
 
 //----------------------------------------
 // GPIO Port E Hardware Interrupt (radio)
@@ -101,144 +317,324 @@ void GPIOPEHwiHandler(void)
 }
 
 //----------------------------------------
-// Radio data accessor:
-// Accessor used by bluetooth to get data
-// from Radio data source.
+// Sample radio data:
+// Gives current radio inputs to radio
+// on-change data source.
 //----------------------------------------
-char** RadioDataAccessor(void)
+static void SampleRadioData(JSONDataSource* Radio_ds)
 {
-	return (char**)RadioIn;
+	float values[5];
+	uint32_t i;
+
+	for(i = 0; i < 5; ++i)
+		values[i] = RadioIn[i][0] == '1' ? 1.0f : 0.0f;
+
+	SampleJSONData(Radio_ds, values);
 }
 
 //----------------------------------------
-// PID data accessor:
-// Accessor used by bluetooth to get data
-// from PID data source.
-//----------------------------------------
-char** PIDDataAccessor(void)
-{
-	// Clear strings
-	memset(YawPID.strOut, '\0', sizeof(YawPID.strOut));
-	memset(PitchPID.strOut, '\0', sizeof(PitchPID.strOut));
-	memset(RollPID.strOut, '\0', sizeof(RollPID.strOut));
-	memset(AltitudePID.strOut, '\0', sizeof(AltitudePID.strOut));
-	memset(YawPID.strIn, '\0', sizeof(YawPID.strIn));
-	memset(PitchPID.strIn, '\0', sizeof(PitchPID.strIn));
-	memset(RollPID.strIn, '\0', sizeof(RollPID.strIn));
-	memset(AltitudePID.strIn, '\0', sizeof(AltitudePID.strIn));
-	memset(Motors[0].strPower, '\0', sizeof(Motors[0].strPower));
-	memset(Motors[1].strPower, '\0', sizeof(Motors[1].strPower));
-	memset(Motors[2].strPower, '\0', sizeof(Motors[2].strPower));
-	memset(Motors[3].strPower, '\0', sizeof(Motors[3].strPower));
-
-	// Convert float values to strings
-	ftoa(Motors[0].power, 	PIDStrPtrs[0], 4);
-	ftoa(Motors[1].power, 	PIDStrPtrs[1], 4);
-	ftoa(Motors[2].power, 	PIDStrPtrs[2], 4);
-	ftoa(Motors[3].power, 	PIDStrPtrs[3], 4);
-	ftoa(YawPID.in, 		PIDStrPtrs[4], 4);
-	ftoa(PitchPID.in, 		PIDStrPtrs[5], 4);
-	ftoa(RollPID.in, 		PIDStrPtrs[6], 4);
-	ftoa(AltitudePID.in, 	PIDStrPtrs[7], 4);
-	ftoa(YawPID.out, 		PIDStrPtrs[8], 4);
-	ftoa(PitchPID.out, 		PIDStrPtrs[9], 4);
-	ftoa(RollPID.out, 		PIDStrPtrs[10], 4);
-	ftoa(AltitudePID.out, 	PIDStrPtrs[11], 4);
-
-	return (char**)PIDStrPtrs;
+// Sample PID data:
+// Gives motors commands and PIDs inputs
+// and outputs to PID decimated data
+// source.
+//----------------------------------------
+static void SamplePIDData(JSONDataSource* PID_ds)
+{
+	const float values[12] = {	Motors[0].power, Motors[1].power, Motors[2].power, Motors[3].power,
+								YawPID.in, PitchPID.in, RollPID.in, AltitudePID.in,
+								YawPID.out, PitchPID.out, RollPID.out, AltitudePID.out	};
+
+	SampleJSONData(PID_ds, values);
 }
 
+//----------------------------------------
+// Remote control data input bindings:
+// Received remote control values are
+// validated and written all at once to
+// remote control targets (setpoints are
+// shaped by controller) and
+// 'TivacopterControl' flags.
+//----------------------------------------
+static const JSONInputBinding RemoteControlBindings[6] =
+{
+	{ .type = JSON_INPUT_FLOAT,	.target = &RemoteControlTargets.Throttle,		.min = 0.0f,	.max = 1.0f,	.defaultValue = 0.0f },
+	{ .type = JSON_INPUT_FLOAT,	.target = &RemoteControlTargets.Direction[x],	.min = -1.0f,	.max = 1.0f,	.defaultValue = 0.0f },
+	{ .type = JSON_INPUT_FLOAT,	.target = &RemoteControlTargets.Direction[y],	.min = -1.0f,	.max = 1.0f,	.defaultValue = 0.0f },
+	{ .type = JSON_INPUT_FLOAT,	.target = &RemoteControlTargets.Yaw,			.min = -PI,		.max = PI,		.defaultValue = 0.0f },
+	{ .type = JSON_INPUT_BOOL,	.target = &TivacopterControl.Beep,			.defaultValue = 0.0f },
+	{ .type = JSON_INPUT_BOOL,	.target = &TivacopterControl.ShutOffMotors,	.defaultValue = 0.0f }
+};
+
 //----------------------------------------
 // Remote control data set accessor:
-// Accessor used by bluetooth to set data
-// from remote control data input.
+// Called once remote control data input
+// values have been written.
 //----------------------------------------
 void RemoteControlDataAccessor(char** RemoteCtrlKeys)
 {
-	TivacopterControl.Throttle = atof(RemoteCtrlKeys[0]);
-	U_SAT(TivacopterControl.Throttle, 1.0f);
+	// Tells controller that new targets have been received
+	++RemoteControlSequence;
+	beep(TivacopterControl.Beep);
+}
 
-	TivacopterControl.Direction[x] = atof(RemoteCtrlKeys[1]);
-	U_SAT(TivacopterControl.Direction[x], 1.0f);
+//------------------------------------------
+// Set PID coefficients:
+// Sets kp, ki, kd (and optional ILimit)
+// coefficients of given PID from command
+// arguments.
+//------------------------------------------
+static void SetPIDCoefficients(PID* pid, int argc, char *argv[])
+{
+	if(checkArgRange(&Console, argc, 4, 5))
+	{
+		pid->Kp = 	atof(argv[1]);
+		pid->Ki = 	atof(argv[2]);
+		pid->Kd = 	atof(argv[3]);
+		if(argc == 5)
+			pid->ILimit = atof(argv[4]);
+	}
+}
 
-	TivacopterControl.Direction[y] = atof(RemoteCtrlKeys[2]);
-	U_SAT(TivacopterControl.Direction[y], 1.0f);
+//------------------------------------------
+// Set kp, ki and kd coeficients of angle,
+// rate and altitude PIDs
+//------------------------------------------
+void SetYawPID_cmd(int argc, char *argv[])			{ SetPIDCoefficients(&YawPID, argc, argv); }
+void SetPitchPID_cmd(int argc, char *argv[])		{ SetPIDCoefficients(&PitchPID, argc, argv); }
+void SetRollPID_cmd(int argc, char *argv[])			{ SetPIDCoefficients(&RollPID, argc, argv); }
+void SetAltitudePID_cmd(int argc, char *argv[])		{ SetPIDCoefficients(&AltitudePID, argc, argv); }
+void SetYawRatePID_cmd(int argc, char *argv[])		{ SetPIDCoefficients(&YawRatePID, argc, argv); }
+void SetPitchRatePID_cmd(int argc, char *argv[])	{ SetPIDCoefficients(&PitchRatePID, argc, argv); }
+void SetRollRatePID_cmd(int argc, char *argv[])		{ SetPIDCoefficients(&RollRatePID, argc, argv); }
 
-	TivacopterControl.Yaw = atof(RemoteCtrlKeys[3]);
-	U_SAT(TivacopterControl.Yaw, PI);
+//------------------------------------------
+// Motor test:
+// Drives given motor (1 to 4) at given
+// command (0 to 1) while motors are shut
+// off, or stops it if no argument is
+// given. Changing motor clears measured
+// thrusts.
+//------------------------------------------
+void MotorTest_cmd(int argc, char *argv[])
+{
+	if(argc == 1)
+	{
+		MotorCalibration.running = false;
+		TurnOffMotors();
+		return;
+	}
 
-	TivacopterControl.Beep = ('1' == RemoteCtrlKeys[4][0]);
-	beep(TivacopterControl.Beep);
+	if(!checkArgCount(&Console, argc, 3))
+		return;
+
+	if(!TivacopterControl.ShutOffMotors)
+	{
+		UARTwrite(&Console, "Motors must be shut off first.", 30);
+		return;
+	}
+
+	int32_t motor = atoi(argv[1]) - 1;
+	float command = atof(argv[2]);
+	if(motor < 0 || motor >= MOTOR_COUNT || command < 0.0f || command > 1.0f)
+	{
+		UARTwrite(&Console, "Invalid motor or command.", 25);
+		return;
+	}
 
-	TivacopterControl.ShutOffMotors =  ('1' == RemoteCtrlKeys[5][0]);
+	if(motor != MotorCalibration.motor)
+		MotorCalibration.pointCount = 0;
+
+	MotorCalibration.motor = motor;
+	MotorCalibration.command = command;
+	MotorCalibration.running = true;
+	TurnOffMotors();
+	SetMotorCommand(motor, command);
 }
 
 //------------------------------------------
-// Set kp, ki and kd coeficients of Yaw PID
+// Motor thrust:
+// Records thrust measured on bench (e.g.
+// in grams) at tested motor's command.
 //------------------------------------------
-void SetYawPID_cmd(int argc, char *argv[])
+void MotorThrust_cmd(int argc, char *argv[])
 {
-	if(checkArgRange(&Console, argc, 4, 5))
+	if(!checkArgCount(&Console, argc, 2))
+		return;
+
+	if(!MotorCalibration.running)
 	{
-		YawPID.Kp = 	atoi(argv[1]);
-		YawPID.Ki = 	atoi(argv[2]);
-		YawPID.Kd = 	atoi(argv[3]);
-		if(argc == 5)
-			YawPID.ILimit = atoi(argv[4]);
+		UARTwrite(&Console, "No motor is tested (see 'motorTest').", 37);
+		return;
+	}
+	if(MotorCalibration.pointCount >= MOTOR_CALIBRATION_MAX_POINTS)
+	{
+		UARTwrite(&Console, "Too many thrust measures.", 25);
+		return;
 	}
+
+	ThrustCalibrationPoint* point = &MotorCalibration.points[MotorCalibration.pointCount++];
+	point->command = MotorCalibration.command;
+	point->thrust = atof(argv[1]);
+	UARTprintf(&Console, "Motor %u: %u thrust measures.", MotorCalibration.motor + 1, MotorCalibration.pointCount);
 }
 
-//-------------------------------------------
-// Set kp, ki and kd coeficients of Pitch PID
-//-------------------------------------------
-void SetPitchPID_cmd(int argc, char *argv[])
+//------------------------------------------
+// Motor calibrate:
+// Replaces tested motor's thrust table by
+// the one built from measured thrusts
+// (optional argument is the thrust
+// corresponding to full thrust of all
+// motors, e.g. weakest motor full thrust)
+// and prints it. Motors must be shut off:
+// rate stage never reads a partially
+// copied table.
+//------------------------------------------
+void MotorCalibrate_cmd(int argc, char *argv[])
 {
-	if(checkArgRange(&Console, argc, 4, 5))
+	ThrustLUT lut;
+	uint32_t i;
+
+	if(!checkArgRange(&Console, argc, 1, 2))
+		return;
+
+	if(!TivacopterControl.ShutOffMotors)
 	{
-		PitchPID.Kp = 		atoi(argv[1]);
-		PitchPID.Ki = 		atoi(argv[2]);
-		PitchPID.Kd = 		atoi(argv[3]);
-		if(argc == 5)
-			PitchPID.ILimit = 	atoi(argv[4]);
+		UARTwrite(&Console, "Motors must be shut off first.", 30);
+		return;
+	}
+
+	if(!ThrustLUTFromCalibration(&lut, MotorCalibration.points, MotorCalibration.pointCount, argc == 2 ? atof(argv[1]) : 0.0f))
+	{
+		UARTwrite(&Console, "Thrust measures must be given from motor start command with increasing commands and thrusts.", 92);
+		return;
 	}
+
+	MotorsLUT[MotorCalibration.motor] = lut;
+
+	UARTprintf(&Console, "Motor %u thrust table:", MotorCalibration.motor + 1);
+	for(i = 0; i < THRUST_LUT_SIZE; ++i)
+		UARTprintf(&Console, " %.4f", lut.command[i]);
 }
 
 //------------------------------------------
-// Set kp, ki and kd coeficients of Roll PID
+// Save settings:
+// Saves PIDs gains and motors thrust
+// tables to EEPROM.
 //------------------------------------------
-void SetRollPID_cmd(int argc, char *argv[])
+void SaveSettings_cmd(int argc, char *argv[])
 {
-	if(checkArgRange(&Console, argc, 4, 5))
+	SaveControllerSettings();
+	UARTwrite(&Console, "Settings will be saved.", 23);
+}
+
+//------------------------------------------
+// Autotune:
+// Starts angle PID autotuning of given
+// axis ("roll", "pitch" or "yaw") with
+// optional relay amplitude (rad/s) and
+// tuning rule ("pid" or "pi"). "stop"
+// aborts autotuning and no argument
+// prints autotuning state.
+//------------------------------------------
+void Autotune_cmd(int argc, char *argv[])
+{
+	static const char* StatesNames[] = { "idle", "running", "done", "failed" };
+	PID* pid;
+	PID* ratePID;
+
+	if(argc == 1)
 	{
-		RollPID.Kp = 		atoi(argv[1]);
-		RollPID.Ki =		atoi(argv[2]);
-		RollPID.Kd =		atoi(argv[3]);
-		if(argc == 5)
-			RollPID.ILimit =	atoi(argv[4]);
+		UARTprintf(&Console, "Autotune %s: %s", Autotune.axis != NULL ? Autotune.axis : "-", StatesNames[Autotune.tuner.state]);
+		if(Autotune.tuner.state == RELAY_TUNER_DONE && Autotune.pid == NULL)
+			UARTprintf(&Console, " (Ku=%.4f Tu=%.4fs, kp=%.4f ki=%.4f kd=%.4f)", Autotune.tuner.Ku, Autotune.tuner.Tu,
+						Autotune.target->Kp, Autotune.target->Ki, Autotune.target->Kd);
+		return;
+	}
+
+	if(!checkArgRange(&Console, argc, 2, 4))
+		return;
+
+	if(strcmp(argv[1], "stop") == 0)
+	{
+		Autotune.pid = NULL;
+		if(Autotune.tuner.state == RELAY_TUNER_RUNNING)
+			Autotune.tuner.state = RELAY_TUNER_FAILED;
+		return;
+	}
+
+	if(Autotune.pid != NULL)
+	{
+		UARTwrite(&Console, "Autotuning is already running.", 30);
+		return;
+	}
+
+	// Relay oscillation needs motors thrust: tuning against stopped motors would only time out (or hit error bound)
+	if(TivacopterControl.ShutOffMotors)
+	{
+		UARTwrite(&Console, "Motors are shut off, turn them on before autotuning.", 52);
+		return;
+	}
+
+	if(strcmp(argv[1], "roll") == 0)
+	{
+		pid = &RollPID;
+		ratePID = &RollRatePID;
+	}
+	else if(strcmp(argv[1], "pitch") == 0)
+	{
+		pid = &PitchPID;
+		ratePID = &PitchRatePID;
+	}
+	else if(strcmp(argv[1], "yaw") == 0 && TivacopterControl.YawRegulationEnabled)
+	{
+		pid = &YawPID;
+		ratePID = &YawRatePID;
 	}
+	else
+	{
+		UARTwrite(&Console, "Unknown axis (or yaw isn't regulated).", 38);
+		return;
+	}
+
+	// Tuned PID is given last so that controller doesn't run a partially configured tuner
+	Autotune.axis = argv[1][0] == 'r' ? "roll" : argv[1][0] == 'p' ? "pitch" : "yaw";
+	Autotune.target = pid;
+	Autotune.ratePID = ratePID;
+	Autotune.rule = argc == 4 && strcmp(argv[3], "pi") == 0 ? RELAY_TUNER_RULE_PI : RELAY_TUNER_RULE_PID;
+	RelayTunerStart(&Autotune.tuner, argc >= 3 ? atof(argv[2]) : AUTOTUNE_AMPLITUDE, AUTOTUNE_HYSTERESIS, AUTOTUNE_MAX_ERROR, AUTOTUNE_TIMEOUT);
+	Autotune.pid = pid;
 }
 
 //------------------------------------------
-// Set kp, ki and kd coeficients of Altitude
-// PID.
+// Print state:
+// Prints last published estimator and
+// controller states.
 //------------------------------------------
-void SetAltitudePID_cmd(int argc, char *argv[])
+void PrintState_cmd(int argc, char *argv[])
 {
-	if(checkArgRange(&Console, argc, 4, 5))
+	IMUState attitude;
+	ControllerState controller;
+	float yaw, pitch, roll;
+	uint32_t IMUVersion = GetIMUState(&attitude);
+	uint32_t controllerVersion = GetControllerState(&controller);
+
+	if(IMUVersion == 0 || controllerVersion == 0)
 	{
-		AltitudePID.Kp = 		atoi(argv[1]);
-		AltitudePID.Ki = 		atoi(argv[2]);
-		AltitudePID.Kd = 		atoi(argv[3]);
-		if(argc == 5)
-			AltitudePID.ILimit =	atoi(argv[4]);
+		UARTwrite(&Console, "No state published yet.", 23);
+		return;
 	}
+
+	QuaternionToEuler(attitude.q, &roll, &pitch, &yaw);
+	UARTprintf(&Console, "IMU (#%u): yaw=%.4f pitch=%.4f roll=%.4f rad\n", IMUVersion, yaw, pitch, roll);
+	UARTprintf(&Console, "PID (#%u): throttle=%.3f motors=%.3f %.3f %.3f %.3f", controllerVersion, controller.throttle,
+				controller.motors[0], controller.motors[1], controller.motors[2], controller.motors[3]);
 }
 
 static void CheckSuccess(bool success)
 {
 	if(!success)
 	{
-		Log_error0("Error (re)allocating memory for UART console Warper commands.");
+		Log_error0("Error: UART console command table is full (PID commands).");
 		ASSERT(FALSE);
 	}
 }
@@ -250,17 +646,160 @@ static void CheckSuccess(bool success)
 //----------------------------------------
 void SubscribePIDsCmds(void)
 {
-	CheckSuccess(SubscribeCmd(&Console, "setYawPID", 		SetYawPID_cmd, 		"Sets Yaw PID coefficients. e.g. \"setYawPID 0.03 0.04 0 0.2\" for kp = 0.03, ki = 0.04, kd = 0.0 ands ILimit = 0.2 (ILimit is optionnal)"));
-	CheckSuccess(SubscribeCmd(&Console, "setPitchPID", 		SetPitchPID_cmd, 	"Sets Pitch PID coefficients."));
-	CheckSuccess(SubscribeCmd(&Console, "setRollPID", 		SetRollPID_cmd, 	"Sets Roll PID coefficients."));
+	CheckSuccess(SubscribeCmd(&Console, "setYawPID", 		SetYawPID_cmd, 		"Sets Yaw angle PID coefficients. e.g. \"setYawPID 2.0 0.1 0 0.5\" for kp = 2.0, ki = 0.1, kd = 0.0 ands ILimit = 0.5 (ILimit is optionnal)"));
+	CheckSuccess(SubscribeCmd(&Console, "setPitchPID", 		SetPitchPID_cmd, 	"Sets Pitch angle PID coefficients."));
+	CheckSuccess(SubscribeCmd(&Console, "setRollPID", 		SetRollPID_cmd, 	"Sets Roll angle PID coefficients."));
 	CheckSuccess(SubscribeCmd(&Console, "setAltitudePID", 	SetAltitudePID_cmd, "Sets Altitude PID coefficients."));
+	CheckSuccess(SubscribeCmd(&Console, "setYawRatePID", 	SetYawRatePID_cmd, 	"Sets Yaw rate PID coefficients."));
+	CheckSuccess(SubscribeCmd(&Console, "setPitchRatePID", 	SetPitchRatePID_cmd, "Sets Pitch rate PID coefficients."));
+	CheckSuccess(SubscribeCmd(&Console, "setRollRatePID", 	SetRollRatePID_cmd, "Sets Roll rate PID coefficients."));
+	CheckSuccess(SubscribeCmd(&Console, "printState", 		PrintState_cmd, 	"Prints last attitude estimation and motors commands."));
+	CheckSuccess(SubscribeCmd(&Console, "motorTest", 		MotorTest_cmd, 		"Drives a motor on bench while motors are shut off. e.g. \"motorTest 2 0.4\" drives motor 2 at 40% command, \"motorTest\" stops it."));
+	CheckSuccess(SubscribeCmd(&Console, "motorThrust", 		MotorThrust_cmd, 	"Records thrust measured on bench at tested motor command. e.g. \"motorThrust 312\"."));
+	CheckSuccess(SubscribeCmd(&Console, "motorCalibrate", 	MotorCalibrate_cmd, "Builds tested motor thrust table from recorded thrusts. e.g. \"motorCalibrate 850\" if 850 is the weakest motor full thrust (optionnal)."));
+	CheckSuccess(SubscribeCmd(&Console, "saveSettings", 	SaveSettings_cmd, 	"Saves PIDs coefficients and motors thrust tables to EEPROM."));
+	CheckSuccess(SubscribeCmd(&Console, "autotune", 		Autotune_cmd, 		"Tunes an angle PID with relay oscillation, applies and saves its coefficients. e.g. \"autotune roll 2.0 pid\" (relay amplitude in rad/s and rule \"pid\" or \"pi\" are optionnal), \"autotune stop\" aborts and \"autotune\" prints state."));
 }
 
 //----------------------------------------
-// PID task
+// Controller JSON datasources and
+// datainput (subscribed by
+// 'ControllerInit').
 //----------------------------------------
-void PIDTask(void)
+static JSONDataSource* PID_ds;
+static JSONDataSource* Radio_ds;
+static JSONDataInput* RemoteControl_di;
+static volatile bool ControllerReady = false;
+
+//----------------------------------------
+// Attitude setpoint quaternions computed
+// from angle PIDs inputs (see
+// 'UpdateAttitudeSetpoint').
+//----------------------------------------
+static struct
+{
+	float roll, pitch, yaw;
+	float qTilt[4];
+	float qYaw[4];
+	bool valid;
+} AttitudeSetpoint;
+
+//----------------------------------------
+// Update attitude setpoint:
+// Recomputes tilt (pitch and roll) and yaw
+// setpoint quaternions if angle PIDs
+// inputs changed.
+//----------------------------------------
+static void UpdateAttitudeSetpoint(void)
+{
+	if(AttitudeSetpoint.valid && AttitudeSetpoint.roll == RollPID.in && AttitudeSetpoint.pitch == PitchPID.in && AttitudeSetpoint.yaw == YawPID.in)
+		return;
+
+	AttitudeSetpoint.roll = RollPID.in;
+	AttitudeSetpoint.pitch = PitchPID.in;
+	AttitudeSetpoint.yaw = YawPID.in;
+	QuaternionFromEulerZYX(AttitudeSetpoint.qTilt, RollPID.in, PitchPID.in, 0.0f);
+	QuaternionFromEulerZYX(AttitudeSetpoint.qYaw, 0.0f, 0.0f, YawPID.in);
+	AttitudeSetpoint.valid = true;
+}
+
+//----------------------------------------
+// Save controller settings:
+// Gives PIDs gains and motors thrust
+// tables to settings task.
+//----------------------------------------
+static void SaveControllerSettings(void)
+{
+	static ControllerSettings settings;
+	uint32_t i;
+
+	for(i = 0; i < SETTINGS_PID_COUNT; ++i)
+	{
+		settings.PIDs[i].Kp = SettingsPIDs[i]->Kp;
+		settings.PIDs[i].Ki = SettingsPIDs[i]->Ki;
+		settings.PIDs[i].Kd = SettingsPIDs[i]->Kd;
+		settings.PIDs[i].ILimit = SettingsPIDs[i]->ILimit;
+	}
+	memcpy(settings.motors, MotorsLUT, sizeof(settings.motors));
+
+	if(!WriteSettings(&settings, sizeof(settings)))
+		Log_error0("Controller settings can't be saved.");
+}
+
+//----------------------------------------
+// Load controller settings:
+// Overrides default PIDs gains and motors
+// thrust tables with stored ones if any.
+//----------------------------------------
+static void LoadControllerSettings(void)
+{
+	static ControllerSettings settings;
+	uint32_t i;
+
+	if(!ReadSettings(&settings, sizeof(settings)))
+	{
+		Log_info0("No controller settings stored: using default PIDs coefficients and motors thrust tables.");
+		return;
+	}
+
+	for(i = 0; i < SETTINGS_PID_COUNT; ++i)
+	{
+		SettingsPIDs[i]->Kp = settings.PIDs[i].Kp;
+		SettingsPIDs[i]->Ki = settings.PIDs[i].Ki;
+		SettingsPIDs[i]->Kd = settings.PIDs[i].Kd;
+		SettingsPIDs[i]->ILimit = settings.PIDs[i].ILimit;
+	}
+	memcpy(MotorsLUT, settings.motors, sizeof(MotorsLUT));
+}
+
+//----------------------------------------
+// Run autotune:
+// Replaces tuned angle PID's rate setpoint
+// by relay output. Once ultimate gain and
+// period are measured, new gains are
+// applied from controller thread (tuned
+// PID is never used with partially updated
+// gains) and saved. Autotuning fails if
+// motors are shut off while it runs (see
+// 'DisarmController').
+//----------------------------------------
+static void RunAutotune(void)
+{
+	PID* pid = Autotune.pid;
+	float Kp, Ki, Kd;
+
+	if(pid == NULL)
+		return;
+
+	Autotune.ratePID->in = -RelayTunerUpdate(&Autotune.tuner, pid->error, SAMPLE_PERIOD);
+
+	if(Autotune.tuner.state == RELAY_TUNER_RUNNING)
+		return;
+
+	if(RelayTunerGains(&Autotune.tuner, Autotune.rule, &Kp, &Ki, &Kd))
+	{
+		pid->Kp = Kp;
+		pid->Ki = Ki;
+		pid->Kd = Kd;
+		ResetPID(pid);
+		SaveControllerSettings();
+	}
+	Autotune.pid = NULL;
+}
+
+//----------------------------------------
+// Controller init
+//----------------------------------------
+bool ControllerInit(void)
 {
+	// Motors thrust tables from quadratic thrust model until motors are calibrated
+	uint32_t i;
+	for(i = 0; i < MOTOR_COUNT; ++i)
+		ThrustLUTFromModel(&MotorsLUT[i], MotorsStartCommand[i]);
+
+	// Stored PIDs coefficients and motors thrust tables
+	LoadControllerSettings();
+
 	// We just want the quadcopter to be horizontal (no radio control)
 	YawPID.in = 0.0; PitchPID.in = 0.0; RollPID.in = 0.0; AltitudePID.in = 0.0;
 
@@ -270,120 +809,273 @@ void PIDTask(void)
 	// Subscribe UART console PID commands
 	SubscribePIDsCmds();
 
-	// Subscribe a bluetooth datasource to send periodically PID's data
-	JSONDataSource* PID_ds = SubscribePeriodicJSONDataSource("PID", (const char*[]) {	"motor1", "motor2", "motor3", "motor4",
-																						"YawIn", "PitchIn", "RollIn", "AltitudeIn",
-																						"YawOut", "PitchOut", "RollOut", "AltitudeOut"}, 12, 20, PIDDataAccessor);
+	// Subscribe a bluetooth datasource to send PID's data over 20 PID iterations: motor commands maximums (peak motor
+	// commands aren't missed) and signed PIDs outputs means
+	PID_ds = SubscribeDecimatedJSONDataSource("PID", PIDPropertiesNames, 12, 20, JSON_AGGREGATE_MEAN, 4);
+
+	SetJSONDataSourceUnits(PID_ds, PIDPropertiesUnits);
+
+	SetJSONDataSourceAggregation(PID_ds, (const JSONAggregation[]) {	JSON_AGGREGATE_MAX, JSON_AGGREGATE_MAX, JSON_AGGREGATE_MAX, JSON_AGGREGATE_MAX,
+																		JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MEAN,
+																		JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MEAN, JSON_AGGREGATE_MEAN	});
+
+	// Allow PID datasource to be streamed in compressed mode with a 0.0001 resolution
+	SetJSONDataSourceResolution(PID_ds, (const float[]) {	0.0001f, 0.0001f, 0.0001f, 0.0001f,
+															0.0001f, 0.0001f, 0.0001f, 0.0001f,
+															0.0001f, 0.0001f, 0.0001f, 0.0001f	});
 
-	// Subscribe a bluetooth datasource to send periodically Radio's data
-	JSONDataSource* Radio_ds = SubscribePeriodicJSONDataSource("radio", RadioPropertiesNames, 5, 40, RadioDataAccessor);
+	// Subscribe a bluetooth datasource to send Radio's data when it changes
+	Radio_ds = SubscribeOnChangeJSONDataSource("radio", RadioPropertiesNames, 5, 0.5f, 0);
 
 	// Subscribe a bluetooth datainput to receive remote control data
-	JSONDataInput* RemoteControl_di = SubscribeJSONDataInput("RemoteControl", (const char*[]) { "throttle", "directionX", "directionY", "yaw", "beep", "shutOffMotors" }, 6, RemoteControlDataAccessor);
+	RemoteControl_di = SubscribeTypedJSONDataInput("RemoteControl", RemoteControlKeys, 6, RemoteControlBindings, true, RemoteControlDataAccessor);
 
 	if(PID_ds == NULL || Radio_ds == NULL || RemoteControl_di == NULL)
 	{
 		Log_error0("Failed to subscribe to 'PID' data source, 'radio' data source or 'RemoteControl' data input.");
+		return false;
+	}
+
+	if(Frame->motorCount != MOTOR_COUNT)
+	{
+		Log_error2("Mixer frame has %u motors but %u motors are wired.", Frame->motorCount, MOTOR_COUNT);
+		ASSERT(FALSE);
+		return false;
+	}
+
+	ControllerReady = true;
+	return true;
+}
+
+//----------------------------------------
+// Controller angle stage
+//----------------------------------------
+void ControllerAngleStage(const IMUState* attitude)
+{
+	if(!ControllerReady)
+		return;
+
+	if(TivacopterControl.ShutOffMotors)
+	{
+		DisarmController();
 		return;
 	}
 
-	while(1)
+	if(TivacopterControl.RadioControlEnabled && RadioInputUpdatedFlag)
+		MapRadioInputToQuadcopterControl();
+	ShapeSetpoints();
+
+	// Map TivacopterControl to PIDs input
+	YawPID.in = TivacopterControl.Yaw;
+	PitchPID.in = PI/4 * TivacopterControl.Direction[x];
+	RollPID.in = PI/4 * TivacopterControl.Direction[y];
+
+	// Setpoint heading is yaw PID input or current heading (yaw rotation part of attitude) if yaw isn't regulated
+	float q[4], qHeading[4], qSetpoint[4], qInverse[4], qError[4];
+	memcpy(q, attitude->q, sizeof(q));
+	UpdateAttitudeSetpoint();
+	if(TivacopterControl.YawRegulationEnabled)
+		memcpy(qHeading, AttitudeSetpoint.qYaw, sizeof(qHeading));
+	else
 	{
-		// TODO: savoir si il faudrais mettre ici un timout pour mettre la pousse des moteurs  0.
-		Semaphore_pend(PID_Sem, BIOS_WAIT_FOREVER);
+		float norm2 = q[Q_A]*q[Q_A] + q[Q_D]*q[Q_D];
+		qHeading[Q_A] = norm2 > 0.0001f ? q[Q_A] * invSqrt(norm2) : 1.0f;
+		qHeading[Q_B] = 0.0f;
+		qHeading[Q_C] = 0.0f;
+		qHeading[Q_D] = norm2 > 0.0001f ? q[Q_D] * invSqrt(norm2) : 0.0f;
+	}
+	QuaternionMultiply(qSetpoint, qHeading, AttitudeSetpoint.qTilt);
 
-		if(TivacopterControl.ShutOffMotors)
-			break;
+	// Error quaternion is the rotation from current attitude to setpoint, in body frame (no euler angles singularity)
+	QuaternionInverse(qInverse, q);
+	QuaternionMultiply(qError, qInverse, qSetpoint);
 
-		if(TivacopterControl.RadioControlEnabled && RadioInputUpdatedFlag)
-			MapRadioInputToQuadcopterControl();
+	// Take shortest rotation (handles yaw wrap-around) and get body axes angle errors from its vector part
+	float sign = qError[Q_A] < 0.0f ? -2.0f : 2.0f;
+	RollPID.error = -sign * qError[Q_B];
+	PitchPID.error = -sign * qError[Q_C];
 
-		// Map TivacopterControl to PIDs input
-		YawPID.in = TivacopterControl.Yaw;
-		PitchPID.in = PI/4 * TivacopterControl.Direction[x];
-		RollPID.in = PI/4 * TivacopterControl.Direction[y];
+	ProcessPID(&PitchPID, SAMPLE_PERIOD);
+	ProcessPID(&RollPID, SAMPLE_PERIOD);
 
-		// Get error using euler angles from IMU
-		PitchPID.error = IMU.pitch - PitchPID.in;
-		RollPID.error = IMU.roll - RollPID.in;
+	// Angle PIDs outputs are corrections of angle errors: rate setpoints are their opposites
+	PitchRatePID.in = -PitchPID.out;
+	RollRatePID.in = -RollPID.out;
 
-		ProcessPID(&PitchPID);
-		ProcessPID(&RollPID);
+	if(TivacopterControl.YawRegulationEnabled)
+	{
+		YawPID.error = -sign * qError[Q_D];
+		ProcessPID(&YawPID, SAMPLE_PERIOD);
+		YawRatePID.in = -YawPID.out;
+	}
 
-		if(TivacopterControl.AltitudeStabilizationEnabled)
-		{
-			AltitudePID.error = IMU.accel->val[z] - IMU.accel->g;
-			ProcessPID(&AltitudePID);
-			TivacopterControl.Throttle -= AltitudePID.out;
-		}
+	RunAutotune();
 
-		// Convert euler angles to motors command
-		Motors[0].power =   PitchPID.out + RollPID.out + TivacopterControl.Throttle;
-		Motors[1].power = - PitchPID.out + RollPID.out + TivacopterControl.Throttle;
-		Motors[2].power = - PitchPID.out - RollPID.out + TivacopterControl.Throttle;
-		Motors[3].power =   PitchPID.out - RollPID.out + TivacopterControl.Throttle;
+	if(TivacopterControl.AltitudeStabilizationEnabled)
+	{
+		AltitudePID.error = attitude->accel[z] - attitude->g;
+		ProcessPID(&AltitudePID, SAMPLE_PERIOD);
+		TivacopterControl.Throttle -= AltitudePID.out;
+	}
+}
 
-		if(TivacopterControl.YawRegulationEnabled)
-		{
-			YawPID.error = IMU.yaw - YawPID.in;
-			ProcessPID(&YawPID);
-			Motors[0].power -= YawPID.out;
-			Motors[1].power += YawPID.out;
-			Motors[2].power -= YawPID.out;
-			Motors[3].power += YawPID.out;
-		}
+//----------------------------------------
+// Controller rate stage
+//----------------------------------------
+bool ControllerRateStage(const SensorsState* sensors)
+{
+	if(!ControllerReady)
+		return true;
+
+	if(TivacopterControl.ShutOffMotors)
+	{
+		// Rate PIDs restart from scratch once motors are turned on again
+		ResetPID(&YawRatePID);
+		ResetPID(&PitchRatePID);
+		ResetPID(&RollRatePID);
+		TurnOffMotors();
+		if(MotorCalibration.running)
+			SetMotorCommand(MotorCalibration.motor, MotorCalibration.command);
+		return false;
+	}
+	MotorCalibration.running = false;
+
+#if RATE_PID_SCHEDULING
+	// Rate PIDs gains are scheduled by collective throttle
+	YawRatePID.scheduleInput = TivacopterControl.Throttle;
+	PitchRatePID.scheduleInput = TivacopterControl.Throttle;
+	RollRatePID.scheduleInput = TivacopterControl.Throttle;
+#endif
 
-		// Limit motors power to its range
-		// We limit motors throttle to 70% for the moment
-		U_SAT(Motors[0].power, 0.7f);
-		U_SAT(Motors[1].power, 0.7f);
-		U_SAT(Motors[2].power, 0.7f);
-		U_SAT(Motors[3].power, 0.7f);
+	// Pitch is a rotation around y axis and roll around x axis
+	PitchRatePID.error = sensors->gyro[y] - PitchRatePID.in;
+	RollRatePID.error = sensors->gyro[x] - RollRatePID.in;
 
-		// Map motors power into their real range (from measured minimum power to start each motors)
-		Motors[0].power = Motors[0].power * (1.0f-MOTOR1_POWER_OFFSET) + MOTOR1_POWER_OFFSET;
-		Motors[1].power = Motors[1].power * (1.0f-MOTOR2_POWER_OFFSET) + MOTOR2_POWER_OFFSET;
-		Motors[2].power = Motors[2].power * (1.0f-MOTOR3_POWER_OFFSET) + MOTOR3_POWER_OFFSET;
-		Motors[3].power = Motors[3].power * (1.0f-MOTOR4_POWER_OFFSET) + MOTOR4_POWER_OFFSET;
+	ProcessPID(&PitchRatePID, SAMPLE_PERIOD);
+	ProcessPID(&RollRatePID, SAMPLE_PERIOD);
 
-		// Update PWM control of ESCs
-		TimerMatchSet(TIMER2_BASE, TIMER_A, (Motors[0].power * (MAX_MOTOR - MIN_MOTOR))	+ MIN_MOTOR);
-		TimerMatchSet(TIMER2_BASE, TIMER_B, (Motors[1].power * (MAX_MOTOR - MIN_MOTOR))	+ MIN_MOTOR);
-		TimerMatchSet(TIMER3_BASE, TIMER_A, (Motors[2].power * (MAX_MOTOR - MIN_MOTOR))	+ MIN_MOTOR);
-		TimerMatchSet(TIMER3_BASE, TIMER_B, (Motors[3].power * (MAX_MOTOR - MIN_MOTOR))	+ MIN_MOTOR);
+	float axes[3] = { RollRatePID.out, PitchRatePID.out, 0.0f };
+	if(TivacopterControl.YawRegulationEnabled)
+	{
+		YawRatePID.error = sensors->gyro[z] - YawRatePID.in;
+		ProcessPID(&YawRatePID, SAMPLE_PERIOD);
+		axes[MIXER_YAW] = YawRatePID.out;
 	}
 
-	TurnOffMotors();
-	UnsubscribeJSONDataSource(PID_ds);
-	UnsubscribeJSONDataInput(RemoteControl_di);
+	// Convert rates corrections to motors thrusts within motors range (attitude corrections have priority over throttle)
+	// Thrusts are scaled to compensate battery voltage sag so that loop gain doesn't drop as battery discharges
+	float motors[MIXER_MAX_MOTORS], applied[3];
+	uint32_t i;
+	MixMotors(Frame, axes, TivacopterControl.Throttle, GetBatteryThrustScale(), MOTOR_LIMIT, motors, applied);
+
+	// Rates corrections actually applied once motors saturated are given back to rate PIDs (anti-windup)
+	PIDTrackOutput(&RollRatePID, applied[MIXER_ROLL], SAMPLE_PERIOD);
+	PIDTrackOutput(&PitchRatePID, applied[MIXER_PITCH], SAMPLE_PERIOD);
+	if(TivacopterControl.YawRegulationEnabled)
+		PIDTrackOutput(&YawRatePID, applied[MIXER_YAW], SAMPLE_PERIOD);
+
+	// Convert motors thrusts to ESCs commands (linearized thrust) and update PWM control of ESCs
+	for(i = 0; i < MOTOR_COUNT; ++i)
+		SetMotorCommand(i, ThrustToCommand(&MotorsLUT[i], motors[i]));
+
+	// Publish controller state and give new samples to JSON datasources
+	PublishControllerState();
+	SamplePIDData(PID_ds);
+	SampleRadioData(Radio_ds);
+
+	return true;
 }
 
 //----------------------------------------
-// Process PID:
-// Process given PID structure's output
-// from its error and input.
-// Uses SAMPLE_FREQ to integrate and
-// derive data.
-// TODO: savoir si ce inline est utile
+// PID task
 //----------------------------------------
-static inline void ProcessPID(PID* pid)
+void PIDTask(void)
 {
-	// If error is very small, we omit this
-	if((*pid).error < 0.0001 && (*pid).error > -0.0001)
-		(*pid).error = 0;
+	if(!ControllerInit())
+		return;
+
+#if !CONTROL_LOOP_INLINE
+	// Attitude messages published by IMU processing task (outer loop) and sensors messages (inner loop)
+	TopicSubscriber attitudeSub, sensorsSub;
+	IMUState attitude;
+	SensorsState sensors;
+
+	// Subscribe to sensors and attitude topics: each sensors reading wakes up this task (before IMU processing task as PID task have an higher priority)
+	if(!TopicSubscribe(&SensorsTopic, &sensorsSub, TopicNotifySemaphore, (uintptr_t)PID_Sem))
+	{
+		Log_error0("Failed to subscribe to sensors topic.");
+		return;
+	}
+	if(!TopicSubscribe(&AttitudeTopic, &attitudeSub, NULL, 0))
+	{
+		Log_error0("Failed to subscribe to attitude topic.");
+		TopicUnsubscribe(&sensorsSub);
+		return;
+	}
+
+	while(1)
+	{
+		// TODO: savoir si il faudrais mettre ici un timout pour mettre la pousse des moteurs  0.
+		Semaphore_pend(PID_Sem, BIOS_WAIT_FOREVER);
+
+		// Outer angle loop: runs once per attitude estimation and gives rate setpoints to inner loop
+		if(TopicRead(&attitudeSub, &attitude, NULL))
+		{
+			while(TopicRead(&attitudeSub, &attitude, NULL))
+				continue;
+			ControllerAngleStage(&attitude);
+		}
+
+		// Inner rate loop: runs once per sensors reading using gyroscope rates (rad/s) which don't wait for attitude estimation
+		if(!TopicRead(&sensorsSub, &sensors, NULL))
+			continue;
+		while(TopicRead(&sensorsSub, &sensors, NULL))
+			continue;
+
+		// Controller keeps running while motors are shut off (disarmed) so that they can be turned on again
+		ControllerRateStage(&sensors);
+	}
+#endif
+}
 
-	// Integrate data and apply saturation
-	(*pid).ITerm += (*pid).Ki * ((*pid).in + (*pid).lastIn) * (SAMPLE_PERIOD/2.0);
-	SAT((*pid).ITerm, (*pid).ILimit);
+//----------------------------------------
+// Publish controller state:
+// Publishes motors commands and PIDs
+// state (readers never block PID task).
+//----------------------------------------
+static void PublishControllerState(void)
+{
+	const PID* PIDs[4] = { &YawPID, &PitchPID, &RollPID, &AltitudePID };
+	const PID* ratePIDs[3] = { &YawRatePID, &PitchRatePID, &RollRatePID };
+	ControllerState state;
+	uint32_t i;
 
-	// Derivate data
-	(*pid).DTerm = (*pid).Kd * ((*pid).in - (*pid).lastIn) * SAMPLE_FREQ;
+	for(i = 0; i < 4; ++i)
+	{
+		state.motors[i] = Motors[i].power;
+		state.in[i] = PIDs[i]->in;
+		state.error[i] = PIDs[i]->error;
+		state.out[i] = PIDs[i]->out;
+	}
+	for(i = 0; i < 3; ++i)
+	{
+		state.rateIn[i] = ratePIDs[i]->in;
+		state.rateOut[i] = ratePIDs[i]->out;
+	}
+	state.throttle = TivacopterControl.Throttle;
 
-	// Sum each PID terms
-	(*pid).out = ((*pid).Kp * (*pid).error) + (*pid).ITerm + (*pid).DTerm;
+	TopicPublish(&ControllerTopic, &state);
+}
 
-	// Update last PID inputs
-	(*pid).lastIn = (*pid).in;
+//----------------------------------------
+// Set motor command:
+// Updates PWM control of given motor's ESC
+// from command (0 to 1).
+//----------------------------------------
+static void SetMotorCommand(uint32_t motor, float command)
+{
+	Motors[motor].power = command;
+	TimerMatchSet(MotorsPWM[motor].base, MotorsPWM[motor].timer, (command * (MAX_MOTOR - MIN_MOTOR)) + MIN_MOTOR);
 }
 
 //----------------------------------------
@@ -391,19 +1083,18 @@ static inline void ProcessPID(PID* pid)
 //----------------------------------------
 static void TurnOffMotors(void)
 {
-	Motors[0].power = 0;
-	Motors[1].power = 0;
-	Motors[2].power = 0;
-	Motors[3].power = 0;
+	uint32_t i;
 
-	TimerMatchSet(TIMER2_BASE, TIMER_A, MIN_MOTOR);
-	TimerMatchSet(TIMER2_BASE, TIMER_B, MIN_MOTOR);
-	TimerMatchSet(TIMER3_BASE, TIMER_A, MIN_MOTOR);
-	TimerMatchSet(TIMER3_BASE, TIMER_B, MIN_MOTOR);
+	for(i = 0; i < MOTOR_COUNT; ++i)
+		SetMotorCommand(i, 0.0f);
 }
 
 //----------------------------------------
-// Map radio input to quadcopter control
+// Map radio input to quadcopter control:
+// Radio buttons give radio targets: throttle
+// rises while held and directions are full
+// deflections (setpoints shaping gives the
+// ramps).
 // TODO: find a safer and handy way to
 // control quadcopter via 5CHs radio!
 //----------------------------------------
@@ -411,38 +1102,106 @@ static void MapRadioInputToQuadcopterControl(void)
 {
 	if(RadioIn[0] == "1")
 	{
-		TivacopterControl.Throttle += 0.0005;
-		U_SAT(TivacopterControl.Throttle, 1.0f);
+		RadioTargets.Throttle += 0.0005;
+		U_SAT(RadioTargets.Throttle, 1.0f);
 	}
 	else
-		TivacopterControl.Throttle = 0;
+		RadioTargets.Throttle = 0;
 
 	if(RadioIn[1] == "1")
-	{
-		TivacopterControl.Direction[x] += 0.0005;
-		SAT(TivacopterControl.Direction[x], 1.0f);
-	}
+		RadioTargets.Direction[x] = 1.0f;
 	else if(RadioIn[2] == "1")
-	{
-		TivacopterControl.Direction[x] -= 0.0005;
-		SAT(TivacopterControl.Throttle, 1.0f);
-	}
+		RadioTargets.Direction[x] = -1.0f;
 	else
-		TivacopterControl.Direction[x] = 0;
+		RadioTargets.Direction[x] = 0;
 
 	if(RadioIn[3] == "1")
+		RadioTargets.Direction[y] = 1.0f;
+	else if(RadioIn[4] == "1")
+		RadioTargets.Direction[y] = -1.0f;
+	else
+		RadioTargets.Direction[y] = 0;
+
+	// When we control quadcopter by radio, the quadcopter orientation is always ahead
+	RadioTargets.Yaw = atan2(RadioTargets.Direction[y], RadioTargets.Direction[x]);
+}
+
+//----------------------------------------
+// Disarm controller:
+// Called by angle stage while motors are
+// shut off (rate stage resets rate PIDs).
+// Angle and altitude PIDs don't integrate
+// and setpoints stop at zero throttle,
+// level attitude and current heading so
+// that motors are turned on again from a
+// clean state. Running autotuning fails.
+//----------------------------------------
+static void DisarmController(void)
+{
+	ResetPID(&YawPID);
+	ResetPID(&PitchPID);
+	ResetPID(&RollPID);
+	ResetPID(&AltitudePID);
+	PitchRatePID.in = 0.0f;
+	RollRatePID.in = 0.0f;
+	YawRatePID.in = 0.0f;
+
+	SetpointShaperReset(&ThrottleShaper, 0.0f);
+	SetpointShaperReset(&DirectionShapers[x], 0.0f);
+	SetpointShaperReset(&DirectionShapers[y], 0.0f);
+	SetpointShaperReset(&YawShaper, YawShaper.value);
+	TivacopterControl.Throttle = 0.0f;
+	TivacopterControl.Direction[x] = 0.0f;
+	TivacopterControl.Direction[y] = 0.0f;
+
+	if(Autotune.pid != NULL)
 	{
-		TivacopterControl.Direction[y] += 0.0005;
-		SAT(TivacopterControl.Throttle, 1.0f);
+		Autotune.tuner.state = RELAY_TUNER_FAILED;
+		Autotune.pid = NULL;
 	}
-	else if(RadioIn[4] == "1")
+}
+
+//----------------------------------------
+// Shape setpoints:
+// Gives new pilot targets to setpoints
+// shapers (radio targets are given on each
+// cycle, remote control targets when a new
+// packet is received) and updates
+// 'TivacopterControl' setpoints with shaped
+// ones. Called once per control loop.
+//----------------------------------------
+static void ShapeSetpoints(void)
+{
+	const PilotTargets* targets = NULL;
+	float interval = 0.0f;
+
+	// Remote control packets interval (low-pass filtered against uplink jitter)
+	++RemoteControlTiming.cycles;
+	uint32_t sequence = RemoteControlSequence;
+	if(sequence != RemoteControlTiming.sequence)
 	{
-		TivacopterControl.Direction[y] -= 0.0005;
-		SAT(TivacopterControl.Throttle, 1.0f);
+		float measured = RemoteControlTiming.cycles * SAMPLE_PERIOD;
+		U_SAT(measured, SETPOINT_MAX_INTERVAL);
+		RemoteControlTiming.interval += (measured - RemoteControlTiming.interval) * SETPOINT_INTERVAL_FILTER;
+		RemoteControlTiming.sequence = sequence;
+		RemoteControlTiming.cycles = 0;
+		targets = &RemoteControlTargets;
+		interval = RemoteControlTiming.interval;
 	}
-	else
-		TivacopterControl.Direction[y] = 0;
 
-	// When we control quadcopter by radio, the quadcopter orientation is always ahead
-	TivacopterControl.Yaw = atan2(TivacopterControl.Direction[y], TivacopterControl.Direction[x]);
+	if(TivacopterControl.RadioControlEnabled && RadioInputUpdatedFlag)
+		targets = &RadioTargets;
+
+	if(targets != NULL)
+	{
+		SetpointShaperTarget(&ThrottleShaper, targets->Throttle, interval);
+		SetpointShaperTarget(&DirectionShapers[x], targets->Direction[x], interval);
+		SetpointShaperTarget(&DirectionShapers[y], targets->Direction[y], interval);
+		SetpointShaperTarget(&YawShaper, targets->Yaw, interval);
+	}
+
+	TivacopterControl.Throttle = SetpointShaperUpdate(&ThrottleShaper, SAMPLE_PERIOD);
+	TivacopterControl.Direction[x] = SetpointShaperUpdate(&DirectionShapers[x], SAMPLE_PERIOD);
+	TivacopterControl.Direction[y] = SetpointShaperUpdate(&DirectionShapers[y], SAMPLE_PERIOD);
+	TivacopterControl.Yaw = SetpointShaperUpdate(&YawShaper, SAMPLE_PERIOD);
 }
@@ -7,12 +7,52 @@
 
 #include <stdint.h>
 
-// We use 'SAMPLE_FREQ' define from 'IMU.h' as PID's integration and derivation is triggered by IMU task
+// We use 'SAMPLE_FREQ' define from 'IMU.h' as PID's integration and derivation is triggered by sensors readings
 #include "IMU.h"
 #include "PinMap.h"
+#include "Utils/PIDEngine.h"
+#include "Utils/Mixer.h"
+
+//----------------------------------------
+// Control loop mode:
+// If CONTROL_LOOP_INLINE is 1, controller
+// stages are run by IMU processing task
+// right after sensors reading (rate stage)
+// and attitude estimation (angle stage),
+// which saves a PID task wake-up per
+// cycle. Otherwise, PID task runs them
+// when woken up by sensors topic.
+// CONTROL_LOOP_TIMING enables inline loop
+// stages timing breakdown ('loopTiming'
+// command).
+//----------------------------------------
+#ifndef CONTROL_LOOP_INLINE
+#define CONTROL_LOOP_INLINE		1
+#endif
+
+#ifndef CONTROL_LOOP_TIMING
+#define CONTROL_LOOP_TIMING		0
+#endif
+
+#if CONTROL_LOOP_TIMING && !CONTROL_LOOP_INLINE
+#error "CONTROL_LOOP_TIMING requires CONTROL_LOOP_INLINE."
+#endif
+
+//----------------------------------------
+// Rate PIDs gain scheduling by collective
+// throttle: disabled until schedules
+// factors are measured (see rate PIDs gain
+// schedules in PID.c).
+//----------------------------------------
+#ifndef RATE_PID_SCHEDULING
+#define RATE_PID_SCHEDULING		0
+#endif
 
 //----------------------------------------
 // Maximum and minimum motor command
+// (PWM match values) and commands at which
+// each motor starts (used by default
+// motors thrust tables)
 //----------------------------------------
 #define MAX_MOTOR				PIOSC_FREQ*0.002
 #define MIN_MOTOR				PIOSC_FREQ*0.001
@@ -22,27 +62,24 @@
 #define MOTOR4_POWER_OFFSET		0.1080f
 
 //----------------------------------------
-// PID data structure
+// Motors mixer:
+// MIXER_FRAME is the mixing matrix used
+// (see 'Utils/Mixer.h' predefined frames)
+// and must have MOTOR_COUNT motors (one
+// per ESC PWM output). Motors thrusts are
+// limited to MOTOR_LIMIT thrust fraction:
+// 0.49 is the thrust of a 70% command with
+// default (quadratic) thrust tables, i.e.
+// the former 70% command limit. Calibrated
+// tables give the same thrust limit at
+// their own commands.
 //----------------------------------------
-typedef struct PID
-{
-	float Kp;
-	float Ki;
-	float Kd;
-
-	float ITerm;
-	float ILimit;
-	float DTerm;
+#ifndef MIXER_FRAME
+#define MIXER_FRAME				MixerQuadX
+#endif
 
-	float in;
-	char strIn[10];
-	float lastIn;
-
-	float out;
-	char strOut[10];
-
-	float error;
-} PID;
+#define MOTOR_COUNT				4
+#define MOTOR_LIMIT				0.49f
 
 //----------------------------------------
 // Quadcopter control structure
@@ -71,10 +108,44 @@ typedef struct
 //----------------------------------------
 typedef struct
 {
-	char strPower[10];
 	float power;
 }Motor;
 
+//----------------------------------------
+// Controller state snapshot typedef:
+// Controller state published once per PID
+// loop (see 'ControllerTopic').
+//----------------------------------------
+typedef struct
+{
+	// Motors commands and global throttle
+	float motors[4];
+	float throttle;
+	// Yaw, pitch, roll and altitude PIDs inputs, errors and outputs
+	float in[4];
+	float error[4];
+	float out[4];
+	// Yaw, pitch and roll rate PIDs inputs (rate setpoints) and outputs
+	float rateIn[3];
+	float rateOut[3];
+} ControllerState;
+
+//----------------------------------------
+// Controller topic:
+// 'ControllerState' messages published by
+// PID task once per loop.
+//----------------------------------------
+extern Topic ControllerTopic;
+
+//----------------------------------------
+// Get controller state:
+// Copies last controller state published
+// to 'state' without blocking. Returns
+// state version or 0 if no state have been
+// published yet.
+//----------------------------------------
+uint32_t GetControllerState(ControllerState* state);
+
 //----------------------------------------
 // GPIO Port E Hardware Interrupt handler
 // (radio)
@@ -82,21 +153,46 @@ typedef struct
 void GPIOPEHwiHandler(void);
 
 //----------------------------------------
-// Radio data accessor:
-// Accessor used by bluetooth to get data
-// from Radio data source.
+// Controller init:
+// Subscribes controller's commands, JSON
+// datasources and datainput. Controller
+// stages do nothing until it succeeded.
+//----------------------------------------
+bool ControllerInit(void);
+
+//----------------------------------------
+// Controller angle stage:
+// Outer angle loop giving rate setpoints
+// to rate stage. Should be run once per
+// attitude estimation.
+// While motors are shut off, controller is
+// disarmed: angle and altitude PIDs and
+// setpoints shapers are held reset (PIDs
+// don't wind up) and motors are turned on
+// again from this clean state as soon as
+// shut off is released.
 //----------------------------------------
-char** RadioDataAccessor(void);
+void ControllerAngleStage(const IMUState* attitude);
 
 //----------------------------------------
-// PID data accessor:
-// Accessor used by bluetooth to get data
-// from PID data source.
+// Controller rate stage:
+// Inner rate loop, motors mixing and ESCs
+// PWM update. Should be run once per
+// sensors reading. Returns false (motors
+// are turned off and rate PIDs are held
+// reset) while motors are shut off.
 //----------------------------------------
-char** PIDDataAccessor(void);
+bool ControllerRateStage(const SensorsState* sensors);
 
 //----------------------------------------
-// PID task
+// PID task:
+// Cascaded controller: outer angle loop
+// runs on each attitude estimation and
+// gives rate setpoints to inner rate loop
+// which runs on each sensors reading with
+// raw gyroscope rates.
+// In inline mode (CONTROL_LOOP_INLINE),
+// PID task only initializes controller.
 //----------------------------------------
 void PIDTask(void);
 
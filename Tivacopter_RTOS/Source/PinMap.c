@@ -19,9 +19,17 @@
 #include "driverlib/timer.h"
 #include "driverlib/debug.h"
 #include "driverlib/adc.h"
+#include "driverlib/udma.h"
 
 #include "PinMap.h"
 
+//------------------------------------------
+// uDMA channel control table (must be
+// aligned on a 1024 bytes boundary)
+//------------------------------------------
+#pragma DATA_ALIGN(DMAControlTable, 1024)
+static uint8_t DMAControlTable[1024];
+
 //------------------------------------------
 // PortFunctionInit
 // TODO: configure all unused pins as
@@ -48,6 +56,12 @@ void PortFunctionInit()
     MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_GPION);
     MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOM);
     MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOJ);
+    MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_UDMA);
+    MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
+
+    // Enable uDMA controller (used by bluetooth UART console)
+    MAP_uDMAEnable();
+    MAP_uDMAControlBaseSet(DMAControlTable);
 
     // Enable radio channels 1(PE0), 2(PE1), 3(PE2), 4(PE3), 5(PE5)
     MAP_GPIOPinTypeGPIOInput(RADIO_PORT, RADIO_PIN_MASK);
@@ -68,18 +82,18 @@ void PortFunctionInit()
     MAP_GPIOPinTypeUART(BLUETOOTH_UART_PORT, BLUETOOTH_TX_PIN);
 
     // Enable Battery level ADC pins as follow: cell1=PK0(AIN16), cell2=PK1(AIN17), cell3=PK2(AIN18)
- /*   MAP_GPIOPinTypeADC(BATTERY_PORT, BATTERY_CELL1_PIN | BATTERY_CELL2_PIN | BATTERY_CELL3_PIN);
-    // Enable the first sample sequencer to capture the value of channel 0 when the processor trigger occurs.
-    MAP_ADCSequenceConfigure(BATTERY_ADC_BASE, 0, ADC_TRIGGER_PROCESSOR, 0);
-    MAP_ADCSequenceStepConfigure(BATTERY_ADC_BASE, 0, 0, ADC_CTL_IE | ADC_CTL_END | ADC_CTL_CH0);
-    MAP_ADCSequenceEnable(BATTERY_ADC_BASE, 0);
-    // Trigger the sample sequence.
-    MAP_ADCProcessorTrigger(BATTERY_ADC_BASE, 0);
-    // Wait until the sample sequence has completed.
-    while(!ADCIntStatus(BATTERY_ADC_BASE, 0, false)) { }
-    // Read the value from the ADC.
-    uint32_t ui32Value;
-    ADCSequenceDataGet(BATTERY_ADC_BASE, 0, &ui32Value);*/
+    MAP_GPIOPinTypeADC(BATTERY_PORT, BATTERY_CELL1_PIN | BATTERY_CELL2_PIN | BATTERY_CELL3_PIN);
+    // Sample sequencer converts the three balance taps (hardware averaged) when processor trigger occurs.
+    // Battery level software interrupt reads each conversion and triggers the next one (no busy wait).
+    MAP_ADCHardwareOversampleConfigure(BATTERY_ADC_BASE, BATTERY_ADC_OVERSAMPLE);
+    MAP_ADCSequenceConfigure(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE, ADC_TRIGGER_PROCESSOR, 0);
+    MAP_ADCSequenceStepConfigure(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE, 0, BATTERY_CELL1_ADC_CH);
+    MAP_ADCSequenceStepConfigure(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE, 1, BATTERY_CELL2_ADC_CH);
+    MAP_ADCSequenceStepConfigure(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE, 2, BATTERY_CELL3_ADC_CH | ADC_CTL_IE | ADC_CTL_END);
+    MAP_ADCSequenceEnable(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE);
+    MAP_ADCIntClear(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE);
+    MAP_ADCProcessorTrigger(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE);
+
     // Enable LED1(PN1), LED2(PN0),  LED2(PN0) and LED4(PF0)
     MAP_GPIOPinTypeGPIOOutput(LED1_PORT, LED1_PIN);
     MAP_GPIOPinTypeGPIOOutput(LED2_PORT, LED2_PIN);
@@ -54,6 +54,8 @@
 #define BLUETOOTH_UART_INT		INT_UART3
 #define BLUETOOTH_RX_PIN		GPIO_PIN_4
 #define BLUETOOTH_TX_PIN		GPIO_PIN_5
+#define BLUETOOTH_UDMA_RX_CH	UDMA_CH16_UART3RX
+#define BLUETOOTH_UDMA_TX_CH	UDMA_CH17_UART3TX
 
 //------------------------------------------
 // MPU6050 and HMC5883L (IC 0)
@@ -118,6 +120,19 @@
 #define BATTERY_CELL1_PIN		GPIO_PIN_0
 #define BATTERY_CELL2_PIN		GPIO_PIN_1
 #define BATTERY_CELL3_PIN		GPIO_PIN_2
+#define BATTERY_CELL1_ADC_CH	ADC_CTL_CH16
+#define BATTERY_CELL2_ADC_CH	ADC_CTL_CH17
+#define BATTERY_CELL3_ADC_CH	ADC_CTL_CH18
+#define BATTERY_ADC_SEQUENCE	1
+#define BATTERY_ADC_OVERSAMPLE	64
+// Balance taps voltage dividers ratios (tap voltage / ADC pin voltage):
+// nominal ratios of dividers resistors, 'battery' command cells voltages
+// must be checked against a voltmeter before enabling battery sag
+// compensation (see BATTERY_SAG_COMPENSATION in 'main.c')
+#define BATTERY_CELL1_DIVIDER	2.0f
+#define BATTERY_CELL2_DIVIDER	3.0f
+#define BATTERY_CELL3_DIVIDER	4.3f
+#define BATTERY_ADC_VREF		3.3f
 
 //------------------------------------------
 // TODO: GPS module
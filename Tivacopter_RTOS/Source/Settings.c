@@ -0,0 +1,206 @@
+/*
+ * Settings.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//----------------------------------------
+// BIOS header files
+//----------------------------------------
+#include <xdc/std.h>  						//mandatory - have to include first, for BIOS types
+#include <ti/sysbios/BIOS.h> 				//mandatory - if you call APIs like BIOS_start()
+#include <xdc/runtime/Log.h>				//needed for any Log_info() call
+#include <xdc/cfg/global.h> 				//header file for statically defined objects/handles
+#include <ti/sysbios/hal/Hwi.h>
+
+#include "driverlib/eeprom.h"
+
+#include "Settings.h"
+
+//----------------------------------------
+// Settings block header stored at EEPROM
+// address 0, followed by settings data
+//----------------------------------------
+#define SETTINGS_MAGIC			0x54435331		// 'TCS1'
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t size;
+	uint32_t checksum;
+} SettingsHeader;
+
+//----------------------------------------
+// Settings blocks staging slots: writers
+// copy a block into a free slot and then
+// make it the pending one, which settings
+// task programs (a slot per concurrent
+// writer, plus pending and programmed
+// blocks). Only slots states are changed
+// with interrupts disabled.
+//----------------------------------------
+#ifndef SETTINGS_SLOT_COUNT
+#define SETTINGS_SLOT_COUNT		3
+#endif
+
+typedef enum
+{
+	SETTINGS_SLOT_FREE,
+	SETTINGS_SLOT_WRITING,
+	SETTINGS_SLOT_PENDING,
+	SETTINGS_SLOT_PROGRAMMING
+} SettingsSlotState;
+
+static struct
+{
+	SettingsHeader header;
+	uint32_t data[SETTINGS_MAX_SIZE / 4];
+} SettingsSlots[SETTINGS_SLOT_COUNT];
+static volatile SettingsSlotState SlotsStates[SETTINGS_SLOT_COUNT];
+
+//----------------------------------------
+// Finds a slot in state 'from' and moves
+// it to state 'to'. Must be called with
+// interrupts disabled. Returns slot index,
+// or -1 if no slot is in state 'from'.
+//----------------------------------------
+static int32_t MoveSettingsSlot(SettingsSlotState from, SettingsSlotState to)
+{
+	int32_t i;
+
+	for(i = 0; i < SETTINGS_SLOT_COUNT; ++i)
+		if(SlotsStates[i] == from)
+		{
+			SlotsStates[i] = to;
+			return i;
+		}
+	return -1;
+}
+
+//----------------------------------------
+// Settings checksum (Fletcher-32 over
+// data words)
+//----------------------------------------
+static uint32_t SettingsChecksum(const uint32_t* data, uint32_t wordCount)
+{
+	uint32_t sum1 = 0xFFFF, sum2 = 0xFFFF;
+	uint32_t i;
+
+	for(i = 0; i < wordCount; ++i)
+	{
+		sum1 = (sum1 + (data[i] & 0xFFFF) + (data[i] >> 16)) % 0xFFFF;
+		sum2 = (sum2 + sum1) % 0xFFFF;
+	}
+
+	return (sum2 << 16) | sum1;
+}
+
+//----------------------------------------
+// Settings init
+//----------------------------------------
+bool SettingsInit(void)
+{
+	if(EEPROMInit() != EEPROM_INIT_OK)
+	{
+		Log_error0("EEPROM initialization failed: settings can't be read nor saved.");
+		return false;
+	}
+	return true;
+}
+
+//----------------------------------------
+// Read settings
+//----------------------------------------
+bool ReadSettings(void* data, uint32_t size)
+{
+	static uint32_t buffer[SETTINGS_MAX_SIZE / 4];
+	SettingsHeader header;
+	uint32_t words = (size + 3) / 4;
+
+	if(size > SETTINGS_MAX_SIZE)
+		return false;
+
+	EEPROMRead((uint32_t*)&header, 0, sizeof(header));
+	if(header.magic != SETTINGS_MAGIC || header.size != size)
+		return false;
+
+	EEPROMRead(buffer, sizeof(header), words * 4);
+	if(SettingsChecksum(buffer, words) != header.checksum)
+	{
+		Log_warning0("Stored settings are corrupted.");
+		return false;
+	}
+
+	memcpy(data, buffer, size);
+	return true;
+}
+
+//----------------------------------------
+// Write settings
+//----------------------------------------
+bool WriteSettings(const void* data, uint32_t size)
+{
+	int32_t slot;
+	UInt key;
+
+	if(size > SETTINGS_MAX_SIZE)
+		return false;
+
+	key = Hwi_disable();
+	slot = MoveSettingsSlot(SETTINGS_SLOT_FREE, SETTINGS_SLOT_WRITING);
+	Hwi_restore(key);
+	if(slot < 0)
+	{
+		Log_error0("No free settings slot: too many concurrent settings writes.");
+		return false;
+	}
+
+	// Copy block out of the lock (checksum is computed by settings task)
+	memset(SettingsSlots[slot].data, 0, sizeof(SettingsSlots[slot].data));
+	memcpy(SettingsSlots[slot].data, data, size);
+	SettingsSlots[slot].header.magic = SETTINGS_MAGIC;
+	SettingsSlots[slot].header.size = size;
+
+	// Replace previous pending block, if any (last written block wins)
+	key = Hwi_disable();
+	MoveSettingsSlot(SETTINGS_SLOT_PENDING, SETTINGS_SLOT_FREE);
+	SlotsStates[slot] = SETTINGS_SLOT_PENDING;
+	Hwi_restore(key);
+
+	Semaphore_post(Settings_Sem);
+	return true;
+}
+
+//----------------------------------------
+// Settings task
+//----------------------------------------
+void SettingsTask(void)
+{
+	while(1)
+	{
+		Semaphore_pend(Settings_Sem, BIOS_WAIT_FOREVER);
+
+		// Take pending block (a newer block can be given while this one is programmed)
+		UInt key = Hwi_disable();
+		int32_t slot = MoveSettingsSlot(SETTINGS_SLOT_PENDING, SETTINGS_SLOT_PROGRAMMING);
+		Hwi_restore(key);
+
+		if(slot < 0)
+			continue;
+
+		uint32_t words = (SettingsSlots[slot].header.size + 3) / 4;
+		uint32_t size = sizeof(SettingsHeader) + words * 4;
+		SettingsSlots[slot].header.checksum = SettingsChecksum(SettingsSlots[slot].data, words);
+
+		if(EEPROMProgram((uint32_t*)&SettingsSlots[slot], 0, size) != 0)
+			Log_error0("Failed to write settings to EEPROM.");
+		else
+			Log_info1("Settings saved (%u bytes).", size);
+
+		key = Hwi_disable();
+		SlotsStates[slot] = SETTINGS_SLOT_FREE;
+		Hwi_restore(key);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Settings.h
+ * Settings persistence in MCU's EEPROM: a single settings block (checked with a magic number, its size and a
+ * checksum) is read at startup and written by a low priority task so that EEPROM programming never delays
+ * control loop.
+ */
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//----------------------------------------
+// Maximum settings block size in bytes
+//----------------------------------------
+#ifndef SETTINGS_MAX_SIZE
+#define SETTINGS_MAX_SIZE		512
+#endif
+
+#if SETTINGS_MAX_SIZE % 4 != 0
+#error "SETTINGS_MAX_SIZE must be a multiple of 4 (EEPROM words)."
+#endif
+
+//----------------------------------------
+// Settings init:
+// Initializes EEPROM peripheral. Must be
+// called once before reading settings.
+//----------------------------------------
+bool SettingsInit(void);
+
+//----------------------------------------
+// Read settings:
+// Copies stored settings block to 'data'.
+// Returns false if no valid settings
+// block of given size is stored.
+//----------------------------------------
+bool ReadSettings(void* data, uint32_t size);
+
+//----------------------------------------
+// Write settings:
+// Copies given settings block which is
+// written to EEPROM later by settings
+// task (last written block wins). Can be
+// called from any task: interrupts are
+// only disabled to swap staging slots, the
+// block is copied out of the lock and its
+// checksum is computed by settings task.
+// Returns false if block is too big or if
+// no staging slot is free.
+//----------------------------------------
+bool WriteSettings(const void* data, uint32_t size);
+
+//----------------------------------------
+// Settings task:
+// Writes settings blocks given by
+// 'WriteSettings' to EEPROM.
+//----------------------------------------
+void SettingsTask(void);
+
+#endif /* SETTINGS_H_ */
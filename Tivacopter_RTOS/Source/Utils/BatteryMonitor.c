@@ -0,0 +1,76 @@
+/*
+ * BatteryMonitor.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "BatteryMonitor.h"
+
+//-----------------------------------------------
+// BatteryMonitorUpdate
+//-----------------------------------------------
+bool BatteryMonitorUpdate(BatteryMonitor* battery, const float taps[])
+{
+	BatteryState previous = battery->state;
+	BatteryState level = BATTERY_OK;
+	uint32_t i;
+
+	// No battery: filter restarts from first sample once a battery is plugged in
+	if(taps[battery->cellCount - 1] < battery->presentVoltage * battery->cellCount)
+	{
+		battery->state = BATTERY_ABSENT;
+		return battery->state != previous;
+	}
+
+	// Filter cells voltages (each balance tap voltage is the sum of cells voltages up to this cell)
+	battery->voltage = 0.0f;
+	for(i = 0; i < battery->cellCount; ++i)
+	{
+		float cell = i == 0 ? taps[0] : taps[i] - taps[i - 1];
+		if(previous == BATTERY_ABSENT)
+			battery->cells[i] = cell;
+		else
+			battery->cells[i] += (cell - battery->cells[i]) * battery->filterAlpha;
+
+		battery->voltage += battery->cells[i];
+		if(i == 0 || battery->cells[i] < battery->minCell)
+			battery->minCell = battery->cells[i];
+	}
+
+	// Alarms are raised by the weakest cell and cleared only once it recovered above threshold plus hysteresis
+	if(battery->minCell < battery->lowVoltage)
+		level = BATTERY_LOW;
+	if(battery->minCell < battery->criticalVoltage)
+		level = BATTERY_CRITICAL;
+
+	if(level > previous || previous == BATTERY_ABSENT)
+		battery->state = level;
+	else if(level < previous)
+	{
+		if(battery->state == BATTERY_CRITICAL && battery->minCell > battery->criticalVoltage + battery->hysteresis)
+			battery->state = BATTERY_LOW;
+		if(battery->state == BATTERY_LOW && battery->minCell > battery->lowVoltage + battery->hysteresis)
+			battery->state = BATTERY_OK;
+	}
+
+	return battery->state != previous;
+}
+
+//-----------------------------------------------
+// BatteryThrustScale
+//-----------------------------------------------
+float BatteryThrustScale(const BatteryMonitor* battery)
+{
+	if(battery->state == BATTERY_ABSENT)
+		return 1.0f;
+
+	float ratio = battery->nominalVoltage * battery->cellCount / battery->voltage;
+	float scale = ratio * ratio;
+
+	if(scale > battery->maxThrustScale)
+		return battery->maxThrustScale;
+	if(scale < 1.0f / battery->maxThrustScale)
+		return 1.0f / battery->maxThrustScale;
+	return scale;
+}
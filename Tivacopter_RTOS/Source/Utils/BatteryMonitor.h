@@ -0,0 +1,80 @@
+/*
+ * BatteryMonitor.h
+ * LiPo battery monitor: filters balance taps voltages into cells voltages, raises low and critical voltage alarms
+ * (with hysteresis so that throttle punches don't toggle them) and gives the thrust scaling factor compensating
+ * battery voltage sag. Battery monitor is RTOS-independent: user samples balance taps and updates the monitor.
+ */
+
+#ifndef BATTERYMONITOR_H_
+#define BATTERYMONITOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Maximum cell count of a battery
+//-----------------------------------------------
+#define BATTERY_MAX_CELLS		6
+
+//-----------------------------------------------
+// Battery state typedef (from best to worst)
+// BATTERY_ABSENT means that battery voltage is
+// too low to be a battery (e.g. board powered
+// by USB).
+//-----------------------------------------------
+typedef enum
+{
+	BATTERY_ABSENT,
+	BATTERY_OK,
+	BATTERY_LOW,
+	BATTERY_CRITICAL
+} BatteryState;
+
+//-----------------------------------------------
+// Battery monitor structure typedef:
+// Configuration (first fields) is given by
+// user. Voltages are in volts and thresholds
+// are cell voltages. 'filterAlpha' is the
+// first-order low-pass filter factor applied
+// at each update (0 to 1, 1 disables filter).
+// 'nominalVoltage' is the cell voltage at which
+// thrust is nominal (e.g. voltage at which
+// motors were calibrated).
+//-----------------------------------------------
+typedef struct
+{
+	uint32_t cellCount;
+	float filterAlpha;
+	float presentVoltage;
+	float lowVoltage;
+	float criticalVoltage;
+	float hysteresis;
+	float nominalVoltage;
+	float maxThrustScale;
+
+	float cells[BATTERY_MAX_CELLS];
+	float voltage;
+	float minCell;
+	BatteryState state;
+} BatteryMonitor;
+
+//-----------------------------------------------
+// BatteryMonitorUpdate:
+// Updates cells voltages, battery voltage and
+// state from balance taps voltages ('taps[i]'
+// is the voltage of the first i+1 cells).
+// Returns true if battery state changed.
+//-----------------------------------------------
+bool BatteryMonitorUpdate(BatteryMonitor* battery, const float taps[]);
+
+//-----------------------------------------------
+// BatteryThrustScale:
+// Returns the factor by which motors thrusts
+// must be scaled to get nominal thrust at
+// current battery voltage: thrust goes with the
+// square of motors voltage. Returns 1 if
+// battery is absent.
+//-----------------------------------------------
+float BatteryThrustScale(const BatteryMonitor* battery);
+
+#endif /* BATTERYMONITOR_H_ */
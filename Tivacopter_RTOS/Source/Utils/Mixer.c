@@ -0,0 +1,130 @@
+/*
+ * Mixer.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Mixer.h"
+
+//-----------------------------------------------
+// Predefined frames mixing matrices
+// Roll and pitch factors are proportional to
+// sine and cosine of motors angles and yaw
+// factors alternate with propellers rotation.
+//-----------------------------------------------
+const MixerFrame MixerQuadX =
+{
+	.name = "quadX",
+	.motorCount = 4,
+	.factors = {
+		{  1.0f,	 1.0f,	-1.0f },
+		{  1.0f,	-1.0f,	 1.0f },
+		{ -1.0f,	-1.0f,	-1.0f },
+		{ -1.0f,	 1.0f,	 1.0f }
+	}
+};
+
+const MixerFrame MixerQuadPlus =
+{
+	.name = "quadPlus",
+	.motorCount = 4,
+	.factors = {
+		{  0.0f,	 1.0f,	-1.0f },
+		{  1.0f,	 0.0f,	 1.0f },
+		{  0.0f,	-1.0f,	-1.0f },
+		{ -1.0f,	 0.0f,	 1.0f }
+	}
+};
+
+const MixerFrame MixerHexX =
+{
+	.name = "hexX",
+	.motorCount = 6,
+	.factors = {
+		{  0.5f,	 0.866025f,	-1.0f },
+		{  1.0f,	 0.0f,		 1.0f },
+		{  0.5f,	-0.866025f,	-1.0f },
+		{ -0.5f,	-0.866025f,	 1.0f },
+		{ -1.0f,	 0.0f,		-1.0f },
+		{ -0.5f,	 0.866025f,	 1.0f }
+	}
+};
+
+const MixerFrame MixerOctoX =
+{
+	.name = "octoX",
+	.motorCount = 8,
+	.factors = {
+		{  0.382683f,	 0.923880f,	-1.0f },
+		{  0.923880f,	 0.382683f,	 1.0f },
+		{  0.923880f,	-0.382683f,	-1.0f },
+		{  0.382683f,	-0.923880f,	 1.0f },
+		{ -0.382683f,	-0.923880f,	-1.0f },
+		{ -0.923880f,	-0.382683f,	 1.0f },
+		{ -0.923880f,	 0.382683f,	-1.0f },
+		{ -0.382683f,	 0.923880f,	 1.0f }
+	}
+};
+
+//-----------------------------------------------
+// MixMotors
+//-----------------------------------------------
+bool MixMotors(const MixerFrame* frame, const float axes[3], float throttle, float thrustScale, float limit, float* motors, float applied[3])
+{
+	float minimum = 0.0f, maximum = 0.0f, scale = 1.0f;
+	uint32_t i;
+
+	// Mix unscaled thrusts within the limit left once thrusts are scaled
+	limit /= thrustScale;
+
+	// Attitude part of motors commands (mixing matrix times roll, pitch and yaw corrections)
+	for(i = 0; i < frame->motorCount; ++i)
+	{
+		const float* f = frame->factors[i];
+		motors[i] = f[MIXER_ROLL] * axes[MIXER_ROLL] + f[MIXER_PITCH] * axes[MIXER_PITCH] + f[MIXER_YAW] * axes[MIXER_YAW];
+		if(i == 0 || motors[i] < minimum)
+			minimum = motors[i];
+		if(i == 0 || motors[i] > maximum)
+			maximum = motors[i];
+	}
+
+	// Scale attitude corrections down if they can't fit in motors range whatever collective throttle is
+	if(maximum - minimum > limit)
+	{
+		scale = limit / (maximum - minimum);
+		minimum *= scale;
+		maximum *= scale;
+	}
+
+	// Shift collective throttle so that no motor clips. Near idle, collective throttle can only be raised up to a share
+	// of lowest correction growing with throttle (motors mustn't spin up on the ground at zero throttle): attitude
+	// corrections which still don't fit are scaled down.
+	if(throttle + maximum > limit)
+		throttle = limit - maximum;
+	if(throttle + minimum < 0.0f)
+	{
+		float authority = throttle <= 0.0f ? 0.0f : (throttle < MIXER_IDLE_THROTTLE ? throttle / MIXER_IDLE_THROTTLE : 1.0f);
+		if(throttle < -minimum * authority)
+			throttle = -minimum * authority;
+		if(throttle + minimum < 0.0f)
+		{
+			if(throttle < 0.0f)
+				throttle = 0.0f;
+			scale *= throttle / -minimum;
+		}
+	}
+
+	for(i = 0; i < frame->motorCount; ++i)
+		motors[i] = (motors[i] * scale + throttle) * thrustScale;
+
+	if(applied != NULL)
+	{
+		applied[MIXER_ROLL] = axes[MIXER_ROLL] * scale;
+		applied[MIXER_PITCH] = axes[MIXER_PITCH] * scale;
+		applied[MIXER_YAW] = axes[MIXER_YAW] * scale;
+	}
+
+	return scale == 1.0f;
+}
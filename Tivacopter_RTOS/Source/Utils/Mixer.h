@@ -0,0 +1,86 @@
+/*
+ * Mixer.h
+ * Motors mixer: motors commands are computed from roll, pitch and yaw corrections and collective throttle with a
+ * frame mixing matrix (one row of roll, pitch and yaw factors per motor). When motors would clip, collective
+ * throttle is shifted first and attitude corrections are only scaled down if they don't fit in motors range, or
+ * near idle throttle, where collective throttle isn't raised so that motors don't spin up on the ground.
+ * Mixer is RTOS-independent.
+ */
+
+#ifndef MIXER_H_
+#define MIXER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Maximum motor count of a frame
+//-----------------------------------------------
+#define MIXER_MAX_MOTORS		8
+
+//-----------------------------------------------
+// Idle throttle: below this collective throttle,
+// collective throttle can only be raised to fit
+// attitude corrections up to a proportional
+// share of them (none at zero throttle) and
+// corrections are scaled down instead
+//-----------------------------------------------
+#ifndef MIXER_IDLE_THROTTLE
+#define MIXER_IDLE_THROTTLE		0.05f
+#endif
+
+//-----------------------------------------------
+// Mixing matrix columns (axes) indexes
+//-----------------------------------------------
+#define MIXER_ROLL				0
+#define MIXER_PITCH				1
+#define MIXER_YAW				2
+
+//-----------------------------------------------
+// Mixer frame typedef:
+// 'factors[i]' are the roll, pitch and yaw
+// factors of motor 'i'. Each motor also gets
+// collective throttle. Attitude columns must
+// sum to zero (symmetric frame) so that
+// collective throttle shifts don't change
+// attitude corrections.
+//-----------------------------------------------
+typedef struct
+{
+	const char* name;
+	uint32_t motorCount;
+	float factors[MIXER_MAX_MOTORS][3];
+} MixerFrame;
+
+//-----------------------------------------------
+// Predefined frames:
+// Motors are numbered going round the frame
+// from motor 0, which is in front of roll and
+// pitch axes. Quad X layout is TivaCopter's.
+//-----------------------------------------------
+extern const MixerFrame MixerQuadX;
+extern const MixerFrame MixerQuadPlus;
+extern const MixerFrame MixerHexX;
+extern const MixerFrame MixerOctoX;
+
+//-----------------------------------------------
+// MixMotors:
+// Computes 'frame->motorCount' motors commands
+// in [0, limit] from 'axes' (roll, pitch and
+// yaw corrections) and 'throttle', scaled by
+// 'thrustScale' (e.g. battery voltage sag
+// compensation, 1 for none). Collective
+// throttle is shifted to keep attitude
+// corrections when motors would clip. If
+// attitude corrections span more than 'limit',
+// or if they don't fit above collective
+// throttle near idle (see MIXER_IDLE_THROTTLE),
+// they are scaled down. Attitude corrections
+// actually applied are written to 'applied'
+// (can be NULL), e.g. for PIDs anti-windup.
+// Returns false if attitude corrections had to
+// be scaled down.
+//-----------------------------------------------
+bool MixMotors(const MixerFrame* frame, const float axes[3], float throttle, float thrustScale, float limit, float* motors, float applied[3]);
+
+#endif /* MIXER_H_ */
@@ -0,0 +1,118 @@
+/*
+ * PIDEngine.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "PIDEngine.h"
+
+#define PID_2PI			6.28318530717958647692f
+
+//-----------------------------------------------
+// Clamp integral term to [-ILimit, ILimit]
+//-----------------------------------------------
+static inline void LimitITerm(PID* pid)
+{
+	if(pid->ITerm > pid->ILimit)
+		pid->ITerm = pid->ILimit;
+	else if(pid->ITerm < -pid->ILimit)
+		pid->ITerm = -pid->ILimit;
+}
+
+//-----------------------------------------------
+// Interpolate gain schedule factors at given
+// scheduling input
+//-----------------------------------------------
+static void InterpolateSchedule(const PIDSchedule* schedule, float input, float* Kp, float* Ki, float* Kd)
+{
+	uint32_t i = 1;
+
+	if(input <= schedule->points[0].input || schedule->count < 2)
+	{
+		*Kp = schedule->points[0].Kp;
+		*Ki = schedule->points[0].Ki;
+		*Kd = schedule->points[0].Kd;
+		return;
+	}
+
+	while(i < schedule->count - 1 && input > schedule->points[i].input)
+		++i;
+
+	float fraction = (input - schedule->points[i - 1].input) / (schedule->points[i].input - schedule->points[i - 1].input);
+	if(fraction > 1.0f)
+		fraction = 1.0f;
+
+	*Kp = schedule->points[i - 1].Kp + (schedule->points[i].Kp - schedule->points[i - 1].Kp) * fraction;
+	*Ki = schedule->points[i - 1].Ki + (schedule->points[i].Ki - schedule->points[i - 1].Ki) * fraction;
+	*Kd = schedule->points[i - 1].Kd + (schedule->points[i].Kd - schedule->points[i - 1].Kd) * fraction;
+}
+
+//-----------------------------------------------
+// ProcessPID
+//-----------------------------------------------
+void ProcessPID(PID* pid, float dt)
+{
+	float measure = pid->in + pid->error;
+	float Kp = pid->Kp, Ki = pid->Ki, Kd = pid->Kd;
+
+	// Scheduled gains
+	if(pid->schedule != NULL)
+	{
+		float KpFactor, KiFactor, KdFactor;
+		InterpolateSchedule(pid->schedule, pid->scheduleInput, &KpFactor, &KiFactor, &KdFactor);
+		Kp *= KpFactor;
+		Ki *= KiFactor;
+		Kd *= KdFactor;
+	}
+
+	// First call: no history to integrate or derive from
+	if(!pid->initialized)
+	{
+		pid->lastError = pid->error;
+		pid->lastMeasure = measure;
+		pid->DTerm = 0.0f;
+		pid->initialized = true;
+	}
+
+	// Trapezoidal integration of error
+	pid->ITerm += Ki * (pid->error + pid->lastError) * (dt / 2.0f);
+	LimitITerm(pid);
+
+	// Derivative on measure with first-order low-pass filter
+	float derivative = Kd * (measure - pid->lastMeasure) / dt;
+	if(pid->DCutoff > 0.0f)
+		pid->DTerm += (derivative - pid->DTerm) * (dt / (dt + 1.0f / (PID_2PI * pid->DCutoff)));
+	else
+		pid->DTerm = derivative;
+
+	// Sum weighted proportional, feed-forward, integral and derivative terms
+	pid->out = Kp * (pid->error + (1.0f - pid->b) * pid->in) - pid->Kff * pid->in + pid->ITerm + pid->DTerm;
+
+	pid->lastError = pid->error;
+	pid->lastMeasure = measure;
+}
+
+//-----------------------------------------------
+// PIDTrackOutput
+//-----------------------------------------------
+void PIDTrackOutput(PID* pid, float appliedOut, float dt)
+{
+	if(pid->Kt <= 0.0f)
+		return;
+
+	pid->ITerm += pid->Kt * (appliedOut - pid->out) * dt;
+	LimitITerm(pid);
+}
+
+//-----------------------------------------------
+// ResetPID
+//-----------------------------------------------
+void ResetPID(PID* pid)
+{
+	pid->ITerm = 0.0f;
+	pid->DTerm = 0.0f;
+	pid->out = 0.0f;
+	pid->initialized = false;
+}
@@ -0,0 +1,112 @@
+/*
+ * PIDEngine.h
+ * Reusable PID controller: trapezoidal integration of error, first-order filtered derivative on measurement,
+ * setpoint weighting of proportional term, feed-forward and back-calculation anti-windup (integral term tracks
+ * the output actually applied, e.g. after motors mixer saturation).
+ * PID engine is RTOS-independent and doesn't allocate anything.
+ */
+
+#ifndef PIDENGINE_H_
+#define PIDENGINE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Maximum point count of a gain schedule
+//-----------------------------------------------
+#define PID_SCHEDULE_MAX_POINTS		8
+
+//-----------------------------------------------
+// PID gain schedule typedef:
+// Kp, Ki and Kd factors at 'count' points of
+// increasing scheduling input. Factors are
+// linearly interpolated between points and
+// held beyond first and last points.
+//-----------------------------------------------
+typedef struct
+{
+	uint32_t count;
+	struct
+	{
+		float input;
+		float Kp, Ki, Kd;
+	} points[PID_SCHEDULE_MAX_POINTS];
+} PIDSchedule;
+
+//-----------------------------------------------
+// PID data structure:
+// 'in' is the setpoint and 'error' the
+// measure minus setpoint, both given by user
+// before each 'ProcessPID' call. 'out' is the
+// correction of error:
+// out = Kp*(error + (1-b)*in) - Kff*in
+//       + ITerm + DTerm
+// where ITerm integrates Ki*error and DTerm
+// is the low-pass filtered Kd*d(measure)/dt
+// (setpoint changes don't kick derivative).
+// 'b' is the setpoint weight (1 means plain
+// proportional on error, 0 proportional on
+// measure only), 'DCutoff' is derivative
+// filter cutoff frequency in Hz (0 disables
+// filter) and 'Kt' is back-calculation gain
+// in 1/s (0 disables back-calculation, see
+// 'PIDTrackOutput'). 'ILimit' stays as an
+// hard integral term bound.
+// If 'schedule' isn't NULL, Kp, Ki and Kd are
+// multiplied by schedule factors interpolated
+// at 'scheduleInput' (e.g. throttle) on each
+// 'ProcessPID' call.
+//-----------------------------------------------
+typedef struct PID
+{
+	float Kp;
+	float Ki;
+	float Kd;
+	float Kff;
+	float b;
+	float Kt;
+	float DCutoff;
+	float ILimit;
+
+	const PIDSchedule* schedule;
+	float scheduleInput;
+
+	float ITerm;
+	float DTerm;
+
+	float in;
+	float error;
+	float lastError;
+	float lastMeasure;
+	bool initialized;
+
+	float out;
+} PID;
+
+//-----------------------------------------------
+// ProcessPID:
+// Processes given PID's output from its input
+// and error. 'dt' is the time elapsed since
+// last call in seconds.
+//-----------------------------------------------
+void ProcessPID(PID* pid, float dt);
+
+//-----------------------------------------------
+// PIDTrackOutput:
+// Back-calculation anti-windup: gives the
+// output which have actually been applied
+// (e.g. after actuators saturation) since last
+// 'ProcessPID' call so that integral term is
+// corrected by Kt*(applied - out)*dt.
+//-----------------------------------------------
+void PIDTrackOutput(PID* pid, float appliedOut, float dt);
+
+//-----------------------------------------------
+// ResetPID:
+// Clears PID's integral and derivative terms
+// and history (gains and input are kept).
+//-----------------------------------------------
+void ResetPID(PID* pid);
+
+#endif /* PIDENGINE_H_ */
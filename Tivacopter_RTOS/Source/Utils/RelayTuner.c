@@ -0,0 +1,129 @@
+/*
+ * RelayTuner.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "RelayTuner.h"
+
+#define RELAY_TUNER_PI			3.14159265358979323846f
+
+//-----------------------------------------------
+// Relay tuner default cycle counts
+//-----------------------------------------------
+#define RELAY_TUNER_SETTLE_CYCLES	2
+#define RELAY_TUNER_MEASURE_CYCLES	4
+
+//-----------------------------------------------
+// Stop tuning with given state
+//-----------------------------------------------
+static float StopTuning(RelayTuner* tuner, RelayTunerState state)
+{
+	tuner->output = 0.0f;
+	tuner->state = state;
+	return 0.0f;
+}
+
+//-----------------------------------------------
+// RelayTunerStart
+//-----------------------------------------------
+void RelayTunerStart(RelayTuner* tuner, float amplitude, float hysteresis, float maxError, float timeout)
+{
+	tuner->state = RELAY_TUNER_IDLE;
+
+	tuner->amplitude = amplitude;
+	tuner->hysteresis = hysteresis;
+	tuner->maxError = maxError;
+	tuner->timeout = timeout;
+	tuner->settleCycles = RELAY_TUNER_SETTLE_CYCLES;
+	tuner->measureCycles = RELAY_TUNER_MEASURE_CYCLES;
+
+	tuner->output = amplitude;
+	tuner->time = 0.0f;
+	tuner->lastRiseTime = -1.0f;
+	tuner->maxErrorInCycle = -maxError;
+	tuner->minErrorInCycle = maxError;
+	tuner->cycles = 0;
+	tuner->periodSum = 0.0f;
+	tuner->errorAmplitudeSum = 0.0f;
+	tuner->Ku = 0.0f;
+	tuner->Tu = 0.0f;
+
+	tuner->state = RELAY_TUNER_RUNNING;
+}
+
+//-----------------------------------------------
+// RelayTunerUpdate
+//-----------------------------------------------
+float RelayTunerUpdate(RelayTuner* tuner, float error, float dt)
+{
+	if(tuner->state != RELAY_TUNER_RUNNING)
+		return 0.0f;
+
+	tuner->time += dt;
+	if(error > tuner->maxError || error < -tuner->maxError || tuner->time > tuner->timeout)
+		return StopTuning(tuner, RELAY_TUNER_FAILED);
+
+	if(error > tuner->maxErrorInCycle)
+		tuner->maxErrorInCycle = error;
+	if(error < tuner->minErrorInCycle)
+		tuner->minErrorInCycle = error;
+
+	if(tuner->output > 0.0f && error < -tuner->hysteresis)
+		tuner->output = -tuner->amplitude;
+	else if(tuner->output < 0.0f && error > tuner->hysteresis)
+	{
+		// Relay switches back to positive output once per cycle
+		tuner->output = tuner->amplitude;
+
+		if(tuner->lastRiseTime >= 0.0f && ++tuner->cycles > tuner->settleCycles)
+		{
+			tuner->periodSum += tuner->time - tuner->lastRiseTime;
+			tuner->errorAmplitudeSum += (tuner->maxErrorInCycle - tuner->minErrorInCycle) / 2.0f;
+
+			if(tuner->cycles - tuner->settleCycles >= tuner->measureCycles)
+			{
+				float errorAmplitude = tuner->errorAmplitudeSum / tuner->measureCycles;
+				if(errorAmplitude <= 0.0f)
+					return StopTuning(tuner, RELAY_TUNER_FAILED);
+
+				tuner->Tu = tuner->periodSum / tuner->measureCycles;
+				tuner->Ku = 4.0f * tuner->amplitude / (RELAY_TUNER_PI * errorAmplitude);
+				return StopTuning(tuner, RELAY_TUNER_DONE);
+			}
+		}
+
+		tuner->lastRiseTime = tuner->time;
+		tuner->maxErrorInCycle = error;
+		tuner->minErrorInCycle = error;
+	}
+
+	return tuner->output;
+}
+
+//-----------------------------------------------
+// RelayTunerGains
+//-----------------------------------------------
+bool RelayTunerGains(const RelayTuner* tuner, RelayTunerRule rule, float* Kp, float* Ki, float* Kd)
+{
+	if(tuner->state != RELAY_TUNER_DONE)
+		return false;
+
+	switch(rule)
+	{
+	case RELAY_TUNER_RULE_PI:
+		*Kp = 0.45f * tuner->Ku;
+		*Ki = 0.54f * tuner->Ku / tuner->Tu;
+		*Kd = 0.0f;
+		break;
+	case RELAY_TUNER_RULE_PID:
+	default:
+		*Kp = 0.2f * tuner->Ku;
+		*Ki = 0.4f * tuner->Ku / tuner->Tu;
+		*Kd = 0.0667f * tuner->Ku * tuner->Tu;
+		break;
+	}
+
+	return true;
+}
@@ -0,0 +1,93 @@
+/*
+ * RelayTuner.h
+ * Relay feedback autotuner (Astrom-Hagglund): replaces a PID output by a relay with hysteresis on its error, which
+ * makes the loop oscillate at its ultimate period. Ultimate gain is given by the relay describing function:
+ * Ku = 4*amplitude / (PI*errorAmplitude). PID gains are then computed with Ziegler-Nichols rules.
+ * Relay tuner is RTOS-independent.
+ */
+
+#ifndef RELAYTUNER_H_
+#define RELAYTUNER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Relay tuner state typedef
+//-----------------------------------------------
+typedef enum
+{
+	RELAY_TUNER_IDLE,
+	RELAY_TUNER_RUNNING,
+	RELAY_TUNER_DONE,
+	RELAY_TUNER_FAILED
+} RelayTunerState;
+
+//-----------------------------------------------
+// Relay tuner tuning rules typedef:
+// Ziegler-Nichols PI or 'no overshoot' PID.
+//-----------------------------------------------
+typedef enum
+{
+	RELAY_TUNER_RULE_PID,
+	RELAY_TUNER_RULE_PI
+} RelayTunerRule;
+
+//-----------------------------------------------
+// Relay tuner structure typedef:
+// Configuration (first fields) is given by
+// 'RelayTunerStart'. Oscillation is measured
+// over 'measureCycles' cycles once
+// 'settleCycles' cycles elapsed. Tuning fails
+// if error exceeds 'maxError' or if it didn't
+// end within 'timeout' seconds.
+//-----------------------------------------------
+typedef struct
+{
+	float amplitude;
+	float hysteresis;
+	float maxError;
+	float timeout;
+	uint32_t settleCycles;
+	uint32_t measureCycles;
+
+	volatile RelayTunerState state;
+	float output;
+	float time;
+	float lastRiseTime;
+	float maxErrorInCycle;
+	float minErrorInCycle;
+	uint32_t cycles;
+	float periodSum;
+	float errorAmplitudeSum;
+
+	float Ku;
+	float Tu;
+} RelayTuner;
+
+//-----------------------------------------------
+// RelayTunerStart:
+// Starts a relay oscillation of given output
+// amplitude and error hysteresis.
+//-----------------------------------------------
+void RelayTunerStart(RelayTuner* tuner, float amplitude, float hysteresis, float maxError, float timeout);
+
+//-----------------------------------------------
+// RelayTunerUpdate:
+// Returns relay output (PID output replacement,
+// same sign convention as PID output: error is
+// measure minus setpoint) from current error.
+// 'dt' is the time elapsed since last update
+// in seconds. Returns 0 once tuning ended.
+//-----------------------------------------------
+float RelayTunerUpdate(RelayTuner* tuner, float error, float dt);
+
+//-----------------------------------------------
+// RelayTunerGains:
+// Gives PID gains from measured ultimate gain
+// and period with given tuning rule. Returns
+// false if tuning isn't done.
+//-----------------------------------------------
+bool RelayTunerGains(const RelayTuner* tuner, RelayTunerRule rule, float* Kp, float* Ki, float* Kd);
+
+#endif /* RELAYTUNER_H_ */
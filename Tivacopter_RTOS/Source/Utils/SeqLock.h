@@ -0,0 +1,80 @@
+/*
+ * SeqLock.h
+ * Sequence lock: tags a copy of some data with the version (sequence number) it holds so that readers detect copies
+ * beeing rewritten without ever blocking nor delaying the writer, whatever their respective priorities. A single
+ * thread must write a given copy. Topic bus slots are sequence locked copies (see 'TopicBus.h').
+ */
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Compiler memory barrier keeping copies writes
+// and sequence updates ordered (single core MCU:
+// no hardware barrier is needed).
+//-----------------------------------------------
+#if defined(__GNUC__)
+#define SEQLOCK_BARRIER()		__asm volatile("" ::: "memory")
+#else
+#define SEQLOCK_BARRIER()		__asm(" dmb")
+#endif
+
+//-----------------------------------------------
+// Sequence lock structure typedef:
+// 'sequence' is the version of the copy (0
+// while the copy is written, so that version 0
+// is reserved).
+//-----------------------------------------------
+typedef struct
+{
+	volatile uint32_t sequence;
+} SeqLock;
+
+//-----------------------------------------------
+// SeqLockWriteBegin:
+// Invalidates the copy before it is rewritten.
+//-----------------------------------------------
+static inline void SeqLockWriteBegin(SeqLock* lock)
+{
+	lock->sequence = 0;
+	SEQLOCK_BARRIER();
+}
+
+//-----------------------------------------------
+// SeqLockWriteEnd:
+// Tags the rewritten copy with its version.
+//-----------------------------------------------
+static inline void SeqLockWriteEnd(SeqLock* lock, uint32_t version)
+{
+	SEQLOCK_BARRIER();
+	lock->sequence = version;
+}
+
+//-----------------------------------------------
+// SeqLockReadBegin:
+// Returns false if the copy doesn't hold given
+// version (anymore) and mustn't be read.
+//-----------------------------------------------
+static inline bool SeqLockReadBegin(const SeqLock* lock, uint32_t version)
+{
+	bool valid = lock->sequence == version;
+	SEQLOCK_BARRIER();
+	return valid;
+}
+
+//-----------------------------------------------
+// SeqLockReadEnd:
+// Returns false if the copy have been rewritten
+// while it was read (read data must then be
+// discarded).
+//-----------------------------------------------
+static inline bool SeqLockReadEnd(const SeqLock* lock, uint32_t version)
+{
+	SEQLOCK_BARRIER();
+	return lock->sequence == version;
+}
+
+#endif /* SEQLOCK_H_ */
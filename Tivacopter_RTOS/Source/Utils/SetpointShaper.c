@@ -0,0 +1,131 @@
+/*
+ * SetpointShaper.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "SetpointShaper.h"
+
+#define SHAPER_2PI			6.28318530717958647692f
+
+//-----------------------------------------------
+// Clamp value to [-limit, limit] if limit is
+// positive
+//-----------------------------------------------
+static inline float Limit(float value, float limit)
+{
+	if(limit <= 0.0f)
+		return value;
+	if(value > limit)
+		return limit;
+	if(value < -limit)
+		return -limit;
+	return value;
+}
+
+//-----------------------------------------------
+// Current ramp position
+//-----------------------------------------------
+static float RampPosition(const SetpointShaper* shaper)
+{
+	if(shaper->rampTime >= shaper->rampDuration)
+		return shaper->rampTo;
+	return shaper->rampFrom + (shaper->rampTo - shaper->rampFrom) * (shaper->rampTime / shaper->rampDuration);
+}
+
+//-----------------------------------------------
+// ExpoCurve
+//-----------------------------------------------
+float ExpoCurve(float input, float expo)
+{
+	return (1.0f - expo) * input + expo * input * input * input;
+}
+
+//-----------------------------------------------
+// SetpointShaperTarget
+//-----------------------------------------------
+void SetpointShaperTarget(SetpointShaper* shaper, float target, float interval)
+{
+	if(shaper->expo > 0.0f)
+		target = ExpoCurve(target, shaper->expo);
+
+	if(!shaper->initialized)
+	{
+		shaper->rampFrom = shaper->rampTo = shaper->value = target;
+		shaper->rampTime = shaper->rampDuration = 0.0f;
+		shaper->rate = shaper->accel = 0.0f;
+		shaper->initialized = true;
+		return;
+	}
+
+	float from = RampPosition(shaper);
+
+	// Wrapping setpoints take the shortest way to target
+	if(shaper->wrap > 0.0f)
+	{
+		float difference = target - from;
+		while(difference > shaper->wrap / 2.0f)
+			difference -= shaper->wrap;
+		while(difference < -shaper->wrap / 2.0f)
+			difference += shaper->wrap;
+		target = from + difference;
+	}
+
+	shaper->rampFrom = from;
+	shaper->rampTo = target;
+	shaper->rampTime = 0.0f;
+	shaper->rampDuration = interval;
+}
+
+//-----------------------------------------------
+// SetpointShaperReset
+//-----------------------------------------------
+void SetpointShaperReset(SetpointShaper* shaper, float value)
+{
+	shaper->rampFrom = shaper->rampTo = shaper->value = value;
+	shaper->rampTime = shaper->rampDuration = 0.0f;
+	shaper->rate = shaper->accel = 0.0f;
+	shaper->initialized = true;
+}
+
+//-----------------------------------------------
+// SetpointShaperUpdate
+//-----------------------------------------------
+float SetpointShaperUpdate(SetpointShaper* shaper, float dt)
+{
+	if(!shaper->initialized)
+		return shaper->value;
+
+	// Interpolated target
+	if(shaper->rampTime < shaper->rampDuration)
+		shaper->rampTime += dt;
+	float target = RampPosition(shaper);
+
+	// Critically damped second-order reference with acceleration and jerk limits
+	float w = SHAPER_2PI * shaper->frequency;
+	float accel = Limit(w * w * (target - shaper->value) - 2.0f * w * shaper->rate, shaper->maxAccel);
+	if(shaper->maxJerk > 0.0f)
+		accel = shaper->accel + Limit(accel - shaper->accel, shaper->maxJerk * dt);
+	shaper->accel = accel;
+
+	// Rate limit (acceleration can't push rate further once limited)
+	shaper->rate += shaper->accel * dt;
+	if(shaper->maxRate > 0.0f && (shaper->rate > shaper->maxRate || shaper->rate < -shaper->maxRate))
+	{
+		shaper->rate = Limit(shaper->rate, shaper->maxRate);
+		shaper->accel = 0.0f;
+	}
+	shaper->value += shaper->rate * dt;
+
+	// Keep wrapping setpoints (and ramp) within [-wrap/2, wrap/2]
+	if(shaper->wrap > 0.0f && (shaper->value > shaper->wrap / 2.0f || shaper->value < -shaper->wrap / 2.0f))
+	{
+		float offset = shaper->value > 0.0f ? -shaper->wrap : shaper->wrap;
+		shaper->value += offset;
+		shaper->rampFrom += offset;
+		shaper->rampTo += offset;
+	}
+
+	return shaper->value;
+}
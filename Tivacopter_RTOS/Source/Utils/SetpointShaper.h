@@ -0,0 +1,79 @@
+/*
+ * SetpointShaper.h
+ * Setpoint shaping of pilot inputs: each new (sparse and jittery) target is reached by a linear ramp lasting one
+ * target interval, followed by a critically damped second-order reference filter with rate, acceleration and jerk
+ * limits. Shaped setpoints are updated at control loop rate so that controller never sees steps.
+ * Setpoint shaper is RTOS-independent.
+ */
+
+#ifndef SETPOINTSHAPER_H_
+#define SETPOINTSHAPER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Setpoint shaper structure typedef:
+// Configuration (first fields) is given by
+// user: 'frequency' is reference filter
+// natural frequency in Hz, 'maxRate',
+// 'maxAccel' and 'maxJerk' are limits of
+// setpoint derivatives (0 disables a limit),
+// 'expo' is the expo curve factor applied to
+// targets (0 to 1, targets are then expected
+// in [-1, 1]) and 'wrap' is the period of
+// wrapping setpoints (e.g. 2*PI for angles,
+// 0 if setpoint doesn't wrap).
+//-----------------------------------------------
+typedef struct
+{
+	float frequency;
+	float maxRate;
+	float maxAccel;
+	float maxJerk;
+	float expo;
+	float wrap;
+
+	float rampFrom;
+	float rampTo;
+	float rampTime;
+	float rampDuration;
+
+	float value;
+	float rate;
+	float accel;
+	bool initialized;
+} SetpointShaper;
+
+//-----------------------------------------------
+// ExpoCurve:
+// Returns (1-expo)*input + expo*input^3: keeps
+// full range while softening response around
+// center.
+//-----------------------------------------------
+float ExpoCurve(float input, float expo);
+
+//-----------------------------------------------
+// SetpointShaperTarget:
+// Gives a new target which is reached by a
+// linear ramp lasting 'interval' seconds
+// (e.g. expected interval until next target).
+// First target initializes shaped setpoint.
+//-----------------------------------------------
+void SetpointShaperTarget(SetpointShaper* shaper, float target, float interval);
+
+//-----------------------------------------------
+// SetpointShaperUpdate:
+// Returns shaped setpoint after 'dt' seconds.
+//-----------------------------------------------
+float SetpointShaperUpdate(SetpointShaper* shaper, float dt);
+
+//-----------------------------------------------
+// SetpointShaperReset:
+// Stops shaped setpoint at 'value' (no ramp,
+// rate nor acceleration left): next targets
+// are reached from there.
+//-----------------------------------------------
+void SetpointShaperReset(SetpointShaper* shaper, float value);
+
+#endif /* SETPOINTSHAPER_H_ */
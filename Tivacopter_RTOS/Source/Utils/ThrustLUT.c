@@ -0,0 +1,75 @@
+/*
+ * ThrustLUT.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "math.h"
+
+#include "ThrustLUT.h"
+
+//-----------------------------------------------
+// ThrustToCommand
+//-----------------------------------------------
+float ThrustToCommand(const ThrustLUT* lut, float thrust)
+{
+	if(thrust <= 0.0f)
+		return lut->command[0];
+	if(thrust >= 1.0f)
+		return lut->command[THRUST_LUT_SIZE - 1];
+
+	float position = thrust * (THRUST_LUT_SIZE - 1);
+	uint32_t i = (uint32_t)position;
+	float fraction = position - i;
+
+	return lut->command[i] + (lut->command[i + 1] - lut->command[i]) * fraction;
+}
+
+//-----------------------------------------------
+// ThrustLUTFromModel
+//-----------------------------------------------
+void ThrustLUTFromModel(ThrustLUT* lut, float startCommand)
+{
+	uint32_t i;
+
+	for(i = 0; i < THRUST_LUT_SIZE; ++i)
+		lut->command[i] = startCommand + (1.0f - startCommand) * sqrtf((float)i / (THRUST_LUT_SIZE - 1));
+}
+
+//-----------------------------------------------
+// ThrustLUTFromCalibration
+//-----------------------------------------------
+bool ThrustLUTFromCalibration(ThrustLUT* lut, const ThrustCalibrationPoint* points, uint32_t count, float maxThrust)
+{
+	uint32_t i, j;
+
+	if(count < 2 || points[count - 1].thrust <= points[0].thrust)
+		return false;
+	for(j = 1; j < count; ++j)
+		if(points[j].command <= points[j - 1].command || points[j].thrust < points[j - 1].thrust)
+			return false;
+
+	if(maxThrust <= 0.0f)
+		maxThrust = points[count - 1].thrust;
+
+	// Invert measured thrust curve at each thrust level (thrusts beyond measured ones give extreme commands)
+	for(i = 0, j = 0; i < THRUST_LUT_SIZE; ++i)
+	{
+		float thrust = maxThrust * i / (THRUST_LUT_SIZE - 1);
+
+		while(j < count - 2 && points[j + 1].thrust < thrust)
+			++j;
+
+		const ThrustCalibrationPoint* low = &points[j];
+		const ThrustCalibrationPoint* high = &points[j + 1];
+		if(thrust <= low->thrust)
+			lut->command[i] = low->command;
+		else if(thrust >= high->thrust)
+			lut->command[i] = high->command;
+		else
+			lut->command[i] = low->command + (high->command - low->command) * (thrust - low->thrust) / (high->thrust - low->thrust);
+	}
+
+	return true;
+}
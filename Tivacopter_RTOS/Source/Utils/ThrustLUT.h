@@ -0,0 +1,74 @@
+/*
+ * ThrustLUT.h
+ * Thrust linearization lookup tables: gives the ESC command (0 to 1) needed to get a thrust fraction (0 to 1) with
+ * linear interpolation between THRUST_LUT_SIZE evenly spaced thrust levels. Tables are either built from a
+ * quadratic thrust model or from bench calibration points (measured thrust at several commands).
+ * Thrust LUT is RTOS-independent.
+ */
+
+#ifndef THRUSTLUT_H_
+#define THRUSTLUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------
+// Thrust levels count of a table (thrust
+// level 'i' is i/(THRUST_LUT_SIZE-1))
+//-----------------------------------------------
+#define THRUST_LUT_SIZE			11
+
+//-----------------------------------------------
+// Thrust lookup table typedef:
+// 'command[i]' is the command giving thrust
+// level 'i'.
+//-----------------------------------------------
+typedef struct
+{
+	float command[THRUST_LUT_SIZE];
+} ThrustLUT;
+
+//-----------------------------------------------
+// Thrust calibration point typedef:
+// Thrust measured on bench (any unit, e.g.
+// grams) at given command.
+//-----------------------------------------------
+typedef struct
+{
+	float command;
+	float thrust;
+} ThrustCalibrationPoint;
+
+//-----------------------------------------------
+// ThrustToCommand:
+// Returns the command giving 'thrust' (clamped
+// to [0, 1]) by linear interpolation.
+//-----------------------------------------------
+float ThrustToCommand(const ThrustLUT* lut, float thrust);
+
+//-----------------------------------------------
+// ThrustLUTFromModel:
+// Fills table from quadratic thrust model:
+// thrust = ((command - startCommand) /
+// (1 - startCommand))^2, where 'startCommand'
+// is the command at which motor starts.
+//-----------------------------------------------
+void ThrustLUTFromModel(ThrustLUT* lut, float startCommand);
+
+//-----------------------------------------------
+// ThrustLUTFromCalibration:
+// Fills table from 'count' calibration points
+// sorted by increasing command. First point
+// should be the motor start command (zero
+// thrust). Thrusts are normalized by
+// 'maxThrust' (e.g. the weakest motor's full
+// thrust so that all motors share the same
+// thrust scale) or by the last point's thrust
+// if 'maxThrust' isn't positive.
+// Returns false (table is left unchanged) if
+// there are less than 2 points or if commands
+// or thrusts aren't increasing.
+//-----------------------------------------------
+bool ThrustLUTFromCalibration(ThrustLUT* lut, const ThrustCalibrationPoint* points, uint32_t count, float maxThrust);
+
+#endif /* THRUSTLUT_H_ */
@@ -0,0 +1,188 @@
+/*
+ * TopicBus.c
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "TopicBus.h"
+
+//--------------------------------------------
+// User defined lock and unlock functions
+// protecting topics subscribers lists from
+// beeing corrupted by other threads accesses.
+// Lock is held while subscribers are notified
+// so it must be usable from any publisher
+// thread (e.g. TI-RTOS users could implement
+// these functions using Hwi_disable/restore).
+//--------------------------------------------
+extern intptr_t TopicBusLock(void);
+extern void TopicBusUnlock(intptr_t lock);
+
+//--------------------------------------------
+// User defined timestamp function giving
+// published messages timestamp (e.g. in
+// microseconds, wrapping around 2^32).
+//--------------------------------------------
+extern uint32_t TopicBusTimestamp(void);
+
+//-----------------------------------------------
+// Get slot header of given sequence number
+//-----------------------------------------------
+static inline TopicSlotHeader* GetSlot(const Topic* topic, uint32_t sequence)
+{
+	return (TopicSlotHeader*)((uint8_t*)topic->slots + (sequence & (topic->depth - 1)) * topic->stride);
+}
+
+//-----------------------------------------------
+// Read slot:
+// Copies message of given sequence number and
+// returns false if slot doesn't hold this
+// message anymore (or was rewritten meanwhile).
+//-----------------------------------------------
+static bool ReadSlot(const Topic* topic, uint32_t sequence, void* msg, uint32_t* timestamp)
+{
+	const TopicSlotHeader* slot = GetSlot(topic, sequence);
+
+	if(!SeqLockReadBegin(&slot->lock, sequence))
+		return false;
+
+	memcpy(msg, (const uint8_t*)slot + topic->msgOffset, topic->size);
+	if(timestamp != NULL)
+		*timestamp = slot->timestamp;
+
+	return SeqLockReadEnd(&slot->lock, sequence);
+}
+
+//-----------------------------------------------
+// TopicSubscribe
+//-----------------------------------------------
+bool TopicSubscribe(Topic* topic, TopicSubscriber* sub, TopicNotifyCallback notify, uintptr_t arg)
+{
+	bool success = false;
+
+	sub->topic = topic;
+	sub->lastSequence = topic->published;
+	sub->lost = 0;
+	sub->notify = notify;
+	sub->arg = arg;
+
+	intptr_t lock = TopicBusLock();
+	if(topic->subscriberCount < TOPIC_MAX_SUBSCRIBERS)
+	{
+		topic->subscribers[topic->subscriberCount++] = sub;
+		success = true;
+	}
+	TopicBusUnlock(lock);
+
+	return success;
+}
+
+//-----------------------------------------------
+// TopicUnsubscribe
+//-----------------------------------------------
+void TopicUnsubscribe(TopicSubscriber* sub)
+{
+	Topic* topic = sub->topic;
+	uint32_t i;
+
+	intptr_t lock = TopicBusLock();
+	for(i = 0; i < topic->subscriberCount; ++i)
+	{
+		if(topic->subscribers[i] == sub)
+		{
+			topic->subscribers[i] = topic->subscribers[--topic->subscriberCount];
+			break;
+		}
+	}
+	TopicBusUnlock(lock);
+}
+
+//-----------------------------------------------
+// TopicPublish
+//-----------------------------------------------
+void TopicPublish(Topic* topic, const void* msg)
+{
+	uint32_t sequence = topic->published + 1;
+	TopicSlotHeader* slot;
+	uint32_t i;
+
+	// Sequence number 0 is reserved for slots beeing written
+	if(sequence == 0)
+		sequence = 1;
+	slot = GetSlot(topic, sequence);
+
+	// Invalidate slot while it is rewritten so that lapped readers detect it
+	SeqLockWriteBegin(&slot->lock);
+	slot->timestamp = TopicBusTimestamp();
+	memcpy((uint8_t*)slot + topic->msgOffset, msg, topic->size);
+	SeqLockWriteEnd(&slot->lock, sequence);
+	topic->published = sequence;
+
+	// Notify subscribers
+	intptr_t lock = TopicBusLock();
+	for(i = 0; i < topic->subscriberCount; ++i)
+	{
+		const TopicSubscriber* sub = topic->subscribers[i];
+		if(sub->notify != NULL)
+			sub->notify(sub->arg);
+	}
+	TopicBusUnlock(lock);
+}
+
+//-----------------------------------------------
+// TopicRead
+//-----------------------------------------------
+bool TopicRead(TopicSubscriber* sub, void* msg, uint32_t* timestamp)
+{
+	const Topic* topic = sub->topic;
+	uint32_t published, next;
+
+	while(1)
+	{
+		published = topic->published;
+		if(published == sub->lastSequence)
+			return false;
+
+		// Skip messages which have been overwritten since last read. At most 'depth-1' messages are kept unread: the
+		// slot of the oldest one is the next slot to publish, which a preempted publisher may be rewriting.
+		if(published - sub->lastSequence >= topic->depth)
+		{
+			sub->lost += published - sub->lastSequence - (topic->depth - 1);
+			sub->lastSequence = published - (topic->depth - 1);
+		}
+
+		next = sub->lastSequence + 1;
+		if(next == 0)
+			next = 1;
+
+		if(ReadSlot(topic, next, msg, timestamp))
+			break;
+
+		// Publisher lapped this subscriber meanwhile: message is lost (never retried so that reader can't spin on a slot
+		// beeing rewritten by a lower priority publisher)
+		sub->lost++;
+		sub->lastSequence = next;
+	}
+
+	sub->lastSequence = next;
+	return true;
+}
+
+//-----------------------------------------------
+// TopicReadLatest
+//-----------------------------------------------
+uint32_t TopicReadLatest(const Topic* topic, void* msg, uint32_t* timestamp)
+{
+	uint32_t sequence;
+
+	do
+	{
+		sequence = topic->published;
+		if(sequence == 0)
+			return 0;
+	} while(!ReadSlot(topic, sequence, msg, timestamp));
+
+	return sequence;
+}
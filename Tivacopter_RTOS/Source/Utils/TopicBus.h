@@ -0,0 +1,152 @@
+/*
+ * TopicBus.h
+ * Publish/subscribe topic bus: each topic is a statically allocated ring of fixed-size timestamped messages.
+ * Slots are sequence locked copies (see 'SeqLock.h'): publishing never blocks and readers (any number, each with its
+ * own cursor) never delay the publisher whatever their respective priorities. A single thread must publish to a
+ * given topic.
+ * Topic bus is RTOS-independent: user must implement 'TopicBusLock', 'TopicBusUnlock' and 'TopicBusTimestamp'.
+ */
+
+#ifndef TOPICBUS_H_
+#define TOPICBUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "SeqLock.h"
+
+//-----------------------------------------------
+// Maximum subscriber count per topic
+//-----------------------------------------------
+#define TOPIC_MAX_SUBSCRIBERS		4
+
+//-----------------------------------------------
+// Topic notify callback typedef:
+// Called from publisher's thread each time a
+// message is published (e.g. to post reader's
+// semaphore). Must not block.
+//-----------------------------------------------
+typedef void (*TopicNotifyCallback)(uintptr_t arg);
+
+//-----------------------------------------------
+// Topic slot header typedef:
+// 'lock' version is the sequence number of
+// message held by slot (0 while slot is
+// written). 'timestamp' is given by
+// 'TopicBusTimestamp' when message is
+// published.
+//-----------------------------------------------
+typedef struct
+{
+	SeqLock lock;
+	uint32_t timestamp;
+} TopicSlotHeader;
+
+struct TopicSubscriber;
+
+//-----------------------------------------------
+// Topic structure typedef:
+// Message of sequence number 's' is held by
+// slot (s & (depth-1)). 'published' is the
+// sequence number of last published message
+// (0 means nothing published yet).
+// Topics must be defined with 'TOPIC_DEFINE'.
+//-----------------------------------------------
+typedef struct
+{
+	const char* name;
+	uint32_t size;
+	uint32_t depth;
+	uint32_t stride;
+	uint32_t msgOffset;
+	void* slots;
+	volatile uint32_t published;
+
+	struct TopicSubscriber* volatile subscribers[TOPIC_MAX_SUBSCRIBERS];
+	volatile uint32_t subscriberCount;
+} Topic;
+
+//-----------------------------------------------
+// Topic subscriber structure typedef:
+// 'lastSequence' is the sequence number of last
+// message read by this subscriber and 'lost'
+// counts messages overwritten before they were
+// read.
+//-----------------------------------------------
+typedef struct TopicSubscriber
+{
+	Topic* topic;
+	uint32_t lastSequence;
+	uint32_t lost;
+
+	TopicNotifyCallback notify;
+	uintptr_t arg;
+} TopicSubscriber;
+
+//-----------------------------------------------
+// TOPIC_DEFINE:
+// Statically defines a topic named 'topic' of
+// 'slotCount' messages of 'msgType' type.
+// 'slotCount' must be a power of two (at least
+// 2) as readers may still copy the previous
+// message while a new one is published.
+// e.g. TOPIC_DEFINE(AttitudeTopic, IMUState, 4);
+//-----------------------------------------------
+#define TOPIC_DEFINE(topic, msgType, slotCount)																	\
+	typedef char topic##_SlotCountCheck[((slotCount) >= 2 && ((slotCount) & ((slotCount) - 1)) == 0) ? 1 : -1];	\
+	typedef struct { TopicSlotHeader header; msgType msg; } topic##_Slot;										\
+	static topic##_Slot topic##_Slots[slotCount];																\
+	Topic topic = { .name = #topic, .size = sizeof(msgType), .depth = (slotCount), .stride = sizeof(topic##_Slot),	\
+					.msgOffset = offsetof(topic##_Slot, msg), .slots = topic##_Slots }
+
+//-----------------------------------------------
+// TopicSubscribe:
+// Subscribes 'sub' to 'topic' so that it reads
+// messages published from now on. 'notify' (can
+// be NULL) is called with 'arg' each time a
+// message is published.
+// Returns false if topic have too many
+// subscribers.
+//-----------------------------------------------
+bool TopicSubscribe(Topic* topic, TopicSubscriber* sub, TopicNotifyCallback notify, uintptr_t arg);
+
+//-----------------------------------------------
+// TopicUnsubscribe:
+// Stops notifying given subscriber.
+//-----------------------------------------------
+void TopicUnsubscribe(TopicSubscriber* sub);
+
+//-----------------------------------------------
+// TopicPublish:
+// Copies 'msg' to the next topic slot with its
+// timestamp and notifies subscribers.
+//-----------------------------------------------
+void TopicPublish(Topic* topic, const void* msg);
+
+//-----------------------------------------------
+// TopicRead:
+// Copies the oldest message subscriber haven't
+// read yet to 'msg' (and its timestamp to
+// 'timestamp' if not NULL). Messages which have
+// been (or are being) overwritten are skipped
+// and counted in 'lost': at most 'depth-1'
+// messages are kept unread. Returns false
+// without copying anything if there is no new
+// message. Never spins on a message, whatever
+// publisher and reader priorities.
+//-----------------------------------------------
+bool TopicRead(TopicSubscriber* sub, void* msg, uint32_t* timestamp);
+
+//-----------------------------------------------
+// TopicReadLatest:
+// Copies last published message to 'msg' (and
+// its timestamp to 'timestamp' if not NULL) and
+// returns its sequence number, or returns 0
+// without copying anything if nothing have been
+// published yet. Never blocks: copy is retried
+// if message is overwritten meanwhile.
+//-----------------------------------------------
+uint32_t TopicReadLatest(const Topic* topic, void* msg, uint32_t* timestamp);
+
+#endif /* TOPICBUS_H_ */
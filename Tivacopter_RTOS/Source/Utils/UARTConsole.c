@@ -14,14 +14,18 @@
 
 #include "inc/tm4c1294ncpdt.h"
 #include "inc/hw_memmap.h"
+#include "inc/hw_uart.h"
 #include "driverlib/debug.h"
 #include "driverlib/rom.h"
 #include "driverlib/rom_map.h"
 #include "driverlib/sysctl.h"
 #include "driverlib/uart.h"
 #include "driverlib/gpio.h"
+#include "driverlib/udma.h"
+#include "driverlib/interrupt.h"
 
 #include "UARTConsole.h"
+#include "utils.h"
 
 //--------------------------------------------
 // Macros to advance receive or tranmit buffer
@@ -30,6 +34,12 @@
 #define ADVANCE_TX_BUFFER_INDEX(Index)	(Index) = ((Index) + 1) % UART_TX_BUFFER_SIZE
 #define ADVANCE_RX_BUFFER_INDEX(Index)	(Index) = ((Index) + 1) % UART_RX_BUFFER_SIZE
 
+//--------------------------------------------
+// Maximum item count of a single uDMA
+// transfer
+//--------------------------------------------
+#define UDMA_MAX_TRANSFER_SIZE			1024
+
 //-------------------------------------------
 // A mapping from an integer between 0 and 15
 // to its ASCII character equivalent
@@ -57,8 +67,19 @@ static const uint32_t UARTPeriphs[4] = { SYSCTL_PERIPH_UART0, SYSCTL_PERIPH_UART
 // Static function forward declarations
 //------------------------------------------
 static void CmdLineProcess(UARTConsole* console, char *input, uint32_t length);
+static uint32_t HashCmdName(const char* name);
+static void AddCmdEntry(UARTConsole* console, const CmdLineEntry* entry);
+static const CmdLineEntry* FindCmd(UARTConsole* console, const char* name);
 static void NotifyCharacterReceived(UARTConsole* console, char c);
+static void ProcessReceivedChar(UARTConsole* console, unsigned char c);
+static void ProcessDMARxBuffers(UARTConsole* console);
 static void UARTPrimeTransmit(UARTConsole* console);
+static void UARTStartTransmit(UARTConsole* console);
+static void RingCopy(char* buffer, uint32_t size, uint32_t offset, const char* src, uint32_t length);
+static uint32_t RingWrite(char* buffer, uint32_t size, uint32_t offset, uint32_t freeSpace, const char* pcBuf, uint32_t ui32Len, bool translate, uint32_t* pui32Used);
+static int TxWrite(UARTConsole* console, const char *pcBuf, uint32_t ui32Len, bool translate);
+static void PublishTxRing(UARTConsole* console, UARTTxRing* ring);
+static void MergeTxRings(UARTConsole* console);
 static bool IsBufferEmpty(volatile uint32_t *pui32Read, volatile uint32_t *pui32Write);
 static bool IsBufferFull(volatile uint32_t *pui32Read, volatile uint32_t *pui32Write, uint32_t ui32Size);
 static uint32_t GetBufferCount(volatile uint32_t *pui32Read, volatile uint32_t *pui32Write, uint32_t ui32Size);
@@ -88,6 +109,13 @@ void UARTConsoleConfig(UARTConsole* console, uint32_t PortNum, uint32_t SrcClock
 	console->UARTBase = UARTBases[PortNum];
 	console->CmdLineInterfaceDisabled = false; // Echo flag isn't raised until a command is received
 	console->IsAbortRequested = false;
+	console->TxLowWaterMark = UART_TX_LOW_WATER_MARK;
+	console->TxDrained = NULL;
+	console->TxWait = NULL;
+	console->TxWaitersCount = 0;
+	console->IsInIntHandler = false;
+	console->DMAEnabled = false;
+	console->DMATxLength = 0;
 
 	// Enable the UART peripheral for use.
 	MAP_SysCtlPeripheralEnable(UARTPeriphs[PortNum]);
@@ -115,78 +143,299 @@ void UARTConsoleConfig(UARTConsole* console, uint32_t PortNum, uint32_t SrcClock
 }
 
 //---------------------------------------------------------------------------
-// Suscribe command:
-// Add a command line entry to a dynamic command table of specified console.
-// Returns false if dynamic memory allocation failed.
+// UARTConsoleEnableDMA:
+// Makes specified console use uDMA for both transmission and reception.
+// Transmission is done by uDMA straight out of console transmit buffer and
+// reception uses two ping-pong buffers so that UART interrupts only occur on
+// uDMA transfers completion or on receive timeout (end of a burst).
+// RxChannel and TxChannel are uDMA channel mappings (e.g. UDMA_CH16_UART3RX
+// and UDMA_CH17_UART3TX).
+// This function must be called after UARTConsoleConfig and assumes that the
+// caller has previously enabled uDMA controller and set its control table.
 //---------------------------------------------------------------------------
-bool SubscribeCmd(UARTConsole* console, const char* name, CmdApp app, const char* help)
+void UARTConsoleEnableDMA(UARTConsole* console, uint32_t RxChannel, uint32_t TxChannel)
 {
 	ASSERT(console != NULL);
-	ASSERT(app != NULL);
-	ASSERT(name != "" && name != NULL);
 
-	// If there is no more available space in dynamic command array, we allocate more memory.
-	if (console->CmdTable.used == console->CmdTable.size)
-	{
-		console->CmdTable.size += 4;
-		console->CmdTable.array = (CmdLineEntry *)realloc(console->CmdTable.array, console->CmdTable.size * sizeof(CmdLineEntry));
+	console->DMARxChannel = RxChannel & 0xFF;
+	console->DMATxChannel = TxChannel & 0xFF;
+	console->DMARxActive = 0;
+	console->DMARxProcessed = 0;
+	console->DMATxLength = 0;
 
-		// Verify wether if any error occured during memory allocation.
-		if (console->CmdTable.array == NULL)
-		{
-			console->CmdTable.size = 0;
-			console->CmdTable.used = 0;
-			free(console->CmdTable.array);
-			return false;
-		}
-	}
+	MAP_UARTIntDisable(console->UARTBase, 0xFFFFFFFF);
 
-	CmdLineEntry* newCmd = &console->CmdTable.array[console->CmdTable.used++];
-	newCmd->name = name;
-	newCmd->app = app;
-	newCmd->help = help;
+	// Assign uDMA channels to console's UART
+	MAP_uDMAChannelAssign(RxChannel);
+	MAP_uDMAChannelAssign(TxChannel);
+
+	// Receive channel only answers to burst requests so that the last characters of a burst stay in receive FIFO and trigger a receive timeout.
+	MAP_uDMAChannelAttributeDisable(console->DMARxChannel, UDMA_ATTR_ALTSELECT | UDMA_ATTR_HIGH_PRIORITY | UDMA_ATTR_REQMASK);
+	MAP_uDMAChannelAttributeEnable(console->DMARxChannel, UDMA_ATTR_USEBURST);
+	MAP_uDMAChannelControlSet(console->DMARxChannel | UDMA_PRI_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_8);
+	MAP_uDMAChannelControlSet(console->DMARxChannel | UDMA_ALT_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_8);
+	MAP_uDMAChannelTransferSet(console->DMARxChannel | UDMA_PRI_SELECT, UDMA_MODE_PINGPONG, (void *)(console->UARTBase + UART_O_DR), console->DMARxBuffers[0], UART_DMA_RX_BUFFER_SIZE);
+	MAP_uDMAChannelTransferSet(console->DMARxChannel | UDMA_ALT_SELECT, UDMA_MODE_PINGPONG, (void *)(console->UARTBase + UART_O_DR), console->DMARxBuffers[1], UART_DMA_RX_BUFFER_SIZE);
+
+	// Transmit channel transfers are started by 'UARTPrimeTransmit'
+	MAP_uDMAChannelAttributeDisable(console->DMATxChannel, UDMA_ATTR_ALL);
+	MAP_uDMAChannelControlSet(console->DMATxChannel | UDMA_PRI_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_8 | UDMA_DST_INC_NONE | UDMA_ARB_4);
+
+	// uDMA burst requests occur when FIFOs are half full (receive) or half empty (transmit)
+	MAP_UARTFIFOLevelSet(console->UARTBase, UART_FIFO_TX4_8, UART_FIFO_RX4_8);
+	MAP_UARTDMAEnable(console->UARTBase, UART_DMA_RX | UART_DMA_TX);
+	MAP_uDMAChannelEnable(console->DMARxChannel);
+
+	console->DMAEnabled = true;
+
+	// Interrupts only occur on receive ping-pong buffer completion, receive timeout and transmit transfer completion.
+	MAP_UARTIntEnable(console->UARTBase, UART_INT_DMARX | UART_INT_RT);
+	UARTStartTransmit(console);
+}
+
+//----------------------------------------------------------------------------
+// Set transmit backpressure callbacks:
+// Registers user-defined callbacks used by 'UARTwriteTimeout' to block until
+// transmit buffer drained below 'lowWaterMark' bytes.
+// 'drained' is called from UART console interrupt handler thread so it must
+// not block.
+//----------------------------------------------------------------------------
+void SetTxBackpressureCallbacks(UARTConsole* console, uint32_t lowWaterMark, TxDrainedCallback drained, TxWaitCallback wait)
+{
+	ASSERT(console != NULL);
+	ASSERT(lowWaterMark < UART_TX_BUFFER_SIZE);
+	ASSERT((drained == NULL) == (wait == NULL));
+
+	console->TxWaitersCount = 0;
+	console->TxLowWaterMark = lowWaterMark;
+	console->TxDrained = drained;
+	console->TxWait = wait;
+}
+
+//---------------------------------------------------------------------------
+// Add transmit ring:
+// Registers a producer ring using given buffer ('size' must be a power of
+// two) to specified console.
+// Returns false if console already has UART_MAX_TX_RINGS rings.
+//---------------------------------------------------------------------------
+bool UARTConsoleAddTxRing(UARTConsole* console, UARTTxRing* ring, char* buffer, uint32_t size)
+{
+	ASSERT(console != NULL);
+	ASSERT(ring != NULL);
+	ASSERT(buffer != NULL);
+	ASSERT(size != 0 && (size & (size - 1)) == 0);
+
+	if(console->TxRingCount >= UART_MAX_TX_RINGS)
+		return false;
+
+	ring->buffer = buffer;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->pendingHead = 0;
+	ring->holdCount = 0;
+
+	// Temporarily turn off interrupts so that interrupt handler never sees a partially registered ring.
+	uint32_t ui32Int = MAP_IntMasterDisable();
+	console->TxRings[console->TxRingCount++] = ring;
+	if(!ui32Int)
+		MAP_IntMasterEnable();
 
 	return true;
 }
 
+//---------------------------------------------------------------------------
+// Set transmit ring selector:
+// Registers the callback used by write functions to find calling thread
+// producer ring.
+//---------------------------------------------------------------------------
+void SetTxRingSelector(UARTConsole* console, TxRingSelector selector)
+{
+	ASSERT(console != NULL);
+
+	console->TxRingSelect = selector;
+}
+
+//---------------------------------------------------------------------------
+// Hold transmission:
+// Delays publication of calling thread writes until 'UARTReleaseTx'.
+//---------------------------------------------------------------------------
+void UARTHoldTx(UARTConsole* console)
+{
+	ASSERT(console != NULL);
+
+	UARTTxRing* ring = console->TxRingSelect != NULL ? console->TxRingSelect() : NULL;
+	if(ring != NULL)
+		ring->holdCount++;
+}
+
+//---------------------------------------------------------------------------
+// Release transmission:
+// Publishes calling thread writes done since outermost 'UARTHoldTx' call.
+//---------------------------------------------------------------------------
+void UARTReleaseTx(UARTConsole* console)
+{
+	ASSERT(console != NULL);
+
+	UARTTxRing* ring = console->TxRingSelect != NULL ? console->TxRingSelect() : NULL;
+	if(ring != NULL)
+	{
+		ASSERT(ring->holdCount != 0);
+		if(--ring->holdCount == 0)
+			PublishTxRing(console, ring);
+	}
+}
+
+//---------------------------------------------------------------------------
+// Suscribe command:
+// Add a command line entry to the command table of specified console.
+// Returns false if console command table is full.
+//---------------------------------------------------------------------------
+bool SubscribeCmd(UARTConsole* console, const char* name, CmdApp app, const char* help)
+{
+	return SubscribeListeningCmd(console, name, app, help, NULL, NULL);
+}
+
 //---------------------------------------------------------------------------
 // Suscribe listening command:
 // Add a command line entry, which can listen for any received character
-// among the given array, to a dynamic command table of specified console.
-// Returns false if dynamic memory allocation failed.
+// among the given array, to the command table of specified console.
+// If 'interestingChars' is NULL, every received character is given to 'cb'
+// instead of being stored in receive buffer (streaming command).
+// Returns false if console command table is full.
 //---------------------------------------------------------------------------
 bool SubscribeListeningCmd(UARTConsole* console, const char* name, CmdApp app, const char* help, const char* interestingChars, ListeningCallback cb)
 {
+	uint32_t ui32Int;
+
 	ASSERT(console != NULL);
 	ASSERT(app != NULL);
-	ASSERT(name != "" && name != NULL);
+	ASSERT(name != NULL && name[0] != '\0');
 
-	// If there is no more available space in dynamic command array, we allocate more memory.
-	if (console->CmdTable.used == console->CmdTable.size)
-	{
-		console->CmdTable.size += 4;
-		console->CmdTable.array = (CmdLineEntry *)realloc(console->CmdTable.array, console->CmdTable.size * sizeof(CmdLineEntry));
+	// Temporarily turn off interrupts so that command line process never sees a partially registered command.
+	ui32Int = MAP_IntMasterDisable();
 
-		// Verify wether if any error occured during memory allocation.
-		if (console->CmdTable.array == NULL)
-		{
-			console->CmdTable.size = 0;
-			console->CmdTable.used = 0;
-			free(console->CmdTable.array);
-			return false;
-		}
+	if(console->CmdTable.poolUsed >= UART_CONSOLE_MAX_CMD_COUNT || console->CmdTable.used >= UART_CONSOLE_MAX_CMD_COUNT)
+	{
+		if(!ui32Int)
+			MAP_IntMasterEnable();
+		return false;
 	}
 
-	CmdLineEntry* newCmd = &console->CmdTable.array[console->CmdTable.used++];
+	CmdLineEntry* newCmd = &console->CmdTable.pool[console->CmdTable.poolUsed++];
 	newCmd->name = name;
 	newCmd->app = app;
 	newCmd->help = help;
 	newCmd->interestingChars = interestingChars;
 	newCmd->cb = cb;
+	AddCmdEntry(console, newCmd);
+
+	if(!ui32Int)
+		MAP_IntMasterEnable();
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Suscribe command table:
+// Registers a static array of command line entries to the command table of
+// specified console. Entries aren't copied: 'table' must remain valid as
+// long as the console is used.
+// Returns false if console command table can't hold every entry.
+//---------------------------------------------------------------------------
+bool SubscribeCmdTable(UARTConsole* console, const CmdLineEntry table[], uint32_t count)
+{
+	uint32_t ui32Int;
+	uint32_t i;
+
+	ASSERT(console != NULL);
+	ASSERT(table != NULL || count == 0);
+
+	ui32Int = MAP_IntMasterDisable();
+
+	if(console->CmdTable.used + count > UART_CONSOLE_MAX_CMD_COUNT)
+	{
+		if(!ui32Int)
+			MAP_IntMasterEnable();
+		return false;
+	}
+
+	for(i = 0; i < count; ++i)
+	{
+		ASSERT(table[i].app != NULL);
+		ASSERT(table[i].name != NULL && table[i].name[0] != '\0');
+		AddCmdEntry(console, &table[i]);
+	}
+
+	if(!ui32Int)
+		MAP_IntMasterEnable();
 
 	return true;
 }
 
+//---------------------------------------------------------------------------
+// Hash command name:
+// 32 bit FNV-1a hash of a command name.
+//---------------------------------------------------------------------------
+static uint32_t HashCmdName(const char* name)
+{
+	uint32_t hash = 2166136261u;
+
+	while(*name != '\0')
+	{
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+//---------------------------------------------------------------------------
+// Add command entry:
+// Appends given entry to console command table and inserts it in command
+// hash index (linear probing). Caller must have disabled interrupts and
+// checked that command table isn't full.
+//---------------------------------------------------------------------------
+static void AddCmdEntry(UARTConsole* console, const CmdLineEntry* entry)
+{
+	uint32_t entryIdx = console->CmdTable.used;
+	uint32_t hash = HashCmdName(entry->name);
+	uint32_t slot = hash & (UART_CONSOLE_CMD_INDEX_SIZE - 1);
+
+	console->CmdTable.entries[entryIdx] = entry;
+	console->CmdTable.hashes[entryIdx] = hash;
+
+	// Index can't be full as it is bigger than command table.
+	while(console->CmdTable.index[slot] != 0)
+		slot = (slot + 1) & (UART_CONSOLE_CMD_INDEX_SIZE - 1);
+	console->CmdTable.index[slot] = (uint8_t)(entryIdx + 1);
+
+	console->CmdTable.used = entryIdx + 1;
+}
+
+//---------------------------------------------------------------------------
+// Find command:
+// Looks for a command named 'name' in console command hash index. If
+// several commands have the same name, the first registered one is
+// returned. Returns NULL if there isn't any matching command.
+//---------------------------------------------------------------------------
+static const CmdLineEntry* FindCmd(UARTConsole* console, const char* name)
+{
+	uint32_t hash = HashCmdName(name);
+	uint32_t slot = hash & (UART_CONSOLE_CMD_INDEX_SIZE - 1);
+	uint8_t entryIdx;
+
+	// Probe until an empty slot is found (compare names only if hashes match).
+	while((entryIdx = console->CmdTable.index[slot]) != 0)
+	{
+		if(console->CmdTable.hashes[entryIdx - 1] == hash && !strcmp(console->CmdTable.entries[entryIdx - 1]->name, name))
+			return console->CmdTable.entries[entryIdx - 1];
+		slot = (slot + 1) & (UART_CONSOLE_CMD_INDEX_SIZE - 1);
+	}
+
+	return NULL;
+}
+
 //---------------------------------------------------------------------------
 // Check argument count:
 // This function must be called by user if argument count verification is
@@ -295,120 +544,193 @@ void EnableCmdLineInterface(UARTConsole* console)
 //---------------------------------------------------------------------------
 void ConsoleUARTIntHandler(UARTConsole* console, uint32_t IntStatus)
 {
-	int8_t cChar;
-	int32_t i32Char;
-	static bool bLastWasCR = false;
-	static char buffer[UART_RX_BUFFER_SIZE+1];
-
 	ASSERT(console != NULL);
 
-	// Are we being interrupted because the TX FIFO has space available?
-	if(IntStatus & UART_INT_TX)
+	console->IsInIntHandler = true;
+
+	// Merge writes published by producer rings into transmit buffer (producers pend UART interrupt once they published a write).
+	MergeTxRings(console);
+
+	// Are we being interrupted because the TX FIFO has space available or because a transmit uDMA transfer is done?
+	if(IntStatus & (UART_INT_TX | UART_INT_DMATX))
 	{
-		// Move as many bytes as we can into the transmit FIFO.
+		// Move as many bytes as we can into the transmit FIFO (or start next transmit uDMA transfer).
 		UARTPrimeTransmit(console);
 
 		// If the output buffer is empty, turn off the transmit interrupt.
 		if(IsBufferEmpty(&console->UARTTxReadIndex, &console->UARTTxWriteIndex))
-			MAP_UARTIntDisable(console->UARTBase, UART_INT_TX);
+			MAP_UARTIntDisable(console->UARTBase, console->DMAEnabled ? UART_INT_DMATX : UART_INT_TX);
+
+		// Release blocked writers (if any) once transmit buffer drained below its low-water mark (waiters count is only
+		// decremented by leaving writers, so that concurrent waiters aren't forgotten when a single one is woken up).
+		if(console->TxWaitersCount != 0 && GetBufferCount(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE) <= console->TxLowWaterMark)
+			console->TxDrained();
 	}
 
-	// Are we being interrupted due to a received character?
-	if(IntStatus & (UART_INT_RX | UART_INT_RT))
+	// Are we being interrupted due to a received character or a receive uDMA ping-pong buffer completion?
+	if(IntStatus & (UART_INT_RX | UART_INT_RT | UART_INT_DMARX))
 	{
-		// Get all the available characters from the UART.
-		while(MAP_UARTCharsAvail(console->UARTBase))
+		if(console->DMAEnabled)
 		{
-			// Read a character
-			i32Char = MAP_UARTCharGetNonBlocking(console->UARTBase);
-			cChar = (unsigned char)(i32Char & 0xFF);
+			// Process characters stored by uDMA in ping-pong buffers.
+			ProcessDMARxBuffers(console);
 
-			// If command line interface is disabled, we skip the various text filtering  operations.
-			if(!console->CmdLineInterfaceDisabled)
+			// Receive timeout means less than a uDMA burst remains in receive FIFO: we read it directly while uDMA requests are disabled so that characters order is kept.
+			if(IntStatus & UART_INT_RT)
 			{
-				console->IsAbortRequested = false;
-
-				// Handle backspace by erasing the last character in the buffer.
-				if(cChar == '\b')
-				{
-					// If there are any characters already in the buffer, then delete the last.
-					if(!IsBufferEmpty(&console->UARTRxReadIndex, &console->UARTRxWriteIndex))
-					{
-						// Rub out the previous character on the users terminal.
-						UARTwrite(console, "\b \b", 3);
-
-						// Decrement the number of characters in the buffer.
-						if(console->UARTRxWriteIndex == 0)
-							console->UARTRxWriteIndex = UART_RX_BUFFER_SIZE - 1;
-						else
-							console->UARTRxWriteIndex--;
-					}
+				MAP_UARTDMADisable(console->UARTBase, UART_DMA_RX);
+				ProcessDMARxBuffers(console);
+				while(MAP_UARTCharsAvail(console->UARTBase))
+					ProcessReceivedChar(console, (unsigned char)(MAP_UARTCharGetNonBlocking(console->UARTBase) & 0xFF));
+				MAP_UARTDMAEnable(console->UARTBase, UART_DMA_RX);
+			}
+		}
+		else
+		{
+			// Get all the available characters from the UART.
+			while(MAP_UARTCharsAvail(console->UARTBase))
+				ProcessReceivedChar(console, (unsigned char)(MAP_UARTCharGetNonBlocking(console->UARTBase) & 0xFF));
+		}
+	}
 
-					// Skip ahead to read the next character.
-					continue;
-				}
+	// If we wrote or merged anything to the transmit buffer, make sure it actually gets transmitted.
+	UARTStartTransmit(console);
 
-				// If this character is LF and last was CR, then just gobble up the character since we already
-				// echoed the previous CR and we don't want to store 2 characters in the buffer if we don't need to.
-				if((cChar == '\n') && bLastWasCR)
-				{
-					bLastWasCR = false;
-					continue;
-				}
+	console->IsInIntHandler = false;
+}
 
-				// See if a newline or escape character was received.
-				if((cChar == '\r') || (cChar == '\n') || (cChar == 0x1b))
-				{
-					// If the character is a CR, then it may be followed by an  LF which should be paired with
-					// the CR.  So remember that a CR was received.
-					if(cChar == '\r')
-						bLastWasCR = 1;
-
-					// Regardless of the line termination character received, put a CR in the receive buffer as a
-					// marker telling UARTgets() where the line ends. We also send an additional LF to ensure that
-					// the local terminal echo receives both CR and LF.
-					UARTwrite(console, "\n\r", 2);
-					console->UARTRxBuffer[console->UARTRxWriteIndex] = '\r';
-					ADVANCE_RX_BUFFER_INDEX(console->UARTRxWriteIndex);
-
-					//TODO: pas super optimis >.< et peut poser des problmes si l'utilisateur s'amuse  utiliser les fonctions pour lire les buffers en mme temps
-					// Parse and execute received command
-					uint32_t length = UARTgets(console, buffer, UART_RX_BUFFER_SIZE);
-					CmdLineProcess(console, buffer, length);
-
-					// Skip ahead to read the next character.
-					continue;
-				}
-			}
-			// else, if CTRL+C (ETX=0x03) character have been sent, we raise abrot requested flag
-			else if(cChar == '\x03')
-			{
-				console->IsAbortRequested = true;
-				continue;
-			}
+//----------------------------------------------------------------------------
+// Process received character:
+// Handles console special characters (backspace, newlines, CTRL+C), stores
+// received character in receive buffer, echoes it and notifies currently
+// running command if it is listening to this character.
+//----------------------------------------------------------------------------
+static void ProcessReceivedChar(UARTConsole* console, unsigned char c)
+{
+	static bool bLastWasCR = false;
+	static char buffer[UART_RX_BUFFER_SIZE+1];
+	int8_t cChar = (int8_t)c;
 
+	// If command line interface is disabled, we skip the various text filtering  operations.
+	if(!console->CmdLineInterfaceDisabled)
+	{
+		console->IsAbortRequested = false;
 
-			// If there is space in the receive buffer, put the character there, otherwise throw it away.
-			if(!IsBufferFull(&console->UARTRxReadIndex, &console->UARTRxWriteIndex, UART_RX_BUFFER_SIZE))
+		// Handle backspace by erasing the last character in the buffer.
+		if(cChar == '\b')
+		{
+			// If there are any characters already in the buffer, then delete the last.
+			if(!IsBufferEmpty(&console->UARTRxReadIndex, &console->UARTRxWriteIndex))
 			{
-				// Store the new character in the receive buffer
-				console->UARTRxBuffer[console->UARTRxWriteIndex] = (unsigned char)(i32Char & 0xFF);
-				ADVANCE_RX_BUFFER_INDEX(console->UARTRxWriteIndex);
-
-				// If console is enabled, write the character to the transmit
-				// buffer so that the user gets some immediate feedback (echo).
-				if(!console->CmdLineInterfaceDisabled)
-					UARTwrite(console, (const char *)&cChar, 1);
-				// Else, notify the running command that we received a character if this command is listenning to this specific character
+				// Rub out the previous character on the users terminal.
+				UARTwrite(console, "\b \b", 3);
+
+				// Decrement the number of characters in the buffer.
+				if(console->UARTRxWriteIndex == 0)
+					console->UARTRxWriteIndex = UART_RX_BUFFER_SIZE - 1;
 				else
-					NotifyCharacterReceived(console, cChar);
+					console->UARTRxWriteIndex--;
 			}
+
+			// Skip ahead to read the next character.
+			return;
 		}
 
-		// If we wrote anything to the transmit buffer, make sure it actually gets transmitted.
-		UARTPrimeTransmit(console);
-		MAP_UARTIntEnable(console->UARTBase, UART_INT_TX);
+		// If this character is LF and last was CR, then just gobble up the character since we already
+		// echoed the previous CR and we don't want to store 2 characters in the buffer if we don't need to.
+		if((cChar == '\n') && bLastWasCR)
+		{
+			bLastWasCR = false;
+			return;
+		}
+
+		// See if a newline or escape character was received.
+		if((cChar == '\r') || (cChar == '\n') || (cChar == 0x1b))
+		{
+			// If the character is a CR, then it may be followed by an  LF which should be paired with
+			// the CR.  So remember that a CR was received.
+			if(cChar == '\r')
+				bLastWasCR = 1;
+
+			// Regardless of the line termination character received, put a CR in the receive buffer as a
+			// marker telling UARTgets() where the line ends. We also send an additional LF to ensure that
+			// the local terminal echo receives both CR and LF.
+			UARTwrite(console, "\n\r", 2);
+			console->UARTRxBuffer[console->UARTRxWriteIndex] = '\r';
+			ADVANCE_RX_BUFFER_INDEX(console->UARTRxWriteIndex);
+
+			//TODO: pas super optimis >.< et peut poser des problmes si l'utilisateur s'amuse  utiliser les fonctions pour lire les buffers en mme temps
+			// Parse and execute received command
+			uint32_t length = UARTgets(console, buffer, UART_RX_BUFFER_SIZE);
+			CmdLineProcess(console, buffer, length);
+
+			// Skip ahead to read the next character.
+			return;
+		}
+	}
+	// else, if CTRL+C (ETX=0x03) character have been sent, we raise abrot requested flag
+	else if(cChar == '\x03')
+	{
+		console->IsAbortRequested = true;
+		return;
 	}
+	// else, if running command is a streaming command, we give it the character without buffering it
+	else if(console->CurrentlyRunningCmd != NULL && console->CurrentlyRunningCmd->cb != NULL && console->CurrentlyRunningCmd->interestingChars == NULL)
+	{
+		console->CurrentlyRunningCmd->cb(cChar);
+		return;
+	}
+
+	// If there is space in the receive buffer, put the character there, otherwise throw it away.
+	if(!IsBufferFull(&console->UARTRxReadIndex, &console->UARTRxWriteIndex, UART_RX_BUFFER_SIZE))
+	{
+		// Store the new character in the receive buffer
+		console->UARTRxBuffer[console->UARTRxWriteIndex] = c;
+		ADVANCE_RX_BUFFER_INDEX(console->UARTRxWriteIndex);
+
+		// If console is enabled, write the character to the transmit
+		// buffer so that the user gets some immediate feedback (echo).
+		if(!console->CmdLineInterfaceDisabled)
+			UARTwrite(console, (const char *)&cChar, 1);
+		// Else, notify the running command that we received a character if this command is listenning to this specific character
+		else
+			NotifyCharacterReceived(console, cChar);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Process DMA receive buffers:
+// Processes characters stored by uDMA in receive ping-pong buffers since last
+// call. Completed buffers are processed and given back to uDMA, then newly
+// received characters of the buffer being filled are processed.
+//----------------------------------------------------------------------------
+static void ProcessDMARxBuffers(UARTConsole* console)
+{
+	uint32_t received;
+	uint32_t select = console->DMARxActive ? UDMA_ALT_SELECT : UDMA_PRI_SELECT;
+
+	// Process completed ping-pong buffers and give them back to uDMA
+	while(MAP_uDMAChannelModeGet(console->DMARxChannel | select) == UDMA_MODE_STOP)
+	{
+		for(received = console->DMARxProcessed; received < UART_DMA_RX_BUFFER_SIZE; ++received)
+			ProcessReceivedChar(console, console->DMARxBuffers[console->DMARxActive][received]);
+
+		MAP_uDMAChannelTransferSet(console->DMARxChannel | select, UDMA_MODE_PINGPONG, (void *)(console->UARTBase + UART_O_DR),
+									console->DMARxBuffers[console->DMARxActive], UART_DMA_RX_BUFFER_SIZE);
+
+		console->DMARxActive = !console->DMARxActive;
+		console->DMARxProcessed = 0;
+		select = console->DMARxActive ? UDMA_ALT_SELECT : UDMA_PRI_SELECT;
+	}
+
+	// If both buffers were completed, uDMA stopped the channel so we restart it.
+	if(!MAP_uDMAChannelIsEnabled(console->DMARxChannel))
+		MAP_uDMAChannelEnable(console->DMARxChannel);
+
+	// Process characters already stored in the buffer being filled
+	received = UART_DMA_RX_BUFFER_SIZE - MAP_uDMAChannelSizeGet(console->DMARxChannel | select);
+	for(; console->DMARxProcessed < received; console->DMARxProcessed++)
+		ProcessReceivedChar(console, console->DMARxBuffers[console->DMARxActive][console->DMARxProcessed]);
 }
 
 //----------------------------------------------------------------------------
@@ -420,7 +742,7 @@ void ConsoleUARTIntHandler(UARTConsole* console, uint32_t IntStatus)
 static void NotifyCharacterReceived(UARTConsole* console, char c)
 {
 	if(console->CurrentlyRunningCmd != NULL && console->CmdLineInterfaceDisabled)
-		if(strchr(console->CurrentlyRunningCmd->interestingChars, c) != NULL)
+		if(console->CurrentlyRunningCmd->cb != NULL && console->CurrentlyRunningCmd->interestingChars != NULL && strchr(console->CurrentlyRunningCmd->interestingChars, c) != NULL)
 			console->CurrentlyRunningCmd->cb(c);
 }
 
@@ -499,6 +821,34 @@ static void UARTPrimeTransmit(UARTConsole* console)
 {
 	ASSERT(console != NULL);
 
+	// If uDMA is used, we release bytes of the last transfer once done and give the next contiguous part of transmit buffer to uDMA.
+	if(console->DMAEnabled)
+	{
+		MAP_IntDisable(UARTInts[console->PortNum]);
+
+		if(console->DMATxLength != 0 && !MAP_uDMAChannelIsEnabled(console->DMATxChannel))
+		{
+			console->UARTTxReadIndex = (console->UARTTxReadIndex + console->DMATxLength) % UART_TX_BUFFER_SIZE;
+			console->DMATxLength = 0;
+		}
+
+		if(console->DMATxLength == 0 && !IsBufferEmpty(&console->UARTTxReadIndex, &console->UARTTxWriteIndex))
+		{
+			const uint32_t ui32Write = console->UARTTxWriteIndex;
+			const uint32_t ui32Read = console->UARTTxReadIndex;
+			uint32_t length = (ui32Write > ui32Read ? ui32Write : UART_TX_BUFFER_SIZE) - ui32Read;
+			if(length > UDMA_MAX_TRANSFER_SIZE)
+				length = UDMA_MAX_TRANSFER_SIZE;
+
+			MAP_uDMAChannelTransferSet(console->DMATxChannel | UDMA_PRI_SELECT, UDMA_MODE_BASIC, &console->UARTTxBuffer[ui32Read], (void *)(console->UARTBase + UART_O_DR), length);
+			console->DMATxLength = length;
+			MAP_uDMAChannelEnable(console->DMATxChannel);
+		}
+
+		MAP_IntEnable(UARTInts[console->PortNum]);
+		return;
+	}
+
 	// Do we have any data to transmit?
 	if(!IsBufferEmpty(&console->UARTTxReadIndex, &console->UARTTxWriteIndex))
 	{
@@ -517,6 +867,22 @@ static void UARTPrimeTransmit(UARTConsole* console)
 	}
 }
 
+//--------------------------------------------
+// UARTStartTransmit:
+// Makes sure that transmit buffer content
+// gets transmitted by priming transmission
+// and enabling transmit interrupt (or uDMA
+// transfer completion interrupt).
+//--------------------------------------------
+static void UARTStartTransmit(UARTConsole* console)
+{
+	if(!IsBufferEmpty(&console->UARTTxReadIndex, &console->UARTTxWriteIndex))
+	{
+		UARTPrimeTransmit(console);
+		MAP_UARTIntEnable(console->UARTBase, console->DMAEnabled ? UART_INT_DMATX : UART_INT_TX);
+	}
+}
+
 //---------------------------------------------------------------------------
 // Writes a string of characters to the UART output.
 //
@@ -539,56 +905,264 @@ static void UARTPrimeTransmit(UARTConsole* console)
 // immediately.  If insufficient space remains in the transmit buffer,
 // additional characters are discarded.
 //
+// If a transmit ring selector has been registered, characters are written to
+// calling thread producer ring (if any) and merged into the transmit buffer by
+// UART console interrupt handler.
+//
 // \return Returns the count of characters written.
 //---------------------------------------------------------------------------
 int UARTwrite(UARTConsole* console, const char *pcBuf, uint32_t ui32Len)
 {
-	unsigned int uIdx;
+	return TxWrite(console, pcBuf, ui32Len, true);
+}
+
+//---------------------------------------------------------------------------
+// Writes a buffer to the UART output without any translation.
+//
+// This function behaves like UARTwrite() except that LF characters aren't
+// replaced with CRLF pairs, so that it can be used by binary protocols.
+//
+// \return Returns the count of bytes written.
+//---------------------------------------------------------------------------
+int UARTwriteRaw(UARTConsole* console, const char *pcBuf, uint32_t ui32Len)
+{
+	return TxWrite(console, pcBuf, ui32Len, false);
+}
+
+//---------------------------------------------------------------------------
+// Transmit write:
+// Copies characters (optionally translating LF to CRLF) to calling thread
+// producer ring or, if it doesn't have any, directly to transmit buffer.
+//---------------------------------------------------------------------------
+static int TxWrite(UARTConsole* console, const char *pcBuf, uint32_t ui32Len, bool translate)
+{
+	UARTTxRing* ring;
+	uint32_t written, used;
 
 	ASSERT(console != NULL);
 	ASSERT(pcBuf != NULL);
 
-	// Send the characters
-	for(uIdx = 0; uIdx < ui32Len; uIdx++)
+	ring = console->TxRingSelect != NULL ? console->TxRingSelect() : NULL;
+
+	if(ring == NULL)
 	{
-		// If the character to the UART is \n, then add a \r before it so that \n is translated to \n\r in the output.
-		if(pcBuf[uIdx] == '\n')
+		// Bulk copy as many characters as fit in transmit buffer (one slot is kept empty to tell a full buffer from an empty one).
+		written = RingWrite((char*)console->UARTTxBuffer, UART_TX_BUFFER_SIZE, console->UARTTxWriteIndex,
+							UART_TX_BUFFER_SIZE - 1 - GetBufferCount(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE),
+							pcBuf, ui32Len, translate, &used);
+		console->UARTTxWriteIndex = (console->UARTTxWriteIndex + used) % UART_TX_BUFFER_SIZE;
+
+		// If we have anything in the buffer, make sure that the UART is set up to transmit it.
+		UARTStartTransmit(console);
+	}
+	else
+	{
+		// Only producer writes 'pendingHead', so that copied characters stay invisible to consumer until published.
+		written = RingWrite(ring->buffer, ring->size, ring->pendingHead & (ring->size - 1), ring->size - (ring->pendingHead - ring->tail),
+							pcBuf, ui32Len, translate, &used);
+		ring->pendingHead += used;
+
+		// Publish characters unless calling thread holds transmission, or if ring is full so that it can be drained.
+		if(ring->holdCount == 0 || written < ui32Len)
+			PublishTxRing(console, ring);
+	}
+
+	// Return the number of characters written.
+	return(written);
+}
+
+//---------------------------------------------------------------------------
+// Ring copy:
+// Copies 'length' bytes to a ring buffer of 'size' bytes from 'offset',
+// wrapping around buffer end if needed.
+//---------------------------------------------------------------------------
+static void RingCopy(char* buffer, uint32_t size, uint32_t offset, const char* src, uint32_t length)
+{
+	uint32_t first = size - offset;
+
+	if(first > length)
+		first = length;
+
+	memcpy(buffer + offset, src, first);
+	memcpy(buffer, src + first, length - first);
+}
+
+//---------------------------------------------------------------------------
+// Ring write:
+// Copies as many characters as possible from 'pcBuf' to a ring buffer with
+// 'freeSpace' free bytes from 'offset', one run between newlines at a time.
+// If 'translate' is true, LF characters are replaced with CRLF pairs (both
+// characters must fit so that a retry from 'UARTwriteTimeout' doesn't
+// duplicate '\r'). Returns the count of characters consumed from 'pcBuf' and
+// gives the count of bytes used in ring buffer through 'pui32Used'.
+//---------------------------------------------------------------------------
+static uint32_t RingWrite(char* buffer, uint32_t size, uint32_t offset, uint32_t freeSpace, const char* pcBuf, uint32_t ui32Len, bool translate, uint32_t* pui32Used)
+{
+	uint32_t ui32Idx = 0, used = 0, run;
+	const char* pcNewline;
+
+	while(ui32Idx < ui32Len && used < freeSpace)
+	{
+		// Copy characters up to next newline (or as many as fit).
+		run = ui32Len - ui32Idx;
+		pcNewline = translate ? (const char*)memchr(pcBuf + ui32Idx, '\n', run) : NULL;
+		if(pcNewline != NULL)
+			run = pcNewline - (pcBuf + ui32Idx);
+		if(run > freeSpace - used)
+			run = freeSpace - used;
+
+		RingCopy(buffer, size, (offset + used) % size, pcBuf + ui32Idx, run);
+		used += run;
+		ui32Idx += run;
+
+		// Translate newline to CRLF.
+		if(pcNewline == pcBuf + ui32Idx)
 		{
-			if(!IsBufferFull(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE))
-			{
-				console->UARTTxBuffer[console->UARTTxWriteIndex] = '\r';
-				ADVANCE_TX_BUFFER_INDEX(console->UARTTxWriteIndex);
-			}
-			else
-			{
-				// Buffer is full - discard remaining characters and return.
+			if(freeSpace - used < 2)
 				break;
-			}
-		}
 
-		// Send the character to the UART output.
-		if(!IsBufferFull(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE))
-		{
-			console->UARTTxBuffer[console->UARTTxWriteIndex] = pcBuf[uIdx];
-			ADVANCE_TX_BUFFER_INDEX(console->UARTTxWriteIndex);
+			buffer[(offset + used) % size] = '\r';
+			buffer[(offset + used + 1) % size] = '\n';
+			used += 2;
+			ui32Idx++;
 		}
-		else
+	}
+
+	*pui32Used = used;
+	return ui32Idx;
+}
+
+//---------------------------------------------------------------------------
+// Publish transmit ring:
+// Makes characters copied to given producer ring visible to UART console
+// interrupt handler and pends UART interrupt so that it merges them.
+//---------------------------------------------------------------------------
+static void PublishTxRing(UARTConsole* console, UARTTxRing* ring)
+{
+	if(ring->head != ring->pendingHead)
+	{
+		ring->head = ring->pendingHead;
+		MAP_IntPendSet(UARTInts[console->PortNum]);
+	}
+}
+
+//---------------------------------------------------------------------------
+// Merge transmit rings:
+// Moves writes published by producer rings into transmit buffer, visiting
+// rings round-robin. A ring whose writes don't fit in transmit buffer is
+// resumed first on next call so that writes are never interleaved. Must only
+// be called from UART console interrupt handler thread.
+//---------------------------------------------------------------------------
+static void MergeTxRings(UARTConsole* console)
+{
+	UARTTxRing* ring;
+	uint32_t i, length, offset, first;
+
+	while(1)
+	{
+		// If no ring is being merged, pick the next ring with published writes (if any).
+		if(console->TxMergeRing == NULL)
 		{
-			// Buffer is full - discard remaining characters and return.
-			break;
+			for(i = 0; i < console->TxRingCount; ++i)
+			{
+				ring = console->TxRings[(console->TxNextRing + i) % console->TxRingCount];
+				if(ring->head != ring->tail)
+					break;
+			}
+			if(i == console->TxRingCount)
+				return;
+
+			console->TxNextRing = (console->TxNextRing + i + 1) % console->TxRingCount;
+			console->TxMergeRing = ring;
+			console->TxMergeEnd = ring->head;
 		}
+
+		// Copy as many published bytes as fit in transmit buffer (ring content may wrap around its end).
+		ring = console->TxMergeRing;
+		length = console->TxMergeEnd - ring->tail;
+		first = UART_TX_BUFFER_SIZE - 1 - GetBufferCount(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE);
+		if(length > first)
+			length = first;
+
+		offset = ring->tail & (ring->size - 1);
+		first = ring->size - offset;
+		if(first > length)
+			first = length;
+
+		RingCopy((char*)console->UARTTxBuffer, UART_TX_BUFFER_SIZE, console->UARTTxWriteIndex, ring->buffer + offset, first);
+		RingCopy((char*)console->UARTTxBuffer, UART_TX_BUFFER_SIZE, (console->UARTTxWriteIndex + first) % UART_TX_BUFFER_SIZE, ring->buffer, length - first);
+		console->UARTTxWriteIndex = (console->UARTTxWriteIndex + length) % UART_TX_BUFFER_SIZE;
+		ring->tail += length;
+
+		// If transmit buffer is full, merge will be resumed on next interrupt.
+		if(ring->tail != console->TxMergeEnd)
+			return;
+
+		console->TxMergeRing = NULL;
 	}
+}
 
-	// If we have anything in the buffer, make sure that the UART is set
-	// up to transmit it.
-	if(!IsBufferEmpty(&console->UARTTxReadIndex, &console->UARTTxWriteIndex))
+//---------------------------------------------------------------------------
+// Writes a string of characters to the UART output, blocking while transmit
+// buffer is full.
+//
+// \param pcBuf points to a buffer containing the string to transmit.
+// \param ui32Len is the length of the string to transmit.
+// \param timeout is the maximum time to wait for each transmit buffer drain,
+// in the unit of user-defined 'TxWaitCallback'.
+//
+// This function behaves like UARTwrite() except that, instead of discarding
+// characters that don't fit in the transmit buffer, it waits (through
+// callbacks given to SetTxBackpressureCallbacks()) for UART console interrupt
+// handler to drain the transmit buffer below its low-water mark. If no
+// callbacks have been registered, this function is equivalent to UARTwrite().
+// If called from UART console interrupt handler thread (command callbacks
+// included), this function doesn't wait as it would wait for itself.
+//
+// \return Returns the count of characters written, which is less than
+// \e ui32Len if timeout expired.
+//---------------------------------------------------------------------------
+int UARTwriteTimeout(UARTConsole* console, const char *pcBuf, uint32_t ui32Len, uint32_t timeout)
+{
+	uint32_t written, ui32Int;
+
+	ASSERT(console != NULL);
+	ASSERT(pcBuf != NULL);
+
+	UARTTxRing* ring = console->TxRingSelect != NULL ? console->TxRingSelect() : NULL;
+
+	written = UARTwrite(console, pcBuf, ui32Len);
+
+	if(written < ui32Len && console->TxWait != NULL && !console->IsInIntHandler)
 	{
-		UARTPrimeTransmit(console);
-		MAP_UARTIntEnable(console->UARTBase, UART_INT_TX);
+		// Count this writer as waiting before checking buffer count so that interrupt handler can't miss it.
+		ui32Int = MAP_IntMasterDisable();
+		console->TxWaitersCount++;
+		if(!ui32Int)
+			MAP_IntMasterEnable();
+
+		while(written < ui32Len)
+		{
+			// Producer ring writers wait while their ring can't hold a CRLF pair (interrupt handler merges it as transmit buffer drains).
+			if(ring != NULL ? (ring->size - (ring->pendingHead - ring->tail) < 2) :
+					(GetBufferCount(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE) > console->TxLowWaterMark))
+				if(!console->TxWait(timeout))
+					break;
+
+			written += UARTwrite(console, pcBuf + written, ui32Len - written);
+		}
+
+		ui32Int = MAP_IntMasterDisable();
+		bool othersWaiting = --console->TxWaitersCount != 0;
+		if(!ui32Int)
+			MAP_IntMasterEnable();
+
+		// A single drain notification may have woken this writer only: hand it over to remaining waiters.
+		if(othersWaiting && GetBufferCount(&console->UARTTxReadIndex, &console->UARTTxWriteIndex, UART_TX_BUFFER_SIZE) <= console->TxLowWaterMark)
+			console->TxDrained();
 	}
 
-	// Return the number of characters written.
-	return(uIdx);
+	return(written);
 }
 
 //---------------------------------------------------------------------------
@@ -697,48 +1271,31 @@ unsigned char UARTgetc(UARTConsole* console)
 	return(cChar);
 }
 
-//----------------------------------------------------------------------------
-// A simple UART based vprintf function supporting \%c, \%d, \%p, \%s, \%u,
-// \%x, and \%X.
-//
-// \param pcString is the format string.
-// \param vaArgP is a variable argument list pointer whose content will depend
-// upon the format string passed in \e pcString.
-//
-// This function is very similar to the C library <tt>vprintf()</tt> function.
-// All of its output will be sent to the UART.  Only the following formatting
-// characters are supported:
-//
-// - \%c to print a character
-// - \%d or \%i to print a decimal value
-// - \%s to print a string
-// - \%u to print an unsigned decimal value
-// - \%x to print a hexadecimal value using lower case letters
-// - \%X to print a hexadecimal value using lower case letters (not upper case
-// letters as would typically be used)
-// - \%p to print a pointer as a hexadecimal value
-// - \%\% to print out a \% character
-//
-// For \%s, \%d, \%i, \%u, \%p, \%x, and \%X, an optional number may reside
-// between the \% and the format character, which specifies the minimum number
-// of characters to use for that value; if preceded by a 0 then the extra
-// characters will be filled with zeros instead of spaces.  For example,
-// ``\%8d'' will use eight characters to print the decimal value with spaces
-// added to reach eight; ``\%08d'' will use eight characters as well but will
-// add zeroes instead of spaces.
-//
-// The type of the arguments in the variable arguments list must match the
-// requirements of the format string.  For example, if an integer was passed
-// where a string was expected, an error of some kind will most likely occur.
-//----------------------------------------------------------------------------
-void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
+//---------------------------------------------------------------------------
+// Format write:
+// Writes a piece of formatted output, waiting for transmit buffer to drain
+// if asked to (see 'UARTwriteTimeout').
+//---------------------------------------------------------------------------
+static inline int FormatWrite(UARTConsole* console, bool wait, uint32_t timeout, const char *pcBuf, uint32_t ui32Len)
 {
-	uint32_t ui32Idx, ui32Value, ui32Pos, ui32Count, ui32Base, ui32Neg;
-	char *pcStr, pcBuf[16], cFill;
+	return wait ? UARTwriteTimeout(console, pcBuf, ui32Len, timeout) : UARTwrite(console, pcBuf, ui32Len);
+}
+
+//---------------------------------------------------------------------------
+// Format transmission:
+// Formats given string and arguments to UART console (see 'UARTvprintf').
+//---------------------------------------------------------------------------
+static void FormatTx(UARTConsole* console, bool wait, uint32_t timeout, const char *pcString, va_list vaArgP)
+{
+	uint32_t ui32Idx, ui32Value, ui32Pos, ui32Count, ui32Base, ui32Neg, ui32Precision;
+	char *pcStr, pcBuf[24], cFill;
 
 	ASSERT(console != NULL);
 	ASSERT(pcString != NULL);
 
+	// Publish the whole formatted string as a single write.
+	UARTHoldTx(console);
+
 	// Loop while there are more characters in the string.
 	while(*pcString)
 	{
@@ -746,7 +1303,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 		for(ui32Idx = 0; (pcString[ui32Idx] != '%') && (pcString[ui32Idx] != '\0'); ui32Idx++) { }
 
 		// Write this portion of the string.
-		UARTwrite(console, pcString, ui32Idx);
+		FormatWrite(console, wait, timeout, pcString, ui32Idx);
 
 		// Skip the portion of the string that was written.
 		pcString += ui32Idx;
@@ -760,6 +1317,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 			// Set the digit count to zero, and the fill character to space (in other words, to the defaults).
 			ui32Count = 0;
 			cFill = ' ';
+			ui32Precision = UART_PRINTF_FLOAT_PRECISION;
 
 			// It may be necessary to get back here to process more characters.  Goto's aren't pretty, but effective.
 			// I feel extremely dirty for using not one but two of the beasts.
@@ -794,6 +1352,63 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 				goto again;
 			}
 
+			// Handle the precision of %f command (decimal count).
+			case '.':
+			{
+				ui32Precision = 0;
+				if(*pcString == '*')
+				{
+					// Precision given by an int argument (negative precision means default one).
+					int32_t i32Precision = va_arg(vaArgP, int);
+					ui32Precision = i32Precision < 0 ? UART_PRINTF_FLOAT_PRECISION : (uint32_t)i32Precision;
+					pcString++;
+				}
+				while((*pcString >= '0') && (*pcString <= '9'))
+					ui32Precision = ui32Precision * 10 + (*pcString++ - '0');
+
+				// Get the next character.
+				goto again;
+			}
+
+			// Handle the %f command.
+			case 'f':
+			{
+				// Get the value from the varargs (floats are promoted to double) and convert it (at most 21 characters).
+				if(ui32Precision > FTOA_MAX_DECIMAL_COUNT)
+					ui32Precision = FTOA_MAX_DECIMAL_COUNT;
+				ui32Pos = ftoa2((float)va_arg(vaArgP, double), pcBuf, (uint8_t)ui32Precision, false);
+
+				// ftoa omits the fractional part when it rounds to zero: pad it to the precision (not NaN nor inf).
+				if((ui32Precision > 0) && (pcBuf[ui32Pos - 1] >= '0') && (pcBuf[ui32Pos - 1] <= '9'))
+				{
+					for(ui32Idx = 0; (ui32Idx < ui32Pos) && (pcBuf[ui32Idx] != '.'); ui32Idx++)
+					{
+					}
+					if(ui32Idx == ui32Pos)
+					{
+						pcBuf[ui32Pos++] = '.';
+						for(ui32Idx = 0; ui32Idx < ui32Precision; ui32Idx++)
+							pcBuf[ui32Pos++] = '0';
+					}
+				}
+				ui32Idx = 0;
+
+				// If the value is negative and padded with zeros, then place the minus sign before the padding.
+				if((cFill == '0') && (pcBuf[0] == '-'))
+				{
+					FormatWrite(console, wait, timeout, pcBuf, 1);
+					ui32Idx = 1;
+				}
+
+				// Write any required padding characters, then the value.
+				for(; ui32Count > ui32Pos; ui32Count--)
+					FormatWrite(console, wait, timeout, &cFill, 1);
+				FormatWrite(console, wait, timeout, pcBuf + ui32Idx, ui32Pos - ui32Idx);
+
+				// This command has been handled.
+				break;
+			}
+
 			// Handle the %c command.
 			case 'c':
 			{
@@ -801,7 +1416,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 				ui32Value = va_arg(vaArgP, uint32_t);
 
 				// Print out the character.
-				UARTwrite(console, (char *)&ui32Value, 1);
+				FormatWrite(console, wait, timeout, (char *)&ui32Value, 1);
 
 				// This command has been handled.
 				break;
@@ -851,7 +1466,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 				for(ui32Idx = 0; pcStr[ui32Idx] != '\0'; ui32Idx++) { }
 
 				// Write the string.
-				UARTwrite(console, pcStr, ui32Idx);
+				FormatWrite(console, wait, timeout, pcStr, ui32Idx);
 
 				// Write any required padding spaces
 				if(ui32Count > ui32Idx)
@@ -859,7 +1474,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 					ui32Count -= ui32Idx;
 					while(ui32Count--)
 					{
-						UARTwrite(console, " ", 1);
+						FormatWrite(console, wait, timeout, " ", 1);
 					}
 				}
 
@@ -947,7 +1562,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 					pcBuf[ui32Pos++] = ASCIIHexMap[(ui32Value / ui32Idx) % ui32Base];
 
 				// Write the string.
-				UARTwrite(console, pcBuf, ui32Pos);
+				FormatWrite(console, wait, timeout, pcBuf, ui32Pos);
 
 				// This command has been handled.
 				break;
@@ -957,7 +1572,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 			case '%':
 			{
 				// Simply write a single %.
-				UARTwrite(console, pcString - 1, 1);
+				FormatWrite(console, wait, timeout, pcString - 1, 1);
 
 				// This command has been handled.
 				break;
@@ -967,7 +1582,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 			default:
 			{
 				// Indicate an error.
-				UARTwrite(console, "ERROR", 5);
+				FormatWrite(console, wait, timeout, "ERROR", 5);
 
 				// This command has been handled.
 				break;
@@ -975,11 +1590,71 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 			}
 		}
 	}
+
+	UARTReleaseTx(console);
+}
+
+//----------------------------------------------------------------------------
+// A simple UART based vprintf function supporting \%c, \%d, \%f, \%p, \%s,
+// \%u, \%x, and \%X.
+//
+// \param pcString is the format string.
+// \param vaArgP is a variable argument list pointer whose content will depend
+// upon the format string passed in \e pcString.
+//
+// This function is very similar to the C library <tt>vprintf()</tt> function.
+// All of its output will be sent to the UART.  Only the following formatting
+// characters are supported:
+//
+// - \%c to print a character
+// - \%d or \%i to print a decimal value
+// - \%f to print a floating point value
+// - \%s to print a string
+// - \%u to print an unsigned decimal value
+// - \%x to print a hexadecimal value using lower case letters
+// - \%X to print a hexadecimal value using lower case letters (not upper case
+// letters as would typically be used)
+// - \%p to print a pointer as a hexadecimal value
+// - \%\% to print out a \% character
+//
+// For \%s, \%d, \%i, \%u, \%p, \%x, and \%X, an optional number may reside
+// between the \% and the format character, which specifies the minimum number
+// of characters to use for that value; if preceded by a 0 then the extra
+// characters will be filled with zeros instead of spaces.  For example,
+// ``\%8d'' will use eight characters to print the decimal value with spaces
+// added to reach eight; ``\%08d'' will use eight characters as well but will
+// add zeroes instead of spaces.
+//
+// For \%f, the same optional width may be followed by a precision
+// (``\%.4f'' or ``\%08.3f''), which is the decimal count (6 by default, 9
+// at most). Unlike 'ftoa', the fractional part is padded to the precision
+// even if it rounds to zero (``\%.4f'' of 2.0 prints ``2.0000''). The
+// precision can also be given by an int argument (``\%.*f'').
+//
+// The type of the arguments in the variable arguments list must match the
+// requirements of the format string.  For example, if an integer was passed
+// where a string was expected, an error of some kind will most likely occur.
+//----------------------------------------------------------------------------
+void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
+{
+	FormatTx(console, false, 0, pcString, vaArgP);
+}
+
+//----------------------------------------------------------------------------
+// A vprintf function which waits for transmit buffer to drain instead of
+// discarding characters which don't fit in it (at most 'timeout' ticks each
+// time, see 'UARTwriteTimeout'). Formatting is the same as 'UARTvprintf' and
+// no intermediate string is built: each piece of output is written as soon as
+// it is formatted, all of them being published as a single write.
+//----------------------------------------------------------------------------
+void UARTvprintfTimeout(UARTConsole* console, uint32_t timeout, const char *pcString, va_list vaArgP)
+{
+	FormatTx(console, true, timeout, pcString, vaArgP);
 }
 
 //---------------------------------------------------------------------------
-// A simple UART based printf function supporting \%c, \%d, \%p, \%s, \%u,
-// \%x, and \%X.
+// A simple UART based printf function supporting \%c, \%d, \%f, \%p, \%s,
+// \%u, \%x, and \%X.
 //
 // \param pcString is the format string.
 // \param ... are the optional arguments, which depend on the contents of the
@@ -991,6 +1666,7 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 //
 // - \%c to print a character
 // - \%d or \%i to print a decimal value
+// - \%f to print a floating point value
 // - \%s to print a string
 // - \%u to print an unsigned decimal value
 // - \%x to print a hexadecimal value using lower case letters
@@ -1007,6 +1683,12 @@ void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP)
 // added to reach eight; ``\%08d'' will use eight characters as well but will
 // add zeroes instead of spaces.
 //
+// For \%f, the same optional width may be followed by a precision
+// (``\%.4f'' or ``\%08.3f''), which is the decimal count (6 by default, 9
+// at most). Unlike 'ftoa', the fractional part is padded to the precision
+// even if it rounds to zero (``\%.4f'' of 2.0 prints ``2.0000''). The
+// precision can also be given by an int argument (``\%.*f'').
+//
 // The type of the arguments after \e pcString must match the requirements of
 // the format string.  For example, if an integer was passed where a string
 // was expected, an error of some kind will most likely occur.
@@ -1024,6 +1706,20 @@ void UARTprintf(UARTConsole* console, const char *pcString, ...)
 	va_end(vaArgP);
 }
 
+//---------------------------------------------------------------------------
+// A printf function which waits for transmit buffer to drain (at most
+// 'timeout' ticks each time) instead of discarding characters (see
+// 'UARTvprintfTimeout').
+//---------------------------------------------------------------------------
+void UARTprintfTimeout(UARTConsole* console, uint32_t timeout, const char *pcString, ...)
+{
+	va_list vaArgP;
+
+	va_start(vaArgP, pcString);
+	UARTvprintfTimeout(console, timeout, pcString, vaArgP);
+	va_end(vaArgP);
+}
+
 //-------------------------------------------
 // UARTRxBytesAvail:
 // Determines the number of bytes of data
@@ -1146,6 +1842,13 @@ void UARTFlushTx(UARTConsole* console, bool bDiscard)
 		// The remaining data should be discarded, so temporarily turn off interrupts.
 		ui32Int = MAP_IntMasterDisable();
 
+		// Abort current transmit uDMA transfer (if any) as it reads from transmit buffer.
+		if(console->DMAEnabled && console->DMATxLength != 0)
+		{
+			MAP_uDMAChannelDisable(console->DMATxChannel);
+			console->DMATxLength = 0;
+		}
+
 		// Flush the transmit buffer.
 		console->UARTTxReadIndex = 0;
 		console->UARTTxWriteIndex = 0;
@@ -1177,7 +1880,7 @@ static void CmdLineProcess(UARTConsole* console, char *input, uint32_t length)
 {
 	char *pcChar = input;
     bool bFindArg = true;
-    CmdLineEntry *psCmdEntry;
+    const CmdLineEntry *psCmdEntry;
 	// Argument counter
     uint_fast8_t ui8Argc = 0;
     // Counter used to iterate over command table.
@@ -1234,37 +1937,29 @@ static void CmdLineProcess(UARTConsole* console, char *input, uint32_t length)
 
     		for(cntr = 0; cntr < console->CmdTable.used; ++cntr)
     		{
-    			UARTprintf(console, " - %s:		%s\n", console->CmdTable.array[cntr].name, console->CmdTable.array[cntr].help);
+    			UARTprintf(console, " - %s:		%s\n", console->CmdTable.entries[cntr]->name, console->CmdTable.entries[cntr]->help);
     		}
     		UARTwrite(console, "\nTivacopter> ", 13);
     		return;
     	}
 
-    	// Start at the beginning of the command table, to look for a matching command.
-    	psCmdEntry = &(console->CmdTable.array[0]);
+    	// Look for a matching command in command hash index.
+    	psCmdEntry = FindCmd(console, console->Argv[0]);
 
-    	// Search through the command table.
-    	for(cntr = 0; cntr < console->CmdTable.used; ++cntr)
+    	// If a command matches argv[0], then call the function for this command, passing the command line arguments.
+    	if(psCmdEntry != NULL)
     	{
-    		// If this command entry command string matches argv[0], then call
-    		// the function for this command, passing the command line arguments.
-    		if(!strcmp(console->Argv[0], psCmdEntry->name))
-    		{
-    			console->CurrentlyRunningCmd = psCmdEntry;
-    			psCmdEntry->app(ui8Argc, console->Argv);
+    		console->CurrentlyRunningCmd = psCmdEntry;
+    		psCmdEntry->app(ui8Argc, console->Argv);
 
-    			// If cmd app didn't disabled command line interface, we ask user for entering a new command ('> ')
-    			if(!console->CmdLineInterfaceDisabled)
-    			{
-    				UARTwrite(console, "\n\nTivacopter> ", 14);
-        			console->CurrentlyRunningCmd = NULL;
-    			}
-
-    			return;
+    		// If cmd app didn't disabled command line interface, we ask user for entering a new command ('> ')
+    		if(!console->CmdLineInterfaceDisabled)
+    		{
+    			UARTwrite(console, "\n\nTivacopter> ", 14);
+    			console->CurrentlyRunningCmd = NULL;
     		}
 
-    		// Not found, so advance to the next entry.
-    		psCmdEntry++;
+    		return;
     	}
     }
 
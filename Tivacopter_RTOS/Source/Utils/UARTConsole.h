@@ -25,6 +25,31 @@
 #define UART_TX_BUFFER_SIZE     4096
 #endif
 
+//-----------------------------------------------
+// Size of each of the two receive ping-pong
+// buffers used when uDMA is enabled.
+//-----------------------------------------------
+#ifndef UART_DMA_RX_BUFFER_SIZE
+#define UART_DMA_RX_BUFFER_SIZE 64
+#endif
+
+//-----------------------------------------------
+// Default transmit buffer low-water mark: writers
+// blocked by 'UARTwriteTimeout' are released as
+// soon as the transmit buffer holds less bytes.
+//-----------------------------------------------
+#ifndef UART_TX_LOW_WATER_MARK
+#define UART_TX_LOW_WATER_MARK  (UART_TX_BUFFER_SIZE/4)
+#endif
+
+//-----------------------------------------------
+// Maximum count of transmit producer rings which
+// can be registered to a console.
+//-----------------------------------------------
+#ifndef UART_MAX_TX_RINGS
+#define UART_MAX_TX_RINGS		4
+#endif
+
 //------------------------------------------
 // Defines the maximum number of arguments
 // that can be parsed.
@@ -33,6 +58,47 @@
 #define CMDLINE_MAX_ARGS        8
 #endif
 
+//------------------------------------------
+// Defines the maximum command count of a
+// console (subscribed commands and static
+// command tables entries) and the size of
+// its command hash index, which must be a
+// power of two greater than command count.
+//------------------------------------------
+#ifndef UART_CONSOLE_MAX_CMD_COUNT
+#define UART_CONSOLE_MAX_CMD_COUNT	48
+#endif
+#ifndef UART_CONSOLE_CMD_INDEX_SIZE
+#define UART_CONSOLE_CMD_INDEX_SIZE	128
+#endif
+
+#if UART_CONSOLE_MAX_CMD_COUNT > 255
+#error "UART_CONSOLE_MAX_CMD_COUNT can't be greater than 255 (command hash index stores 8 bit entry indexes)."
+#endif
+#if (UART_CONSOLE_CMD_INDEX_SIZE & (UART_CONSOLE_CMD_INDEX_SIZE - 1)) != 0 || UART_CONSOLE_CMD_INDEX_SIZE <= UART_CONSOLE_MAX_CMD_COUNT
+#error "UART_CONSOLE_CMD_INDEX_SIZE must be a power of two greater than UART_CONSOLE_MAX_CMD_COUNT."
+#endif
+
+//------------------------------------------
+// Defines the default decimal count used
+// by UARTprintf '%f' conversion when no
+// precision is given.
+//------------------------------------------
+#ifndef UART_PRINTF_FLOAT_PRECISION
+#define UART_PRINTF_FLOAT_PRECISION	6
+#endif
+
+//------------------------------------------
+// Lets compilers supporting GNU attributes
+// check UARTprintf arguments against
+// constant format strings at compile time.
+//------------------------------------------
+#if defined(__GNUC__) || defined(__TI_GNU_ATTRIBUTE_SUPPORT__)
+#define UART_PRINTF_FORMAT(fmtIdx, argIdx)	__attribute__((format(printf, fmtIdx, argIdx)))
+#else
+#define UART_PRINTF_FORMAT(fmtIdx, argIdx)
+#endif
+
 /*
 //------------------------------------------
 // Defines the maximum command number of
@@ -50,9 +116,66 @@ typedef void (*CmdApp)(int argc, char *argv[]);
 typedef void (*ListeningCallback)(char c);
 
 //------------------------------------------
-// Private structure typedef describing a
-// command that can listen to some character
-// input
+// Transmit backpressure callbacks typedefs:
+// 'TxDrainedCallback' is called while
+// writers wait and transmit buffer drained
+// below its low-water mark, from UART
+// console interrupt handler or from a
+// leaving writer (it hands over to other
+// waiters), so it must not block.
+// 'TxWaitCallback' blocks calling writer
+// until 'TxDrainedCallback' is called or
+// timeout expires (returns false on timeout)
+// For example, users using TI-RTOS could
+// implement these with a binary semaphore.
+//------------------------------------------
+typedef void (*TxDrainedCallback)(void);
+typedef bool (*TxWaitCallback)(uint32_t timeout);
+
+//------------------------------------------
+// Transmit producer ring:
+// Lock-free single-producer/single-consumer
+// ring through which one thread writes its
+// console output. UART console interrupt
+// handler merges rings content into console
+// transmit buffer, one published write at
+// a time, so that outputs of concurrent
+// threads never interleave.
+// User should use API functions instead of
+// modifing directly members of this struct.
+//------------------------------------------
+typedef struct
+{
+	// Ring storage (size must be a power of two).
+	char* buffer;
+	uint32_t size;
+	// Free running indexes: 'head' is only written by producer (once a whole write is copied) and 'tail' only by consumer.
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	// Producer-private index of copied (not yet published) bytes and nesting count of 'UARTHoldTx' calls.
+	uint32_t pendingHead;
+	uint32_t holdCount;
+} UARTTxRing;
+
+//------------------------------------------
+// Transmit ring selector callback typedef:
+// Returns the producer ring of calling
+// thread, or NULL if calling thread writes
+// directly to console transmit buffer (UART
+// console interrupt handler thread must
+// return NULL).
+// For example, users using TI-RTOS could
+// implement it by comparing 'Task_self()'
+// to their tasks handles.
+//------------------------------------------
+typedef UARTTxRing* (*TxRingSelector)(void);
+
+//------------------------------------------
+// Structure typedef describing a command
+// that can listen to some character input.
+// Users may declare 'const' arrays of this
+// structure and register them with
+// 'SubscribeCmdTable'.
 //------------------------------------------
 typedef struct
 {
@@ -62,7 +185,7 @@ typedef struct
     CmdApp app;
     // A pointer to a string of brief help text for the command
     const char* help;
-    // An array of all characters that will be listened for
+    // An array of all characters that will be listened for (NULL means every character, which won't be buffered)
     const char* interestingChars;
     // Callback used when interesting char is received
     ListeningCallback cb;
@@ -81,14 +204,19 @@ typedef struct
 	// The UART base in use
 	uint32_t UARTBase;
 
-	// Dynamic command table provided by the user
+	// Command table provided by the user: subscribed commands are copied in a fixed pool whereas static command
+	// tables are only referenced. Commands are looked up through an open addressing hash index of their names
+	// ('index' slots store entry index + 1, 0 means empty slot).
 	struct
 	{
-		CmdLineEntry* array;
-		uint32_t used;
-		uint32_t size;
+		CmdLineEntry pool[UART_CONSOLE_MAX_CMD_COUNT];
+		uint32_t poolUsed;
+		const CmdLineEntry* entries[UART_CONSOLE_MAX_CMD_COUNT];
+		uint32_t hashes[UART_CONSOLE_MAX_CMD_COUNT];
+		volatile uint32_t used;
+		uint8_t index[UART_CONSOLE_CMD_INDEX_SIZE];
 	} CmdTable;
-	CmdLineEntry* CurrentlyRunningCmd;
+	const CmdLineEntry* CurrentlyRunningCmd;
 
 	// Output ring buffer. Buffer is full if UARTTxReadIndex is one ahead of
 	// UARTTxWriteIndex. Buffer is empty if  the two indices are the same.
@@ -96,12 +224,39 @@ typedef struct
 	volatile uint32_t UARTTxWriteIndex;
 	volatile uint32_t UARTTxReadIndex;
 
+	// Transmit backpressure: low-water mark, user-defined callbacks and count of writers waiting for transmit buffer to drain.
+	uint32_t TxLowWaterMark;
+	TxDrainedCallback TxDrained;
+	TxWaitCallback TxWait;
+	volatile uint32_t TxWaitersCount;
+	// This flag is raised while UART console interrupt handler runs (writers can't wait for transmit buffer to drain from this thread).
+	volatile bool IsInIntHandler;
+
+	// Transmit producer rings: user-defined ring selector, registered rings, index of the next ring to merge (round-robin) and
+	// ring whose writes are being merged with the free running index ending them ('TxMergeRing' is NULL between writes).
+	TxRingSelector TxRingSelect;
+	UARTTxRing* TxRings[UART_MAX_TX_RINGS];
+	uint32_t TxRingCount;
+	uint32_t TxNextRing;
+	UARTTxRing* TxMergeRing;
+	uint32_t TxMergeEnd;
+
 	// Input ring buffer. Buffer is full if  UARTTxReadIndex is one ahead of
 	// UARTTxWriteIndex. Buffer is empty if the two indices are the same.
 	unsigned char UARTRxBuffer[UART_RX_BUFFER_SIZE];
 	volatile uint32_t UARTRxWriteIndex;
 	volatile uint32_t UARTRxReadIndex;
 
+	// uDMA state (see 'UARTConsoleEnableDMA'): channels numbers, receive ping-pong buffers, index of the buffer being
+	// filled, count of its characters already processed and length of the transmit transfer in progress (0 if none).
+	bool DMAEnabled;
+	uint32_t DMARxChannel;
+	uint32_t DMATxChannel;
+	unsigned char DMARxBuffers[2][UART_DMA_RX_BUFFER_SIZE];
+	uint32_t DMARxActive;
+	uint32_t DMARxProcessed;
+	volatile uint32_t DMATxLength;
+
 	// An array to hold the pointers to the command line arguments.
 	char *Argv[CMDLINE_MAX_ARGS + 1];
 
@@ -126,19 +281,31 @@ void UARTConsoleConfig(UARTConsole* console, uint32_t PortNum, uint32_t SrcClock
 
 //---------------------------------------------------------------------------
 // Suscribe command:
-// Add a command line entry to a dynamic command table of specified console.
-// Returns false if dynamic memory allocation failed.
+// Add a command line entry to the command table of specified console.
+// Returns false if console command table is full.
 //---------------------------------------------------------------------------
 bool SubscribeCmd(UARTConsole* console, const char* name, CmdApp app, const char* help);
 
 //---------------------------------------------------------------------------
 // Suscribe listening command:
 // Add a command line entry, which can listen for any received character
-// among the given array, to a dynamic command table of specified console.
-// Returns false if dynamic memory allocation failed.
+// among the given array, to the command table of specified console.
+// If 'interestingChars' is NULL, every received character is given to 'cb'
+// instead of being stored in receive buffer (streaming command).
+// Returns false if console command table is full.
 //---------------------------------------------------------------------------
 bool SubscribeListeningCmd(UARTConsole* console, const char* name, CmdApp app, const char* help, const char* interestingChars, ListeningCallback cb);
 
+//---------------------------------------------------------------------------
+// Suscribe command table:
+// Registers a static array of command line entries (typically 'const' so
+// that it stays in flash) to the command table of specified console.
+// Entries aren't copied: 'table' must remain valid as long as the console
+// is used. Returns false if console command table can't hold every entry
+// (no entry is registered in this case).
+//---------------------------------------------------------------------------
+bool SubscribeCmdTable(UARTConsole* console, const CmdLineEntry table[], uint32_t count);
+
 //---------------------------------------------------------------------------
 // Check argument count:
 // This function must be called by user if argument count verification is
@@ -183,6 +350,59 @@ void DisableCmdLineInterface(UARTConsole* console);
 //----------------------------------------------------------------------------
 void EnableCmdLineInterface(UARTConsole* console);
 
+//---------------------------------------------------------------------------
+// UARTConsoleEnableDMA:
+// Makes specified console use uDMA for both transmission and reception.
+// Transmission is done by uDMA straight out of console transmit buffer and
+// reception uses two ping-pong buffers so that UART interrupts only occur on
+// uDMA transfers completion or on receive timeout (end of a burst).
+// RxChannel and TxChannel are uDMA channel mappings (e.g. UDMA_CH16_UART3RX
+// and UDMA_CH17_UART3TX).
+// This function must be called after UARTConsoleConfig and assumes that the
+// caller has previously enabled uDMA controller and set its control table.
+//---------------------------------------------------------------------------
+void UARTConsoleEnableDMA(UARTConsole* console, uint32_t RxChannel, uint32_t TxChannel);
+
+//----------------------------------------------------------------------------
+// Set transmit backpressure callbacks:
+// Registers user-defined callbacks used by 'UARTwriteTimeout' to block until
+// transmit buffer drained below 'lowWaterMark' bytes.
+// 'drained' is called from UART console interrupt handler thread so it must
+// not block.
+//----------------------------------------------------------------------------
+void SetTxBackpressureCallbacks(UARTConsole* console, uint32_t lowWaterMark, TxDrainedCallback drained, TxWaitCallback wait);
+
+//----------------------------------------------------------------------------
+// Add transmit ring:
+// Registers a producer ring using given buffer ('size' must be a power of
+// two) to specified console. Each thread writing to the console from outside
+// UART console interrupt handler should have its own ring, returned by the
+// selector given to 'SetTxRingSelector', so that its writes are lock-free
+// and safe under preemption.
+// Returns false if console already has UART_MAX_TX_RINGS rings.
+//----------------------------------------------------------------------------
+bool UARTConsoleAddTxRing(UARTConsole* console, UARTTxRing* ring, char* buffer, uint32_t size);
+
+//----------------------------------------------------------------------------
+// Set transmit ring selector:
+// Registers the callback used by write functions to find calling thread
+// producer ring. Without selector, every thread writes directly to console
+// transmit buffer.
+//----------------------------------------------------------------------------
+void SetTxRingSelector(UARTConsole* console, TxRingSelector selector);
+
+//----------------------------------------------------------------------------
+// Hold and release transmission:
+// Writes done by calling thread between 'UARTHoldTx' and 'UARTReleaseTx' are
+// published to UART console interrupt handler as a single write (e.g. a whole
+// JSON object), so that they are never interleaved with other threads output.
+// Calls can be nested. If calling thread ring fills up while held, writes
+// copied so far are published so that 'UARTwriteTimeout' can wait.
+// These functions do nothing if calling thread doesn't have a producer ring.
+//----------------------------------------------------------------------------
+void UARTHoldTx(UARTConsole* console);
+void UARTReleaseTx(UARTConsole* console);
+
 //----------------------------------------------------------------------------
 // Handles UART interrupts.
 // This function handles interrupts from the UART corresponding to specified
@@ -200,10 +420,14 @@ void EnableCmdLineInterface(UARTConsole* console);
 void ConsoleUARTIntHandler(UARTConsole* console,  uint32_t IntStatus);
 
 int UARTwrite(UARTConsole* console, const char *pcBuf, uint32_t ui32Len);
+int UARTwriteRaw(UARTConsole* console, const char *pcBuf, uint32_t ui32Len);
+int UARTwriteTimeout(UARTConsole* console, const char *pcBuf, uint32_t ui32Len, uint32_t timeout);
 int UARTgets(UARTConsole* console, char *pcBuf, uint32_t ui32Len);
 unsigned char UARTgetc(UARTConsole* console);
 void UARTvprintf(UARTConsole* console, const char *pcString, va_list vaArgP);
-void UARTprintf(UARTConsole* console, const char *pcString, ...);
+void UARTprintf(UARTConsole* console, const char *pcString, ...) UART_PRINTF_FORMAT(2, 3);
+void UARTvprintfTimeout(UARTConsole* console, uint32_t timeout, const char *pcString, va_list vaArgP);
+void UARTprintfTimeout(UARTConsole* console, uint32_t timeout, const char *pcString, ...) UART_PRINTF_FORMAT(3, 4);
 int UARTRxBytesAvail(UARTConsole* console);
 int UARTTxBytesFree(UARTConsole* console);
 int UARTPeek(UARTConsole* console, unsigned char ucChar);
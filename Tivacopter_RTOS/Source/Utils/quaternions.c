@@ -13,7 +13,7 @@
 
 //-----------------------------------------------
 // QuaternionToEuler:
-// Computes a Euler angles in degrees from given
+// Computes a Euler angles in radians from given
 // quaternion.
 //-----------------------------------------------
 void QuaternionToEuler(float QIn[4], float* RollDegOut, float* PitchDegOut, float* YawDegOut)
@@ -59,6 +59,24 @@ void QuaternionFromEuler(float QOut[4], float RollDeg, float PitchDeg, float Yaw
 	QOut[Q_D] = SinY * CosP * CosR + CosY * SinP * SinR;
 }
 
+//-----------------------------------------------
+// QuaternionFromEulerZYX:
+// Computes a quaternion from given Euler angles
+// specified in radians (yaw, pitch then roll
+// rotations, as given by 'QuaternionToEuler').
+//-----------------------------------------------
+void QuaternionFromEulerZYX(float QOut[4], float Roll, float Pitch, float Yaw)
+{
+	float CosY = cosf(Yaw / 2.0f), SinY = sinf(Yaw / 2.0f);
+	float CosP = cosf(Pitch / 2.0f), SinP = sinf(Pitch / 2.0f);
+	float CosR = cosf(Roll / 2.0f), SinR = sinf(Roll / 2.0f);
+
+	QOut[Q_A] = CosR * CosP * CosY + SinR * SinP * SinY;
+	QOut[Q_B] = SinR * CosP * CosY - CosR * SinP * SinY;
+	QOut[Q_C] = CosR * SinP * CosY + SinR * CosP * SinY;
+	QOut[Q_D] = CosR * CosP * SinY - SinR * SinP * CosY;
+}
+
 //-----------------------------------------------
 // QuaternionMagnitude:
 // Computes the magnitude of a quaternion by
@@ -128,7 +146,8 @@ void QuaternionNormalize(float QOut[4], float QIn[4])
 
 //------------------------------------------------
 // QuaternionMultiply:
-// Computes the cross product of two quaternions.
+// Computes the Hamilton product QIn1 * QIn2
+// (rotation QIn2 followed by rotation QIn1).
 //------------------------------------------------
 void QuaternionMultiply(float QOut[4], float QIn1[4], float QIn2[4])
 {
@@ -139,10 +158,10 @@ void QuaternionMultiply(float QOut[4], float QIn1[4], float QIn2[4])
 	QOut[Q_B] = QIn2[Q_B]*QIn1[Q_A] + QIn2[Q_A]*QIn1[Q_B] - QIn2[Q_C]*QIn1[Q_D] + QIn2[Q_D]*QIn1[Q_C];
 
 	// Calculate the Y term
-	QOut[Q_C] = QIn2[Q_A]*QIn1[Q_C] + QIn2[Q_B]*QIn1[Q_D] - QIn2[Q_C]*QIn1[Q_A] - QIn2[Q_D]*QIn1[Q_B];
+	QOut[Q_C] = QIn2[Q_A]*QIn1[Q_C] + QIn2[Q_B]*QIn1[Q_D] + QIn2[Q_C]*QIn1[Q_A] - QIn2[Q_D]*QIn1[Q_B];
 
 	// Calculate the Z term
-	QOut[Q_D] = QIn2[Q_A]*QIn1[Q_D] - QIn2[Q_B]*QIn1[Q_C] - QIn2[Q_C]*QIn1[Q_B] + QIn2[Q_D]*QIn1[Q_A];
+	QOut[Q_D] = QIn2[Q_A]*QIn1[Q_D] - QIn2[Q_B]*QIn1[Q_C] + QIn2[Q_C]*QIn1[Q_B] + QIn2[Q_D]*QIn1[Q_A];
 }
 
 //------------------------------------------------
@@ -19,7 +19,7 @@
 
 //-----------------------------------------------
 // QuaternionToEuler:
-// Computes a Euler angles in degrees from given
+// Computes a Euler angles in radians from given
 // quaternion.
 //-----------------------------------------------
 void QuaternionToEuler(float QOut[4], float* RollDegOut, float* PitchDegOut, float* YawDegOut);
@@ -31,6 +31,14 @@ void QuaternionToEuler(float QOut[4], float* RollDegOut, float* PitchDegOut, flo
 //-----------------------------------------------
 void QuaternionFromEuler(float QOut[4], float RollDeg, float PitchDeg, float YawDeg);
 
+//-----------------------------------------------
+// QuaternionFromEulerZYX:
+// Computes a quaternion from given Euler angles
+// specified in radians (yaw, pitch then roll
+// rotations, as given by 'QuaternionToEuler').
+//-----------------------------------------------
+void QuaternionFromEulerZYX(float QOut[4], float Roll, float Pitch, float Yaw);
+
 //-----------------------------------------------
 // QuaternionMagnitude:
 // Computes the magnitude of a quaternion by
@@ -67,7 +75,8 @@ void QuaternionNormalize(float QOut[4], float QIn[4]);
 
 //------------------------------------------------
 // QuaternionMultiply:
-// Computes the cross product of two quaternions.
+// Computes the Hamilton product QIn1 * QIn2
+// (rotation QIn2 followed by rotation QIn1).
 //------------------------------------------------
 void QuaternionMultiply(float QOut[4], float QIn1[4], float QIn2[4]);
 
@@ -9,38 +9,64 @@
 #include "math.h"
 #include "utils.h"
 
-static uint32_t uitoaReal(int32_t value, char* buff, bool AddEndingZero)
+//------------------------------------------
+// Two digits per entry lookup table and
+// powers of ten used by number formatting
+// functions (one division by 100 gives two
+// digits at a time).
+//------------------------------------------
+static const char DigitPairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+static const uint32_t Pow10[10] = { 1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u };
+
+static uint32_t DigitCount(uint32_t value)
 {
-	static char const digit[] = "0123456789";
-	char* It = buff;
+	uint32_t count = 1;
+	while(count < 10 && value >= Pow10[count])
+		count++;
+	return count;
+}
 
-	// Move to where representation ends
-	if(value == 0)
-		It++;
-	else
+// Writes exactly 'count' digits of 'value' (with leading zeros) backward from 'end'
+static void WriteDigits(uint32_t value, char* end, uint32_t count)
+{
+	while(count >= 2)
 	{
-		uint32_t shifter;
-		for(shifter = value; shifter != 0; shifter /= 10)
-			It++;
+		uint32_t pair = (value % 100) * 2;
+		value /= 100;
+		*--end = DigitPairs[pair + 1];
+		*--end = DigitPairs[pair];
+		count -= 2;
 	}
+	if(count != 0)
+		*--end = (char)('0' + value % 10);
+}
 
-	// Get final string length
-	uint32_t length = It - buff;
+// Rounds a positive float to nearest integer (floats from 2^23 are integers and adding 0.5 would round them up)
+static uint32_t RoundToUint(float value)
+{
+	if(value >= 8388608.0f)
+		return (uint32_t)value;
+	return (uint32_t)(value + 0.5f);
+}
 
-	if(AddEndingZero)
-		*It = '\0';
+static uint32_t uitoaReal(uint32_t value, char* buff, bool AddEndingZero)
+{
+	uint32_t length = DigitCount(value);
 
-	// Move back, inserting digits as you go
-	if(value == 0)
-		*--It = '0';
-	else
-	{
-		while(value)
-		{
-			*--It = digit[value % 10];
-			value /= 10;
-		}
-	}
+	WriteDigits(value, buff + length, length);
+
+	if(AddEndingZero)
+		buff[length] = '\0';
 
 	return length;
 }
@@ -61,31 +87,24 @@ uint32_t itoa(int32_t value, char* buff)
 //------------------------------------------
 uint32_t itoa2(int32_t value, char* buff, bool AddEndingZero)
 {
-	if(isnan(value))
-	{
-		buff[0] = 'N';
-		buff[1] = 'a';
-		buff[2] = 'N';
-		return 3;
-	}
-	else if(isinf(value))
-	{
-		buff[0] = value < 0 ? '-' : '+';
-		buff[1] = 'i';
-		buff[2] = 'n';
-		buff[3] = 'f';
-		return 4;
-	}
-
 	if(value < 0)
 	{
 		*buff++ = '-';
-		value  *= -1;
-
-		return uitoaReal(value, buff, AddEndingZero) + 1;
+		// Negate as unsigned so that INT32_MIN doesn't overflow
+		return uitoaReal(0u - (uint32_t)value, buff, AddEndingZero) + 1;
 	}
 
-	return uitoaReal(value, buff, AddEndingZero);
+	return uitoaReal((uint32_t)value, buff, AddEndingZero);
+}
+
+//------------------------------------------
+// uitoa:
+// Unsigned int to char* conversion
+// function.
+//------------------------------------------
+uint32_t uitoa(uint32_t value, char* buff)
+{
+	return uitoaReal(value, buff, true);
 }
 
 //------------------------------------------
@@ -101,17 +120,23 @@ uint32_t ftoa(float value, char* buff, uint8_t DecimalCount)
 // ftoa2:
 // Float to char* conversion function with
 // optional ending '\0'.
+// Value is rounded to 'DecimalCount'
+// decimals (at most 9) and its integer and
+// fractional parts are converted as scaled
+// integers. Fractional part is omitted if
+// it rounds to zero.
 //------------------------------------------
 uint32_t ftoa2(float value, char* buff, uint8_t DecimalCount, bool AddEndingZero)
 {
 	uint32_t length = 0;
-	static char const digit[] = "0123456789";
 
 	if(isnan(value))
 	{
 		buff[0] = 'N';
 		buff[1] = 'a';
 		buff[2] = 'N';
+		if(AddEndingZero)
+			buff[3] = '\0';
 		return 3;
 	}
 	else if(isinf(value))
@@ -120,66 +145,163 @@ uint32_t ftoa2(float value, char* buff, uint8_t DecimalCount, bool AddEndingZero
 		buff[1] = 'i';
 		buff[2] = 'n';
 		buff[3] = 'f';
+		if(AddEndingZero)
+			buff[4] = '\0';
 		return 4;
 	}
 
-	if(value < 0)
+	bool negative = value < 0;
+	if(negative)
+		value = -value;
+
+	if(DecimalCount > FTOA_MAX_DECIMAL_COUNT)
+		DecimalCount = FTOA_MAX_DECIMAL_COUNT;
+
+	// Integer part saturates to uint32_t range
+	uint32_t intValue, decValue = 0;
+	if(value >= 4294967295.0f)
+		intValue = 0xFFFFFFFFu;
+	else if(DecimalCount == 0)
+		intValue = RoundToUint(value);
+	else
 	{
-		buff[length++] = '-';
-		value  *= -1;
+		intValue = (uint32_t)value;
+		decValue = RoundToUint((value - (float)intValue) * (float)Pow10[DecimalCount]);
+
+		// Rounding may carry to integer part (e.g. 0.99999 with 4 decimals)
+		if(decValue >= Pow10[DecimalCount])
+		{
+			decValue -= Pow10[DecimalCount];
+			if(intValue != 0xFFFFFFFFu)
+				intValue++;
+		}
 	}
 
-	uint32_t intValue;
-	if(DecimalCount != 0)
-		intValue = (uint32_t)value;
-	else
-		intValue = (uint32_t)(value + 0.5);
+	// Values rounding to zero are written without sign
+	if(negative && (intValue != 0 || decValue != 0))
+		buff[length++] = '-';
 
 	length += uitoaReal(intValue, buff + length, false);
 
-	if(DecimalCount != 0)
+	if(decValue != 0)
 	{
-		float factor = 1.0f;
-		uint8_t DecCount;
-		for(DecCount = 0; DecCount < DecimalCount; ++DecCount)
-			factor *= 10;
+		buff[length++] = '.';
+		length += DecimalCount;
+		WriteDigits(decValue, buff + length, DecimalCount);
+	}
 
-		uint32_t decValue = (uint32_t)((value - intValue)*factor + 0.5);
+	if(AddEndingZero)
+		buff[length] = '\0';
 
-		if(decValue != 0)
-		{
-			buff += length;
-			*(buff++) = '.';
+	return length;
+}
+
+//------------------------------------------
+// Zigzag varint encode:
+// Maps signed values to unsigned ones
+// (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...)
+// and writes them 7 bits at a time.
+//------------------------------------------
+uint32_t ZigZagVarintEncode(int32_t value, uint8_t* buff)
+{
+	uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	uint32_t length = 0;
 
-			char* It = buff + DecimalCount;
+	while(zigzag >= 0x80)
+	{
+		buff[length++] = (uint8_t)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	buff[length++] = (uint8_t)zigzag;
 
-			if(AddEndingZero)
-				*It = '\0';
+	return length;
+}
 
-			// Move back, inserting decimal part digits as you go
-			while(It > buff)
-			{
-				*--It = digit[decValue % 10];
-				decValue /= 10;
-			}
+//------------------------------------------
+// Quantize:
+// Saturates before float to int conversion
+// (undefined for out of range, infinite or
+// NaN values).
+//------------------------------------------
+int32_t Quantize(float value, float resolution)
+{
+	float scaled = floorf(value / resolution + 0.5f);
 
-			length += DecimalCount + 1;
-		}
+	if(isnan(scaled))
+		return INT32_MIN;
+	if(scaled >= 2147483648.0f)
+		return INT32_MAX;
+	if(scaled <= -2147483648.0f)
+		return INT32_MIN + 1;
+	return (int32_t)scaled;
+}
+
+//------------------------------------------
+// Delta frame encode
+//------------------------------------------
+uint32_t DeltaFrameEncode(const int32_t values[], int32_t previous[], uint32_t count, bool keyframe, uint8_t sequence, uint8_t* buff)
+{
+	uint32_t i, length = 0;
+
+	buff[length++] = (keyframe ? 0x80 : 0x00) | (sequence & 0x7F);
+	for(i = 0; i < count; ++i)
+	{
+		length += ZigZagVarintEncode(keyframe ? values[i] : (int32_t)((uint32_t)values[i] - (uint32_t)previous[i]), buff + length);
+		previous[i] = values[i];
 	}
+
 	return length;
 }
 
+//------------------------------------------
+// Base64 encode:
+// Standard base64 alphabet with '='
+// padding.
+//------------------------------------------
+uint32_t Base64Encode(const uint8_t* data, uint32_t length, char* buff)
+{
+	static char const alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint32_t i, textLength = 0;
+
+	for(i = 0; i + 2 < length; i += 3)
+	{
+		buff[textLength++] = alphabet[data[i] >> 2];
+		buff[textLength++] = alphabet[((data[i] & 0x03) << 4) | (data[i+1] >> 4)];
+		buff[textLength++] = alphabet[((data[i+1] & 0x0F) << 2) | (data[i+2] >> 6)];
+		buff[textLength++] = alphabet[data[i+2] & 0x3F];
+	}
+
+	if(i < length)
+	{
+		buff[textLength++] = alphabet[data[i] >> 2];
+		if(i + 1 < length)
+		{
+			buff[textLength++] = alphabet[((data[i] & 0x03) << 4) | (data[i+1] >> 4)];
+			buff[textLength++] = alphabet[(data[i+1] & 0x0F) << 2];
+		}
+		else
+		{
+			buff[textLength++] = alphabet[(data[i] & 0x03) << 4];
+			buff[textLength++] = '=';
+		}
+		buff[textLength++] = '=';
+	}
+
+	buff[textLength] = '\0';
+	return textLength;
+}
+
 //-----------------------------------------------------------
 // Fast inverse square-root
 // See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
 //-----------------------------------------------------------
 float invSqrt(float x)
 {
+	// Union type punning (a 32 bits integer, 'long' is 64 bits on host unit tests)
+	union { float f; int32_t i; } conversion = { .f = x };
 	float halfx = 0.5f * x;
-	float y = x;
-	long i = *(long*)&y;
-	i = 0x5f3759df - (i>>1);
-	y = *(float*)&i;
+	conversion.i = 0x5f3759df - (conversion.i>>1);
+	float y = conversion.f;
 	y = y * (1.5f - (halfx * y * y));
 	return y;
 }
@@ -38,6 +38,16 @@ uint32_t itoa(int32_t value, char* buff);
 //------------------------------------------
 uint32_t itoa2(int32_t value, char* buff, bool AddEndingZero);
 
+//------------------------------------------
+// uitoa:
+// Unsigned int to char* conversion
+// function.
+//------------------------------------------
+uint32_t uitoa(uint32_t value, char* buff);
+
+// Maximum decimal count handled by ftoa (fractional part is scaled into an uint32_t)
+#define FTOA_MAX_DECIMAL_COUNT		9
+
 //------------------------------------------
 // ftoa:
 // Float to char* conversion function.
@@ -48,9 +58,57 @@ uint32_t ftoa(float value, char* buff, uint8_t DecimalCount);
 // ftoa2:
 // Float to char* conversion function with
 // optional ending '\0'.
+// Value is rounded to 'DecimalCount'
+// decimals (at most 9), fractional part is
+// omitted if it rounds to zero and integer
+// part saturates to uint32_t range.
 //------------------------------------------
 uint32_t ftoa2(float value, char* buff, uint8_t DecimalCount, bool AddEndingZero);
 
+//------------------------------------------
+// Zigzag varint encode:
+// Writes 'value' as a zigzag encoded
+// varint (7 bits per byte, least
+// significant first, MSB set on all bytes
+// but the last one) so that small
+// negative and positive values take few
+// bytes. Returns written bytes count (at
+// most 5).
+//------------------------------------------
+uint32_t ZigZagVarintEncode(int32_t value, uint8_t* buff);
+
+//------------------------------------------
+// Quantize:
+// Rounds 'value' to the nearest multiple of
+// 'resolution' and returns its index,
+// saturated to [INT32_MIN+1, INT32_MAX].
+// NaN gives INT32_MIN.
+//------------------------------------------
+int32_t Quantize(float value, float resolution);
+
+//------------------------------------------
+// Delta frame encode:
+// Writes a frame header byte (bit 7:
+// keyframe flag, bits 0-6: 'sequence')
+// followed by one zigzag varint per value.
+// Keyframes carry 'values' and other frames
+// their differences (modulo 2^32) with
+// 'previous' values, which are then
+// updated. 'buff' must be at least
+// 1+5*count long. Returns written bytes
+// count.
+//------------------------------------------
+uint32_t DeltaFrameEncode(const int32_t values[], int32_t previous[], uint32_t count, bool keyframe, uint8_t sequence, uint8_t* buff);
+
+//------------------------------------------
+// Base64 encode:
+// Encodes 'length' bytes from 'data' to
+// '\0' terminated base64 text ('buff' must
+// be at least 4*((length+2)/3)+1 long).
+// Returns text length.
+//------------------------------------------
+uint32_t Base64Encode(const uint8_t* data, uint32_t length, char* buff);
+
 //-----------------------------------------------------------
 // Fast inverse square-root
 // See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
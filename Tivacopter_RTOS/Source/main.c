@@ -13,6 +13,9 @@
 #include <ti/sysbios/BIOS.h> 				//mandatory - if you call APIs like BIOS_start()
 #include <xdc/runtime/Log.h>				//needed for any Log_info() call
 #include <xdc/cfg/global.h> 				//header file for statically defined objects/handles
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <xdc/runtime/Timestamp.h>
 
 //------------------------------------------
 // TivaWare Header Files
@@ -26,14 +29,46 @@
 #include "driverlib/debug.h"
 #include "driverlib/rom_map.h"
 #include "driverlib/interrupt.h"
+#include "driverlib/udma.h"
+#include "driverlib/adc.h"
 #include "string.h"
 
 #include "Utils\UARTConsole.h"
+#include "Utils/TopicBus.h"
+#include "Utils/BatteryMonitor.h"
 #include "PinMap.h"
 #include "CmdLineWarper.h"
+#include "Settings.h"
 
-#define MIN_BATTERY_LVL 50
-#define MAX_BATTERY_LVL 1000
+//------------------------------------------
+// Battery monitoring (3S LiPo):
+// Cells voltages are sampled each battery
+// level clock period and filtered with a
+// BATTERY_TIME_CONSTANT time constant.
+// Thrust is nominal at
+// BATTERY_NOMINAL_VOLTAGE cell voltage.
+// Thrust sag compensation is computed from
+// balance taps dividers ratios: it stays
+// disabled (BATTERY_SAG_COMPENSATION) until
+// these ratios have been checked (see
+// 'PinMap.h') as wrong ratios would change
+// loop gain by up to
+// BATTERY_MAX_THRUST_SCALE.
+//------------------------------------------
+#define BATTERY_CELL_COUNT			3
+#define BATTERY_SAMPLE_PERIOD		0.08f		// 32 clock ticks of 2.5 ms (see 'BatteryLevel_Clock')
+#define BATTERY_TIME_CONSTANT		0.5f
+#define BATTERY_PRESENT_VOLTAGE		2.5f
+#define BATTERY_LOW_VOLTAGE			3.5f
+#define BATTERY_CRITICAL_VOLTAGE	3.3f
+#define BATTERY_HYSTERESIS			0.1f
+#define BATTERY_FULL_VOLTAGE		4.2f
+#define BATTERY_NOMINAL_VOLTAGE		3.8f
+#define BATTERY_MAX_THRUST_SCALE	1.5f
+
+#ifndef BATTERY_SAG_COMPENSATION
+#define BATTERY_SAG_COMPENSATION	0
+#endif
 
 #ifdef DEBUG
 //-------------------------------------------
@@ -51,8 +86,154 @@ void __error__(char *pcFilename, uint32_t ui32Line)
 UARTConsole Console;
 // Stop buttons flag
 bool ButtonsPushed;
-// UART interrupt status needed by UART console interrupt handler
-static uint32_t IntStatus;
+// Battery monitor updated by battery level software interrupt
+static BatteryMonitor Battery =
+{
+	.cellCount = BATTERY_CELL_COUNT,
+	.filterAlpha = BATTERY_SAMPLE_PERIOD / (BATTERY_TIME_CONSTANT + BATTERY_SAMPLE_PERIOD),
+	.presentVoltage = BATTERY_PRESENT_VOLTAGE,
+	.lowVoltage = BATTERY_LOW_VOLTAGE,
+	.criticalVoltage = BATTERY_CRITICAL_VOLTAGE,
+	.hysteresis = BATTERY_HYSTERESIS,
+	.nominalVoltage = BATTERY_NOMINAL_VOLTAGE,
+	.maxThrustScale = BATTERY_MAX_THRUST_SCALE
+};
+static volatile float BatteryThrustScaleValue = 1.0f;
+// UART interrupt status needed by UART console interrupt handler (accumulated until UART console task handles it)
+static volatile uint32_t IntStatus;
+
+// Console transmit producer rings of tasks writing to UART console and of software interrupts
+static UARTTxRing JSONTxRing, MagnTxRing, I2CTxRing, SwiTxRing;
+static char JSONTxRingBuffer[1024], MagnTxRingBuffer[256], I2CTxRingBuffer[128], SwiTxRingBuffer[64];
+
+//------------------------------------------
+// Console transmit ring selector:
+// Returns producer ring of calling thread.
+// UART console task writes directly to
+// console transmit buffer as it is the
+// one merging producer rings, and so do
+// UART interrupt handler and 'main' (before
+// BIOS start). I2C state machine task
+// writes I2C commands transactions results
+// from their callbacks.
+// Any other writer would preempt the
+// console task in the middle of a merge:
+// it must be given its own ring here.
+//------------------------------------------
+static UARTTxRing* ConsoleTxRingSelector(void)
+{
+	switch(BIOS_getThreadType())
+	{
+	case BIOS_ThreadType_Task:
+	{
+		Task_Handle self = Task_self();
+		if(self == UARTConsole_Task)
+			return NULL;
+		if(self == PeriodicJSONDataSending_Task)
+			return &JSONTxRing;
+		if(self == SendCSVMagn_Task)
+			return &MagnTxRing;
+		if(self == I2CStateMachine_Task)
+			return &I2CTxRing;
+		Log_error1("Error: task 0x%x has no UART console transmit ring.", (xdc_IArg)self);
+		ASSERT(FALSE);
+		return NULL;
+	}
+	case BIOS_ThreadType_Swi:
+		return &SwiTxRing;
+	case BIOS_ThreadType_Hwi:
+	case BIOS_ThreadType_Main:
+		return NULL;
+	default:
+		ASSERT(FALSE);
+		return NULL;
+	}
+}
+
+//------------------------------------------
+// Console transmit buffer drained callback:
+// Called from UART console interrupt
+// handler (or by a writer handing over to
+// other waiters) to release blocked
+// writers.
+//------------------------------------------
+static void ConsoleTxDrained(void)
+{
+	Semaphore_post(UARTTxDrained_Sem);
+}
+
+//------------------------------------------
+// Console transmit wait callback:
+// Blocks writers until console transmit
+// buffer drained or timeout (in RTOS clock
+// ticks) expired.
+//------------------------------------------
+static bool ConsoleTxWait(uint32_t timeout)
+{
+	return Semaphore_pend(UARTTxDrained_Sem, timeout);
+}
+
+//------------------------------------------
+// Topic bus lock and unlock functions:
+// Topics subscribers are notified from
+// tasks and software interrupts so they
+// are protected by disabling interrupts.
+//------------------------------------------
+intptr_t TopicBusLock(void)
+{
+	return (intptr_t)Hwi_disable();
+}
+
+void TopicBusUnlock(intptr_t lock)
+{
+	Hwi_restore((UInt)lock);
+}
+
+//------------------------------------------
+// System time:
+// Returns time in microseconds from CPU
+// timestamp counter (wraps around 2^32 us,
+// about 71 minutes).
+//------------------------------------------
+uint32_t SystemTimeUs(void)
+{
+	static uint32_t CountsPerMicrosecond = 0;
+	Types_Timestamp64 counts;
+
+	if(CountsPerMicrosecond == 0)
+	{
+		Types_FreqHz freq;
+		Timestamp_getFreq(&freq);
+		CountsPerMicrosecond = freq.lo / 1000000;
+	}
+
+	Timestamp_get64(&counts);
+	return (uint32_t)((((uint64_t)counts.hi << 32) | counts.lo) / CountsPerMicrosecond);
+}
+
+//------------------------------------------
+// Topic bus timestamp function:
+// Messages are stamped with system time.
+//------------------------------------------
+uint32_t TopicBusTimestamp(void)
+{
+	return SystemTimeUs();
+}
+
+//------------------------------------------
+// Topic notify semaphore:
+// Topic notify callback posting given
+// semaphore (wakes up subscriber task).
+//------------------------------------------
+void TopicNotifySemaphore(uintptr_t semaphore)
+{
+	Semaphore_post((Semaphore_Handle)semaphore);
+}
+
+//------------------------------------------
+// Static function forward declarations
+//------------------------------------------
+static void Battery_cmd(int argc, char *argv[]);
 
 //------------------------------------------
 // Main
@@ -69,12 +250,25 @@ int main(void)
 
 	// Initialize peripherals
 	PortFunctionInit();
+	SettingsInit();
 
 	// Configure UART console
 	UARTConsoleConfig(&Console, BLUETOOTH_UART_BASE_NUM, CLOCK_FREQ, BLUETOOTH_UART_BAUDRATE);
+	UARTConsoleEnableDMA(&Console, BLUETOOTH_UDMA_RX_CH, BLUETOOTH_UDMA_TX_CH);
+	SetTxBackpressureCallbacks(&Console, UART_TX_LOW_WATER_MARK, ConsoleTxDrained, ConsoleTxWait);
+	UARTConsoleAddTxRing(&Console, &JSONTxRing, JSONTxRingBuffer, sizeof(JSONTxRingBuffer));
+	UARTConsoleAddTxRing(&Console, &MagnTxRing, MagnTxRingBuffer, sizeof(MagnTxRingBuffer));
+	UARTConsoleAddTxRing(&Console, &I2CTxRing, I2CTxRingBuffer, sizeof(I2CTxRingBuffer));
+	UARTConsoleAddTxRing(&Console, &SwiTxRing, SwiTxRingBuffer, sizeof(SwiTxRingBuffer));
+	SetTxRingSelector(&Console, ConsoleTxRingSelector);
 
 	// Add command line API warper commands to UART console
 	SubscribeWarperCmds();
+	if(!SubscribeCmd(&Console, "battery", Battery_cmd, "Prints battery cells voltages, state and thrust compensation."))
+	{
+		Log_error0("Error: UART console command table is full (battery command).");
+		ASSERT(FALSE);
+	}
 
     BIOS_start();
 
@@ -91,7 +285,13 @@ void UARTConsoleTask(void)
 	{
 		Semaphore_pend(UARTConsole_Sem, BIOS_WAIT_FOREVER);
 
-		ConsoleUARTIntHandler(&Console, IntStatus);
+		// Get and reset interrupt status accumulated since last handling
+		UInt key = Hwi_disable();
+		uint32_t status = IntStatus;
+		IntStatus = 0;
+		Hwi_restore(key);
+
+		ConsoleUARTIntHandler(&Console, status);
 	}
 }
 
@@ -100,9 +300,10 @@ void UARTConsoleTask(void)
 //------------------------------------------
 void UART3IntHandler(void)
 {
-	// Get and clear the current interrupt source(s)
-	IntStatus = MAP_UARTIntStatus(BLUETOOTH_UART_BASE, true);
-	MAP_UARTIntClear(BLUETOOTH_UART_BASE, IntStatus);
+	// Get and clear the current interrupt source(s) (status is empty if interrupt was pended by a console producer ring)
+	uint32_t status = MAP_UARTIntStatus(BLUETOOTH_UART_BASE, true);
+	MAP_UARTIntClear(BLUETOOTH_UART_BASE, status);
+	IntStatus |= status;
 
 	// As bluetooth communication isn't critical, we handle it in a low priority task rather than in this software interrupt.
 	Semaphore_post(UARTConsole_Sem);
@@ -120,17 +321,70 @@ void beep(bool state)
 }
 
 //------------------------------------------
-// Battery level periodic interrupt.
-// TODO: le faire >.<
+// Battery thrust scale:
+// Returns the factor by which motors
+// thrusts must be scaled to compensate
+// battery voltage sag.
+//------------------------------------------
+float GetBatteryThrustScale(void)
+{
+	return BatteryThrustScaleValue;
+}
+
+//------------------------------------------
+// Show battery level:
+// Lights up to four LEDs depending on
+// weakest cell voltage.
+//------------------------------------------
+static void ShowBatteryLevel(float cellVoltage)
+{
+	int32_t level = (int32_t)(4.0f * (cellVoltage - BATTERY_LOW_VOLTAGE) / (BATTERY_FULL_VOLTAGE - BATTERY_LOW_VOLTAGE) + 1.0f);
+
+	GPIOPinWrite(LED1_PORT, LED1_PIN, level >= 1 ? LED1_PIN : 0x00);
+	GPIOPinWrite(LED2_PORT, LED2_PIN, level >= 2 ? LED2_PIN : 0x00);
+	GPIOPinWrite(LED3_PORT, LED3_PIN, level >= 3 ? LED3_PIN : 0x00);
+	GPIOPinWrite(LED4_PORT, LED4_PIN, level >= 4 ? LED4_PIN : 0x00);
+}
+
+//------------------------------------------
+// Battery level periodic interrupt:
+// Reads last balance taps conversion,
+// triggers next one and updates battery
+// monitor. Battery level is shown on LEDs
+// (or LEDs chase if no battery is
+// plugged) and buzzer beeps slowly when
+// battery is low and quickly when it is
+// critical.
 //------------------------------------------
 void BatteryLevelSwi(void)
 {
 	static bool beepState = false;
 	static uint8_t cool = 0x00;
+	static uint8_t beepCount = 0;
 
-	int32_t batteryLvl = -1;
+	if(MAP_ADCIntStatus(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE, false))
+	{
+		uint32_t samples[8];
+		float taps[BATTERY_CELL_COUNT];
+
+		MAP_ADCIntClear(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE);
+		if(MAP_ADCSequenceDataGet(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE, samples) == BATTERY_CELL_COUNT)
+		{
+			taps[0] = samples[0] * (BATTERY_ADC_VREF / 4096.0f) * BATTERY_CELL1_DIVIDER;
+			taps[1] = samples[1] * (BATTERY_ADC_VREF / 4096.0f) * BATTERY_CELL2_DIVIDER;
+			taps[2] = samples[2] * (BATTERY_ADC_VREF / 4096.0f) * BATTERY_CELL3_DIVIDER;
 
-	if(batteryLvl < 0)
+			// Stop alarm once battery recovered (buzzer is also used by remote control)
+			if(BatteryMonitorUpdate(&Battery, taps) && Battery.state <= BATTERY_OK)
+				beep(false);
+#if BATTERY_SAG_COMPENSATION
+			BatteryThrustScaleValue = BatteryThrustScale(&Battery);
+#endif
+		}
+	}
+	MAP_ADCProcessorTrigger(BATTERY_ADC_BASE, BATTERY_ADC_SEQUENCE);
+
+	if(Battery.state == BATTERY_ABSENT)
 	{
 		switch(cool++)
 		{
@@ -160,14 +414,37 @@ void BatteryLevelSwi(void)
 			break;
 		}
 		cool %= 4;
+		return;
 	}
-	else if(batteryLvl < MIN_BATTERY_LVL)
+
+	ShowBatteryLevel(Battery.minCell);
+
+	// Beep every period if battery is critical or every 8 periods if battery is low
+	if(Battery.state == BATTERY_CRITICAL || (Battery.state == BATTERY_LOW && (beepCount++ & 0x07) == 0))
 	{
 		beep(beepState);
 		beepState = !beepState;
 	}
-	else
+	else if(Battery.state == BATTERY_LOW && beepState)
+	{
 		beep(false);
+		beepState = false;
+	}
+}
+
+//------------------------------------------
+// Battery command:
+// Prints battery cells voltages, state and
+// thrust compensation (computed one if
+// compensation is disabled).
+//------------------------------------------
+static void Battery_cmd(int argc, char *argv[])
+{
+	static const char* StatesNames[] = { "absent", "ok", "low", "critical" };
+
+	UARTprintf(&Console, "Battery %s: %.2fV (cells %.3fV %.3fV %.3fV), thrust scale %.3f%s", StatesNames[Battery.state], Battery.voltage,
+				Battery.cells[0], Battery.cells[1], Battery.cells[2], BatteryThrustScale(&Battery),
+				BATTERY_SAG_COMPENSATION ? "" : " (compensation disabled)");
 }
 
 //------------------------------------------